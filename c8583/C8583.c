@@ -6,6 +6,7 @@
 
 #include "C8583.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -15,15 +16,93 @@
 #include "C8583Config.h"
 #include "C8583Utils.h"
 
+#define C8583_ARENA_ALIGNMENT 16
+
+/**
+ * Struct: C8583Arena
+ * ------------------
+ * Memory given to createIso8583InArena, taken from the front.
+ */
+struct C8583Arena {
+  unsigned char* base;
+  size_t capacity;
+  size_t used;
+};
+
 struct C8583Struct {
   short allocated;
   unsigned char mti[5];
-  unsigned char bitmap[16];
+  C8583Bitmap bitmap;
   char message[65];
   char isRequest;
-  struct DataElement* dataElements;
+  C8583Allocator allocator;
+  struct C8583Arena arena;
+  struct DataElements dataElements;
 };
 
+static void* heapAllocate(void* context, size_t size) {
+  (void)context;
+  return malloc(size);
+}
+
+static void* heapReallocate(void* context, void* ptr, size_t oldSize,
+                            size_t newSize) {
+  (void)context;
+  (void)oldSize;
+  return realloc(ptr, newSize);
+}
+
+static void heapRelease(void* context, void* ptr) {
+  (void)context;
+  free(ptr);
+}
+
+static const C8583Allocator heapAllocator = {heapAllocate, heapReallocate,
+                                             heapRelease, NULL};
+
+static size_t alignArenaOffset(const struct C8583Arena* arena,
+                               const size_t offset) {
+  uintptr_t address = (uintptr_t)&arena->base[offset];
+  uintptr_t aligned = (address + C8583_ARENA_ALIGNMENT - 1) &
+                      ~(uintptr_t)(C8583_ARENA_ALIGNMENT - 1);
+
+  return offset + (size_t)(aligned - address);
+}
+
+static void* arenaAllocate(void* context, size_t size) {
+  struct C8583Arena* arena = (struct C8583Arena*)context;
+  size_t start = alignArenaOffset(arena, arena->used);
+
+  if (start > arena->capacity || size > arena->capacity - start) return NULL;
+
+  arena->used = start + size;
+  return &arena->base[start];
+}
+
+static void* arenaReallocate(void* context, void* ptr, size_t oldSize,
+                             size_t newSize) {
+  struct C8583Arena* arena = (struct C8583Arena*)context;
+  unsigned char* block = (unsigned char*)ptr;
+  void* moved = NULL;
+
+  if (block == NULL) return arenaAllocate(context, newSize);
+
+  // the last block grows in place
+  if (block + oldSize == &arena->base[arena->used]) {
+    size_t start = (size_t)(block - arena->base);
+
+    if (newSize > arena->capacity - start) return NULL;
+
+    arena->used = start + newSize;
+    return block;
+  }
+
+  moved = arenaAllocate(context, newSize);
+  if (moved) memcpy(moved, block, oldSize < newSize ? oldSize : newSize);
+
+  return moved;
+}
+
 static short setMti(IsoMsg isoMsg, const unsigned char* datum,
                     const unsigned int datumSize) {
   struct C8583Config config;
@@ -84,33 +163,10 @@ static short isValidDatum(IsoMsg isoMsg, const int field,
   }
 }
 
-static short encodeNextDataElement(const struct DataElement* node,
-                                   unsigned char* packet, const int size,
-                                   char* message) {
-  struct C8583Config config;
-  struct IsoData* encodedData = NULL;
-  int result = 0;
-
-  getC8583Config(&config, node->field);
-  encodedData = encodeDatum(node->datum, node->size, &config, message);
-
-  if (encodedData == NULL) {
-    return 0;
-  }
-
-  result = encodedData->size;
-
-  if (size < result) {
-    sprintf(message, "not enough buffer to pack F[%d] and others", node->field);
-    freeIsoData(encodedData);
-    return 0;
-  }
-
-  memcpy(packet, encodedData->datum, result);
-
-  freeIsoData(encodedData);
-
-  return result;
+static short encodeNextDataElement(const int field, const unsigned char* datum,
+                                   const int datumSize, unsigned char* packet,
+                                   const int size, char* message) {
+  return encodeField(field, packet, size, datum, datumSize, message);
 }
 
 static int addMtiToPacket(const IsoMsg isoMsg, unsigned char* packet,
@@ -144,19 +200,21 @@ static int addMtiToPacket(const IsoMsg isoMsg, unsigned char* packet,
 static int addBitmapToPacket(const IsoMsg isoMsg, unsigned char* packet,
                              const int size) {
   struct C8583Config config;
-  int len = isSecondaryBitmap(isoMsg->bitmap) ? 16 : 8;
+  int len = isSecondaryBitmap(&isoMsg->bitmap) ? 16 : 8;
+  unsigned char bitmap[BITMAP_SIZE];
 
   getC8583Config(&config, BITMAP_1);
+  bitmapToBytes(bitmap, &isoMsg->bitmap);
 
-  if (size < len) {
+  if (size < ((config.outputEncoding == BCD_ENCODING) ? len : len * 2)) {
     strcpy(isoMsg->message, "Not enough buffer to pack bitmap");
     return 0;
   }
 
   if (config.outputEncoding == BCD_ENCODING) {
-    memcpy(packet, isoMsg->bitmap, len);
+    memcpy(packet, bitmap, len);
   } else {
-    c8583BcdToAsc(packet, isoMsg->bitmap, len);
+    c8583BcdToAsc(packet, bitmap, len);
     len *= 2;
   }
 
@@ -165,51 +223,120 @@ static int addBitmapToPacket(const IsoMsg isoMsg, unsigned char* packet,
   return len;
 }
 
+/**
+ * MacStream over a MacFunc: the parts of the packet are contiguous, so only
+ * their extent is recorded and macFunc is called over it once.
+ */
+struct MacFuncStream {
+  MacFunc macFunc;
+  const unsigned char* key;
+  int keySize;
+  const unsigned char* packet;
+  int size;
+};
+
+static short macFuncStreamInit(void* state, const unsigned char* key,
+                               const int keySize) {
+  struct MacFuncStream* stream = (struct MacFuncStream*)state;
+
+  stream->key = key;
+  stream->keySize = keySize;
+  stream->packet = NULL;
+  stream->size = 0;
+
+  return 0;
+}
+
+static void macFuncStreamUpdate(void* state, const unsigned char* data,
+                                const int size) {
+  struct MacFuncStream* stream = (struct MacFuncStream*)state;
+
+  if (stream->packet == NULL) stream->packet = data;
+  stream->size += size;
+}
+
+static short macFuncStreamFinal(void* state, unsigned char* mac) {
+  struct MacFuncStream* stream = (struct MacFuncStream*)state;
+
+  return (*stream->macFunc)(mac, stream->key, stream->keySize, stream->packet,
+                            stream->size);
+}
+
 static int generatePacket(const IsoMsg isoMsg, unsigned char* packet,
                           const int size, const unsigned char* sessionKey,
-                          const int keySize, MacFunc macFunc) {
+                          const int keySize, const MacStream* macStream) {
   int result = 0;
   short status = 0;
-  struct DataElement* node = isoMsg->dataElements;
   char message[65] = {'\0'};
   int macField = -1;
+  int field = 0;
+
+  if (macStream != NULL &&
+      (*macStream->init)(macStream->state, sessionKey, keySize) != 0) {
+    strcpy(isoMsg->message, "Error starting MAC");
+    return 0;
+  }
 
   status = addMtiToPacket(isoMsg, &packet[result], size);
   if (!status) return status;
   result += status;
 
-  if (macFunc != NULL) {
-    macField = isSecondaryBitmap(isoMsg->bitmap) ? 128 : 64;
-    setFieldBit(isoMsg->bitmap, macField);
+  if (macStream != NULL) {
+    macField = isSecondaryBitmap(&isoMsg->bitmap)
+                   ? MESSAGE_AUTHENTICATION_CODE_128
+                   : MESSAGE_AUTHENTICATION_CODE_64;
+    setFieldBit(&isoMsg->bitmap, macField);
   }
 
   status = addBitmapToPacket(isoMsg, &packet[result], size - result);
   if (!status) return status;
   result += status;
 
-  while (node != NULL) {
-    status =
-        encodeNextDataElement(node, &packet[result], size - result, message);
+  if (macStream != NULL) {
+    (*macStream->update)(macStream->state, packet, result);
+  }
+
+  for (field = nextFieldBit(&isoMsg->bitmap, 1); field;
+       field = nextFieldBit(&isoMsg->bitmap, field)) {
+    const unsigned char* datum = NULL;
+    int datumSize = 0;
+
+    // the MAC field's bit is set, its datum comes last
+    datum = peekElement(&isoMsg->dataElements, field, &datumSize);
+    if (datum == NULL) continue;
+
+    status = encodeNextDataElement(field, datum, datumSize, &packet[result],
+                                   size - result, message);
     if (!status) {
       memcpy(isoMsg->message, message, sizeof(isoMsg->message) - 1);
       return 0;
     }
 
-    node = node->next;
+    if (macStream != NULL) {
+      (*macStream->update)(macStream->state, &packet[result], status);
+    }
     result += status;
   }
 
-  if (macFunc != NULL) {
+  if (macStream != NULL) {
     unsigned char mac[65] = {0x00};
-    int macSize = (*macFunc)(mac, sessionKey, keySize, packet, result);
+    int macSize = (*macStream->final)(macStream->state, mac);
 
     if (macSize <= 0) {
       // error generating back
       return 0;
     }
 
+    if (macSize > size - result) {
+      strcpy(isoMsg->message, "Not enough buffer to add MAC");
+      return 0;
+    }
+
     // push it for logging purpose.
-    pushElement(&isoMsg->dataElements, macField, mac, macSize);
+    if (pushElement(&isoMsg->dataElements, macField, mac, macSize) != 0) {
+      strcpy(isoMsg->message, "Out of memory");
+      return 0;
+    }
     memcpy(&packet[result], mac, macSize);
     result += macSize;
   }
@@ -225,19 +352,14 @@ short isEmptyMti(const IsoMsg isoMsg) {
 }
 
 short isEmptyBitmap(const IsoMsg isoMsg) {
-  unsigned char emptyBitmap[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00};
-
-  return (memcmp(emptyBitmap, isoMsg->bitmap, sizeof(isoMsg->bitmap)) == 0) ? 1
-                                                                            : 0;
+  return isBitmapEmpty(&isoMsg->bitmap);
 }
 
 #ifdef C8583_SPY
 
 unsigned char* getMti(const IsoMsg isoMsg) { return isoMsg->mti; }
 
-unsigned char* getBitmap(const IsoMsg isoMsg) { return isoMsg->bitmap; }
+C8583Bitmap* getBitmap(const IsoMsg isoMsg) { return &isoMsg->bitmap; }
 
 #endif
 
@@ -273,12 +395,12 @@ static int getMtiFromPacket(const IsoMsg isoMsg, const unsigned char* packet,
 
 static short isSecondaryBitmapAsc(const char* bitmapAsc) {
   char twoNibbles[3] = {'\0'};
-  unsigned char oneByte[16];
+  unsigned char oneByte[1];
 
   strncpy(twoNibbles, bitmapAsc, 2);
 
   c8583AscToBcd(oneByte, 1, twoNibbles);
-  return isFieldBitSet(oneByte, 1);
+  return (oneByte[0] & 0x80) != 0;
 }
 
 static int getBitmapFromPacket(const IsoMsg isoMsg, const unsigned char* packet,
@@ -291,12 +413,22 @@ static int getBitmapFromPacket(const IsoMsg isoMsg, const unsigned char* packet,
 
   if (config.outputEncoding == ASCII_ENCODING) {
     char ascBitmap[33];
+    unsigned char bitmap[BITMAP_SIZE];
     len = isSecondaryBitmapAsc((const char*)packet) ? 32
                                                     : 16;  // actual len coped
 
+    if (size < len) {
+      strcpy(isoMsg->message, "Bitmap is absent or incomplete");
+      return 0;
+    }
+
     memcpy(ascBitmap, packet, len);
     ascBitmap[len] = '\0';
-    c8583AscToBcd(isoMsg->bitmap, len / 2, ascBitmap);
+    if (!c8583AscToBcd(bitmap, len / 2, ascBitmap)) {
+      strcpy(isoMsg->message, "Bitmap isn't hex");
+      return 0;
+    }
+    bitmapFromBytes(&isoMsg->bitmap, bitmap, len / 2);
 
   } else {
     if (isBcdToAsc(&config)) {
@@ -305,35 +437,95 @@ static int getBitmapFromPacket(const IsoMsg isoMsg, const unsigned char* packet,
       len /= 2;
     }
 
-    memcpy(isoMsg->bitmap, packet, len);
+    if (size < len) {
+      strcpy(isoMsg->message, "Bitmap is absent or incomplete");
+      return 0;
+    }
+
+    bitmapFromBytes(&isoMsg->bitmap, packet, len);
   }
 
-  if (size < len) {
-    strcpy(isoMsg->message, "Bitmap is absent or incomplete");
+  return len;
+}
+
+static short storeDatum(IsoMsg isoMsg, const int field,
+                        const unsigned char* packet, const int pos,
+                        const struct IsoDataView* view, const short copy) {
+  short status = copy ? pushElement(&isoMsg->dataElements, field,
+                                    &packet[pos + view->offset], view->size)
+                      : setElementView(&isoMsg->dataElements, field,
+                                       pos + view->offset, view->size);
+
+  if (status != 0) {
+    strcpy(isoMsg->message, "Out of memory");
     return 0;
   }
 
-  return len;
+  return 1;
 }
 
-static int getNextDatumFromPacket(IsoMsg isoMsg,
-                                  const struct C8583Config* config,
-                                  const unsigned char* packet, const int size) {
-  int result = 0;
-  struct IsoData* decodedDatum =
-      decodeDatum(packet, size, config, isoMsg->message);
+static int getNextDatumFromPacket(IsoMsg isoMsg, const int field,
+                                  const unsigned char* packet, const int pos,
+                                  const int size, const short copy) {
+  struct IsoDataView view;
 
-  if (decodedDatum == NULL) {
-    return result;
+  if (!decodeFieldView(&view, field, &packet[pos], size - pos,
+                       isoMsg->message)) {
+    return 0;
   }
 
-  result = decodedDatum->jumper;
+  if (!storeDatum(isoMsg, field, packet, pos, &view, copy)) return 0;
 
-  pushElement(&isoMsg->dataElements, config->field, decodedDatum->datum,
-              decodedDatum->size);
-  freeIsoData(decodedDatum);
+  return view.jumper;
+}
 
-  return result;
+/**
+ * Compares the MAC field at pos with macStream's MAC of packet[0, pos), the
+ * bytes it was generated over, see generatePacket.
+ */
+static int getMacFromPacket(IsoMsg isoMsg, const int macField,
+                            const unsigned char* packet, const int pos,
+                            const int size, const short copy,
+                            const unsigned char* key, const int keySize,
+                            const MacStream* macStream) {
+  struct IsoDataView view;
+  unsigned char mac[65] = {0x00};
+  unsigned char diff = 0;
+  int macSize = 0;
+  int i = 0;
+
+  if (!isFieldBitSet(&isoMsg->bitmap, macField)) {
+    strcpy(isoMsg->message, "Message has no MAC");
+    return 0;
+  }
+
+  if (!decodeFieldView(&view, macField, &packet[pos], size - pos,
+                       isoMsg->message)) {
+    return 0;
+  }
+
+  if ((*macStream->init)(macStream->state, key, keySize) != 0) {
+    strcpy(isoMsg->message, "Error starting MAC");
+    return 0;
+  }
+  (*macStream->update)(macStream->state, packet, pos);
+  macSize = (*macStream->final)(macStream->state, mac);
+  if (macSize <= 0 || macSize != view.size) {
+    strcpy(isoMsg->message, "Error generating MAC");
+    return 0;
+  }
+
+  for (i = 0; i < macSize; i++) {
+    diff |= mac[i] ^ packet[pos + view.offset + i];
+  }
+  if (diff) {
+    strcpy(isoMsg->message, "MAC mismatch");
+    return 0;
+  }
+
+  if (!storeDatum(isoMsg, macField, packet, pos, &view, copy)) return 0;
+
+  return view.jumper;
 }
 
 static void c8583Debug(IsoMsg isoMsg, const struct C8583Config* config,
@@ -360,7 +552,7 @@ static void c8583Debug(IsoMsg isoMsg, const struct C8583Config* config,
   if (config->field == MESSAGE_TYPE_INDICATOR_0) {
     fprintf(stream, "MTI -> %s\n", asc);
   } else if (config->field == BITMAP_1) {
-    if (isSecondaryBitmap(datum)) {
+    if (datum[0] & 0x80) {
       char primaryBitmap[17] = {'\0'};
       strncpy(primaryBitmap, (char*)asc, 16);
       fprintf(stream, "Primary Bitmap -> %s\n", primaryBitmap);
@@ -377,9 +569,10 @@ static void c8583Debug(IsoMsg isoMsg, const struct C8583Config* config,
 
 DllSpec const char* getMessage(const IsoMsg isoMsg) { return isoMsg->message; }
 
-DllSpec short packDataWithMac(const IsoMsg isoMsg, unsigned char* packet,
-                              const int size, const unsigned char* key,
-                              const int keySize, MacFunc macFunc) {
+DllSpec short packDataWithMacStream(const IsoMsg isoMsg, unsigned char* packet,
+                                    const int size, const unsigned char* key,
+                                    const int keySize,
+                                    const MacStream* macStream) {
   if (isoMsg == NULL) return 0;
   isoMsg->isRequest = 'Y';
 
@@ -393,7 +586,18 @@ DllSpec short packDataWithMac(const IsoMsg isoMsg, unsigned char* packet,
     return 0;
   }
 
-  return generatePacket(isoMsg, packet, size, key, keySize, macFunc);
+  return generatePacket(isoMsg, packet, size, key, keySize, macStream);
+}
+
+DllSpec short packDataWithMac(const IsoMsg isoMsg, unsigned char* packet,
+                              const int size, const unsigned char* key,
+                              const int keySize, MacFunc macFunc) {
+  struct MacFuncStream state = {macFunc, NULL, 0, NULL, 0};
+  const MacStream macStream = {macFuncStreamInit, macFuncStreamUpdate,
+                               macFuncStreamFinal, &state};
+
+  return packDataWithMacStream(isoMsg, packet, size, key, keySize,
+                               macFunc != NULL ? &macStream : NULL);
 }
 
 DllSpec short packData(const IsoMsg isoMsg, unsigned char* packet,
@@ -403,15 +607,12 @@ DllSpec short packData(const IsoMsg isoMsg, unsigned char* packet,
 
 DllSpec void logIsoMsg(const IsoMsg isoMsg, FILE* stream) {
   struct C8583Config config;
-  struct DataElement* node = NULL;
   unsigned int len;
-  char binaryLiteral[129] = {'\0'};
+  int field;
+  unsigned char bitmap[BITMAP_SIZE];
 
   if (isoMsg == NULL) return;
 
-  node = isoMsg->dataElements;
-  bitmapToBinLiteral(binaryLiteral, isoMsg->bitmap);
-
   fprintf(stream, "\n\n");
 
   getC8583Config(&config, MESSAGE_TYPE_INDICATOR_0);
@@ -421,17 +622,23 @@ DllSpec void logIsoMsg(const IsoMsg isoMsg, FILE* stream) {
   getC8583Config(&config, BITMAP_1);
 
   if (isoMsg->isRequest == 'Y') {
-    len = isSecondaryBitmap(isoMsg->bitmap) ? 16 : 8;
+    len = isSecondaryBitmap(&isoMsg->bitmap) ? 16 : 8;
   } else {
     len = getOutputLen(&config);
   }
 
-  c8583Debug(isoMsg, &config, isoMsg->bitmap, len, stream);
+  bitmapToBytes(bitmap, &isoMsg->bitmap);
+  c8583Debug(isoMsg, &config, bitmap, len, stream);
 
-  while (node != NULL) {
-    getC8583Config(&config, node->field);
-    c8583Debug(isoMsg, &config, node->datum, node->size, stream);
-    node = node->next;
+  for (field = nextFieldBit(&isoMsg->bitmap, 1); field;
+       field = nextFieldBit(&isoMsg->bitmap, field)) {
+    int datumSize = 0;
+    const unsigned char* datum =
+        peekElement(&isoMsg->dataElements, field, &datumSize);
+
+    if (datum == NULL) continue;
+    getC8583Config(&config, field);
+    c8583Debug(isoMsg, &config, (unsigned char*)datum, datumSize, stream);
   }
 
   fprintf(stream, "\n\n");
@@ -444,21 +651,34 @@ DllSpec void dumpPacket(FILE* stream, const void* packet,
 }
 
 static int getDataInBitmapFromPacket(IsoMsg isoMsg, const unsigned char* packet,
-                                     const int size) {
-  int nextField, lastField;
+                                     const int pos, const int size,
+                                     const short copy, const unsigned char* key,
+                                     const int keySize,
+                                     const MacStream* macStream) {
+  int nextField, macField;
   int status, result;
-  struct C8583Config config;
 
   result = 0;
-  lastField =
-      isSecondaryBitmap(isoMsg->bitmap) ? SECONDARY_BITMAP : PRIMARY_BITMAP;
-
-  for (nextField = PRIMARY_ACCOUNT_NUMBER_2; nextField < lastField;
-       nextField++) {
-    if (!isFieldBitSet(isoMsg->bitmap, nextField)) continue;
-    getC8583Config(&config, nextField);
-    status =
-        getNextDatumFromPacket(isoMsg, &config, &packet[result], size - result);
+  macField = 0;
+  if (macStream != NULL) {
+    macField = isSecondaryBitmap(&isoMsg->bitmap)
+                   ? MESSAGE_AUTHENTICATION_CODE_128
+                   : MESSAGE_AUTHENTICATION_CODE_64;
+  }
+
+  for (nextField = nextFieldBit(&isoMsg->bitmap, 1);
+       nextField && nextField != macField;
+       nextField = nextFieldBit(&isoMsg->bitmap, nextField)) {
+    status = getNextDatumFromPacket(isoMsg, nextField, packet, pos + result,
+                                    size, copy);
+    if (!status) return 0;
+    result += status;
+  }
+
+  // the MAC is the last field, checked as soon as the bytes before it are
+  if (macStream != NULL) {
+    status = getMacFromPacket(isoMsg, macField, packet, pos + result, size,
+                              copy, key, keySize, macStream);
     if (!status) return 0;
     result += status;
   }
@@ -466,8 +686,10 @@ static int getDataInBitmapFromPacket(IsoMsg isoMsg, const unsigned char* packet,
   return result;
 }
 
-DllSpec short unpackData(const IsoMsg isoMsg, const unsigned char* packet,
-                         const int size) {
+static short unpackPacket(const IsoMsg isoMsg, const unsigned char* packet,
+                          const int size, const short copy,
+                          const unsigned char* key, const int keySize,
+                          const MacStream* macStream) {
   int pos = 0;
   short status = 0;
   const unsigned char* current = packet;
@@ -488,33 +710,139 @@ DllSpec short unpackData(const IsoMsg isoMsg, const unsigned char* packet,
     return 0;
   }
 
-  status = getDataInBitmapFromPacket(isoMsg, &current[pos], size - pos);
+  if (!copy) isoMsg->dataElements.view = packet;
+
+  status = getDataInBitmapFromPacket(isoMsg, packet, pos, size, copy, key,
+                                     keySize, macStream);
   if (!status) return 0;
   pos += status;
 
   return pos;
 }
 
+DllSpec short unpackData(const IsoMsg isoMsg, const unsigned char* packet,
+                         const int size) {
+  return unpackPacket(isoMsg, packet, size, 1, NULL, 0, NULL);
+}
+
+DllSpec short unpackDataView(const IsoMsg isoMsg, const unsigned char* packet,
+                             const int size) {
+  return unpackPacket(isoMsg, packet, size, 0, NULL, 0, NULL);
+}
+
+DllSpec short unpackDataWithMacVerify(const IsoMsg isoMsg,
+                                      const unsigned char* packet,
+                                      const int size, const unsigned char* key,
+                                      const int keySize, MacFunc macFunc) {
+  struct MacFuncStream state = {macFunc, NULL, 0, NULL, 0};
+  const MacStream macStream = {macFuncStreamInit, macFuncStreamUpdate,
+                               macFuncStreamFinal, &state};
+
+  return unpackPacket(isoMsg, packet, size, 1, key, keySize,
+                      macFunc != NULL ? &macStream : NULL);
+}
+
+DllSpec short unpackDataViewWithMacVerify(const IsoMsg isoMsg,
+                                          const unsigned char* packet,
+                                          const int size,
+                                          const unsigned char* key,
+                                          const int keySize, MacFunc macFunc) {
+  struct MacFuncStream state = {macFunc, NULL, 0, NULL, 0};
+  const MacStream macStream = {macFuncStreamInit, macFuncStreamUpdate,
+                               macFuncStreamFinal, &state};
+
+  return unpackPacket(isoMsg, packet, size, 0, key, keySize,
+                      macFunc != NULL ? &macStream : NULL);
+}
+
+DllSpec short unpackDataWithMacStreamVerify(const IsoMsg isoMsg,
+                                            const unsigned char* packet,
+                                            const int size,
+                                            const unsigned char* key,
+                                            const int keySize,
+                                            const MacStream* macStream) {
+  return unpackPacket(isoMsg, packet, size, 1, key, keySize, macStream);
+}
+
+DllSpec short unpackDataViewWithMacStreamVerify(const IsoMsg isoMsg,
+                                                const unsigned char* packet,
+                                                const int size,
+                                                const unsigned char* key,
+                                                const int keySize,
+                                                const MacStream* macStream) {
+  return unpackPacket(isoMsg, packet, size, 0, key, keySize, macStream);
+}
+
 DllSpec const char* getC8583Version() { return "0.0.1"; }
 
-DllSpec IsoMsg createIso8583(void) {
-  IsoMsg isoMsg = (IsoMsg)calloc(1, sizeof(struct C8583Struct));
+static void initIso8583(IsoMsg isoMsg, const C8583Allocator* allocator) {
+  memset(isoMsg, '\0', sizeof(struct C8583Struct));
 
   isoMsg->allocated = 1;
+  isoMsg->allocator = *allocator;
+  isoMsg->dataElements.allocator = &isoMsg->allocator;
+}
+
+DllSpec IsoMsg createIso8583(void) {
+  return createIso8583WithAllocator(NULL);
+}
+
+DllSpec IsoMsg createIso8583WithAllocator(const C8583Allocator* allocator) {
+  IsoMsg isoMsg = NULL;
+
+  if (allocator == NULL) allocator = &heapAllocator;
+
+  isoMsg = (IsoMsg)allocator->allocate(allocator->context,
+                                       sizeof(struct C8583Struct));
+  if (isoMsg == NULL) return NULL;
+
+  initIso8583(isoMsg, allocator);
+  return isoMsg;
+}
+
+DllSpec IsoMsg createIso8583InArena(void* buf, size_t cap) {
+  struct C8583Arena arena;
+  C8583Allocator allocator = {arenaAllocate, arenaReallocate, NULL, NULL};
+  IsoMsg isoMsg = NULL;
+
+  if (buf == NULL) return NULL;
+
+  arena.base = (unsigned char*)buf;
+  arena.capacity = cap;
+  arena.used = 0;
+
+  isoMsg = (IsoMsg)arenaAllocate(&arena, sizeof(struct C8583Struct));
+  if (isoMsg == NULL) return NULL;
+
+  // the arena's state lives in the message it holds
+  allocator.context = &isoMsg->arena;
+  initIso8583(isoMsg, &allocator);
+  isoMsg->arena = arena;
+
   return isoMsg;
 }
 
+DllSpec void resetIso8583(const IsoMsg isoMsg) {
+  if (isoMsg == NULL) return;
+
+  memset(isoMsg->mti, '\0', sizeof(isoMsg->mti));
+  memset(&isoMsg->bitmap, '\0', sizeof(isoMsg->bitmap));
+  memset(isoMsg->message, '\0', sizeof(isoMsg->message));
+  isoMsg->isRequest = '\0';
+
+  resetDataElement(&isoMsg->dataElements);
+}
+
 DllSpec void destroyIso8583(const IsoMsg isoMsg) {
   if (isoMsg == NULL) return;
   if (isoMsg->allocated == 0) return;
 
-  if (isoMsg->dataElements != NULL) {
-    freeDataElement(&isoMsg->dataElements);
-    isoMsg->dataElements = NULL;
-  }
+  freeDataElement(&isoMsg->dataElements);
 
   isoMsg->allocated = 0;
-  free(isoMsg);
+  if (isoMsg->allocator.release) {
+    isoMsg->allocator.release(isoMsg->allocator.context, isoMsg);
+  }
 }
 
 DllSpec short setDatum(const IsoMsg isoMsg, const int field,
@@ -538,14 +866,17 @@ DllSpec short setDatum(const IsoMsg isoMsg, const int field,
     return -3;
   }
 
-  if (isFieldBitSet(isoMsg->bitmap, field)) {
+  if (isFieldBitSet(&isoMsg->bitmap, field)) {
     sprintf(isoMsg->message, "Can't set F[%d] twice", field);
     return -4;
   }
 
-  pushElement(&isoMsg->dataElements, field, datum, datumSize);
+  if (pushElement(&isoMsg->dataElements, field, datum, datumSize) != 0) {
+    strcpy(isoMsg->message, "Out of memory");
+    return -5;
+  }
 
-  setFieldBit(isoMsg->bitmap, field);
+  setFieldBit(&isoMsg->bitmap, field);
 
   return 0;
 }
@@ -564,7 +895,7 @@ DllSpec short getDatum(const IsoMsg isoMsg, const int field,
     return 0;
   }
 
-  ret = getElement(isoMsg->dataElements, field, datum, datumSize);
+  ret = getElement(&isoMsg->dataElements, field, datum, datumSize);
 
   if (ret == 0) {
     sprintf(isoMsg->message, "Can't find DE[%d]", field);
@@ -572,3 +903,38 @@ DllSpec short getDatum(const IsoMsg isoMsg, const int field,
 
   return ret;
 }
+
+DllSpec short getDatumView(const IsoMsg isoMsg, const int field,
+                           const unsigned char** datum, int* datumSize) {
+  const unsigned char* element = NULL;
+  int size = 0;
+
+  if (isoMsg == NULL) return 0;
+
+  if (field == MESSAGE_TYPE_INDICATOR_0) {
+    struct C8583Config config;
+
+    if (isEmptyMti(isoMsg)) return 0;
+    getC8583Config(&config, MESSAGE_TYPE_INDICATOR_0);
+    *datum = isoMsg->mti;
+    *datumSize = config.length;
+    return *datumSize;
+  }
+
+  if (!isFieldInRange(field)) {
+    sprintf(isoMsg->message, "F[%d] isn't a valid DE", field);
+    return 0;
+  }
+
+  element = peekElement(&isoMsg->dataElements, field, &size);
+
+  if (element == NULL || size == 0) {
+    sprintf(isoMsg->message, "Can't find DE[%d]", field);
+    return 0;
+  }
+
+  *datum = element;
+  *datumSize = size;
+
+  return size;
+}
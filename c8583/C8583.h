@@ -25,8 +25,11 @@ extern "C" {
 
 #define C8583_SPY
 
+#include <stddef.h>
 #include <stdio.h>
 
+#include "C8583Bitmap.h"
+
 /**
  * New Type: IsoMsg
  * ----------------
@@ -52,6 +55,45 @@ typedef short (*MacFunc)(unsigned char* mac, const unsigned char* key,
                          const int keySize, const unsigned char* packet,
                          const int packetSize);
 
+/**
+ * Struct: MacStream
+ * -----------------
+ * Incremental MAC of a packet, fed every field as it is packed, see
+ * packDataWithMacStream and unpackDataWithMacStreamVerify.
+ * @param init Starts a MAC with key, returns 0 on success
+ * @param update Absorbs the next size bytes of the packet
+ * @param final Writes the MAC to mac, at least 65 bytes, returns its size or 0
+ * on error
+ * @param state Passed to every call, owned by the caller
+ */
+
+typedef struct MacStream {
+  short (*init)(void* state, const unsigned char* key, const int keySize);
+  void (*update)(void* state, const unsigned char* data, const int size);
+  short (*final)(void* state, unsigned char* mac);
+  void* state;
+} MacStream;
+
+/**
+ * Struct: C8583Allocator
+ * ----------------------
+ * Memory an IsoMsg gets its storage from, see createIso8583WithAllocator.
+ * @param allocate Returns size bytes, or NULL if out of memory
+ * @param reallocate Grows ptr, of oldSize bytes, to newSize bytes keeping its
+ * content. ptr is NULL on the first call.
+ * @param release Frees ptr, NULL if the memory is reclaimed by its owner,
+ * e.g. an arena that is reset as a whole.
+ * @param context Passed to every call
+ */
+
+typedef struct C8583Allocator {
+  void* (*allocate)(void* context, size_t size);
+  void* (*reallocate)(void* context, void* ptr, size_t oldSize,
+                      size_t newSize);
+  void (*release)(void* context, void* ptr);
+  void* context;
+} C8583Allocator;
+
 /**
  * Function: createIso8583
  * Usage: IsoMsg isoMsg = createIso8583();
@@ -63,6 +105,44 @@ typedef short (*MacFunc)(unsigned char* mac, const unsigned char* key,
 
 DllSpec IsoMsg createIso8583(void);
 
+/**
+ * Function: createIso8583WithAllocator
+ * Usage: IsoMsg isoMsg = createIso8583WithAllocator(&allocator);
+ * ---------------------------------------------------------------
+ * Like createIso8583, but the message and its fields are allocated from
+ * allocator, which is copied. NULL uses the heap.
+ * @param allocator Memory to use
+ * @return isoMsg Initilized IsoMsg data type, NULL if out of memory
+ */
+
+DllSpec IsoMsg createIso8583WithAllocator(const C8583Allocator* allocator);
+
+/**
+ * Function: createIso8583InArena
+ * Usage: IsoMsg isoMsg = createIso8583InArena(buf, sizeof(buf));
+ * ---------------------------------------------------------------
+ * Like createIso8583, but the message and its fields live in buf, nothing is
+ * allocated. Setting a field fails with "Out of memory" once buf is full.
+ * About 2KB of buf is taken by the message itself; 4KB leaves enough room for
+ * a network management message. buf must outlive the message.
+ * @param buf Memory to use
+ * @param cap Size of buf
+ * @return isoMsg Initilized IsoMsg data type, NULL if buf is too small
+ */
+
+DllSpec IsoMsg createIso8583InArena(void* buf, size_t cap);
+
+/**
+ * Function: resetIso8583
+ * Usage: resetIso8583(isoMsg);
+ * ----------------------------
+ * Clears isoMsg so it can be used for another message. Memory already taken
+ * for fields is kept for the next ones.
+ * @param isoMsg IsoMsg type, see createIso8583
+ */
+
+DllSpec void resetIso8583(const IsoMsg isoMsg);
+
 /**
  * Function: destroyIso8583
  * Usage: destroyIso8583(isoMsg);
@@ -104,6 +184,22 @@ DllSpec short setDatum(const IsoMsg isoMsg, const int field,
 DllSpec short getDatum(const IsoMsg isoMsg, const int field,
                        unsigned char* datum, const int datumSize);
 
+/**
+ * Function: getDatumView
+ * Usage: short result = getDatumView(isoMsg, field, &datum, &datumSize);
+ * ----------------------------------------------------------------
+ * Like getDatum, without the copy. datum points into the isoMsg, or into the
+ * packet given to unpackDataView, and isn't NUL terminated.
+ * @param isoMsg IsoMsg type, see createIso8583
+ * @param field Iso 8583 field to get.
+ * @return datum start of the value of field
+ * @return datumSize size of the value of field
+ * @return result Returns 0 if failed, othewise returns positive number
+ */
+
+DllSpec short getDatumView(const IsoMsg isoMsg, const int field,
+                           const unsigned char** datum, int* datumSize);
+
 /**
  * Function: packData
  * Usage: short result = packData(isoMsg, packet, size);
@@ -130,6 +226,87 @@ DllSpec short packData(const IsoMsg isoMsg, unsigned char* packet,
 DllSpec short unpackData(const IsoMsg isoMsg, const unsigned char* packet,
                          const int size);
 
+/**
+ * Function: unpackDataView
+ * Usage: short result = unpackDataView(isoMsg, packet, size);
+ * ----------------------------------------------------------------
+ * Like unpackData, but fields aren't copied, isoMsg only records where they
+ * are in packet. packet must stay alive and unchanged for as long as fields
+ * are read from isoMsg. Read them with getDatumView to avoid copies too.
+ * @return isoMsg IsoMsg type, see createIso8583
+ * @param packet Iso8583 packet to unpack
+ * @param size Size of packet to unpack.
+ */
+
+DllSpec short unpackDataView(const IsoMsg isoMsg, const unsigned char* packet,
+                             const int size);
+
+/**
+ * Function: unpackDataWithMacVerify
+ * Usage: short result = unpackDataWithMacVerify(isoMsg, packet, size, key,
+ *                                               keySize, macFunc);
+ * ----------------------------------------------------------------
+ * Like unpackData, and checks the MAC (DE 64, or DE 128 with a secondary
+ * bitmap) against macFunc's MAC of the bytes before it, in the same pass.
+ * Fails if the message has no MAC or it doesn't match, getMessage says which.
+ * @return isoMsg IsoMsg type, see createIso8583
+ * @param packet Iso8583 packet to unpack
+ * @param size Size of packet to unpack.
+ * @param key Key given to macFunc
+ * @param keySize Size of key
+ * @param macFunc Function pointer to a function for calculating the MAC
+ */
+
+DllSpec short unpackDataWithMacVerify(const IsoMsg isoMsg,
+                                      const unsigned char* packet,
+                                      const int size, const unsigned char* key,
+                                      const int keySize, MacFunc macFunc);
+
+/**
+ * Function: unpackDataViewWithMacVerify
+ * Usage: short result = unpackDataViewWithMacVerify(isoMsg, packet, size, key,
+ *                                                   keySize, macFunc);
+ * ----------------------------------------------------------------
+ * unpackDataWithMacVerify without copies, see unpackDataView.
+ */
+
+DllSpec short unpackDataViewWithMacVerify(const IsoMsg isoMsg,
+                                          const unsigned char* packet,
+                                          const int size,
+                                          const unsigned char* key,
+                                          const int keySize, MacFunc macFunc);
+
+/**
+ * Function: unpackDataWithMacStreamVerify
+ * Usage: short result = unpackDataWithMacStreamVerify(isoMsg, packet, size,
+ *                                                     key, keySize, macStream);
+ * ----------------------------------------------------------------
+ * unpackDataWithMacVerify with the MAC computed by macStream, e.g. one
+ * carrying its key in its state.
+ */
+
+DllSpec short unpackDataWithMacStreamVerify(const IsoMsg isoMsg,
+                                            const unsigned char* packet,
+                                            const int size,
+                                            const unsigned char* key,
+                                            const int keySize,
+                                            const MacStream* macStream);
+
+/**
+ * Function: unpackDataViewWithMacStreamVerify
+ * Usage: short result = unpackDataViewWithMacStreamVerify(isoMsg, packet,
+ *                                       size, key, keySize, macStream);
+ * ----------------------------------------------------------------
+ * unpackDataWithMacStreamVerify without copies, see unpackDataView.
+ */
+
+DllSpec short unpackDataViewWithMacStreamVerify(const IsoMsg isoMsg,
+                                                const unsigned char* packet,
+                                                const int size,
+                                                const unsigned char* key,
+                                                const int keySize,
+                                                const MacStream* macStream);
+
 /**
  * Function: unpackDataWithMac
  * Usage: short result = unpackData(isoMsg, packet, size, macFunc);
@@ -148,6 +325,27 @@ DllSpec short packDataWithMac(const IsoMsg isoMsg, unsigned char* packet,
                               const int size, const unsigned char* key,
                               const int keySize, MacFunc macFunc);
 
+/**
+ * Function: packDataWithMacStream
+ * Usage: short result = packDataWithMacStream(isoMsg, packet, size, key,
+ *                                             keySize, macStream);
+ * ----------------------------------------------------------------
+ * Like packDataWithMac, but the MAC is computed while packing: macStream is
+ * fed each part of the packet as it's written, so the packet isn't read again.
+ * Equivalent to packData if macStream is NULL.
+ * @param isoMsg IsoMsg type, see createIso8583
+ * @return packet packed Iso8583 message
+ * @param size The size of packet buffer
+ * @param key Key given to macStream's init
+ * @param keySize Size of key
+ * @param macStream MAC of the message (DE 64 or 128)
+ */
+
+DllSpec short packDataWithMacStream(const IsoMsg isoMsg, unsigned char* packet,
+                                    const int size, const unsigned char* key,
+                                    const int keySize,
+                                    const MacStream* macStream);
+
 /**
  * Function: logIsoMsg
  * Usage: logIsoMsg(isoMsg, stream)
@@ -192,7 +390,7 @@ short isEmptyMti(const IsoMsg isoMsg);
 #ifdef C8583_SPY
 short isEmptyBitmap(const IsoMsg isoMsg);
 unsigned char* getMti(const IsoMsg isoMsg);
-unsigned char* getBitmap(const IsoMsg isoMsg);
+C8583Bitmap* getBitmap(const IsoMsg isoMsg);
 #endif
 
 #ifdef __cplusplus
@@ -1,64 +1,127 @@
-
 #include "C8583Algorithm.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static void SortedInsert(struct DataElement** headRef,
-                         struct DataElement* newNode) {
-  if (*headRef == NULL || (*headRef)->field >= newNode->field) {
-    newNode->next = *headRef;
-    *headRef = newNode;
-  } else {
-    struct DataElement* current = *headRef;
-    while (current->next != NULL && current->next->field < newNode->field) {
-      current = current->next;
-    }
-    newNode->next = current->next;
-    current->next = newNode;
+#define DATA_ELEMENT_MIN_CAPACITY 256
+
+static unsigned char* resize(struct DataElements* elements,
+                             const unsigned int capacity) {
+  if (elements->allocator == NULL) {
+    return (unsigned char*)realloc(elements->buffer, capacity);
   }
+
+  return (unsigned char*)elements->allocator->reallocate(
+      elements->allocator->context, elements->buffer, elements->capacity,
+      capacity);
 }
 
-void pushElement(struct DataElement** head_ref, const int field,
-                 const void* datum, const int size) {
-  struct DataElement* new_node =
-      (struct DataElement*)malloc(sizeof(struct DataElement));
+static short reserve(struct DataElements* elements, const unsigned int size) {
+  unsigned int capacity = elements->capacity;
+  unsigned char* buffer = NULL;
+
+  if (elements->used + size <= capacity) return 0;
+
+  if (capacity < DATA_ELEMENT_MIN_CAPACITY) {
+    capacity = DATA_ELEMENT_MIN_CAPACITY;
+  }
+  while (capacity < elements->used + size) {
+    capacity *= 2;
+  }
+
+  buffer = resize(elements, capacity);
+  // a bounded allocator may still fit what's needed without doubling
+  if (buffer == NULL && capacity > elements->used + size) {
+    capacity = elements->used + size;
+    buffer = resize(elements, capacity);
+  }
+  if (buffer == NULL) return -1;
 
-  new_node->field = field;
-  new_node->size = size;
-  new_node->datum = (unsigned char*)malloc(size * sizeof(char));
-  memcpy(new_node->datum, datum, size);
+  elements->buffer = buffer;
+  elements->capacity = capacity;
 
-  SortedInsert(head_ref, new_node);
+  return 0;
 }
 
-short getElement(const struct DataElement* head_ref, const int field,
-                 void* datum, const int size) {
-  const struct DataElement* node = head_ref;
-
-  while (node != NULL) {
-    if (node->field == field) {
-      if (size < node->size) return 0;
-      memcpy(datum, node->datum, node->size);
-      return node->size;
-    }
-    node = node->next;
+short pushElement(struct DataElements* elements, const int field,
+                  const void* datum, const int size) {
+  struct DataElementSlot* slot = NULL;
+
+  if (field < 0 || field >= DATA_ELEMENT_SLOTS || size < 0) return -1;
+  if (reserve(elements, size) != 0) return -1;
+
+  slot = &elements->slots[field];
+  slot->offset = elements->used;
+  slot->size = size;
+  slot->present = 1;
+  slot->external = 0;
+
+  if (size) memcpy(&elements->buffer[slot->offset], datum, size);
+  elements->used += size;
+
+  return 0;
+}
+
+short setElementView(struct DataElements* elements, const int field,
+                     const unsigned int offset, const unsigned int size) {
+  struct DataElementSlot* slot = NULL;
+
+  if (field < 0 || field >= DATA_ELEMENT_SLOTS || elements->view == NULL) {
+    return -1;
   }
 
+  slot = &elements->slots[field];
+  slot->offset = offset;
+  slot->size = size;
+  slot->present = 1;
+  slot->external = 1;
+
   return 0;
 }
 
-void freeDataElement(struct DataElement** headRef) {
-  struct DataElement* current = *headRef;
-  struct DataElement* next;
+short getElement(const struct DataElements* elements, const int field,
+                 void* datum, const int size) {
+  int elementSize = 0;
+  const unsigned char* element = peekElement(elements, field, &elementSize);
+
+  if (element == NULL || size < elementSize) return 0;
+
+  memcpy(datum, element, elementSize);
+  return elementSize;
+}
+
+const unsigned char* peekElement(const struct DataElements* elements,
+                                 const int field, int* size) {
+  const struct DataElementSlot* slot = NULL;
+
+  if (field < 0 || field >= DATA_ELEMENT_SLOTS) return NULL;
+
+  slot = &elements->slots[field];
+  if (!slot->present) return NULL;
+
+  *size = slot->size;
+  if (slot->external) return &elements->view[slot->offset];
+
+  return elements->buffer ? &elements->buffer[slot->offset]
+                          : (const unsigned char*)"";
+}
+
+void resetDataElement(struct DataElements* elements) {
+  memset(elements->slots, '\0', sizeof(elements->slots));
+  elements->view = NULL;
+  elements->used = 0;
+}
+
+void freeDataElement(struct DataElements* elements) {
+  const C8583Allocator* allocator = elements->allocator;
 
-  while (current != NULL) {
-    next = current->next;
-    free(current->datum);
-    free(current);
-    current = next;
+  if (allocator == NULL) {
+    free(elements->buffer);
+  } else if (allocator->release && elements->buffer) {
+    allocator->release(allocator->context, elements->buffer);
   }
 
-  *headRef = NULL;
+  memset(elements, '\0', sizeof(struct DataElements));
+  elements->allocator = allocator;
 }
@@ -7,17 +7,50 @@
 #ifndef C8583_ALGORITHM_INCLUDED
 #define C8583_ALGORITHM_INCLUDED
 
-struct DataElement {
-  int field;
-  unsigned char* datum;
-  int size;
-  struct DataElement* next;
+#include "C8583.h"
+
+#define DATA_ELEMENT_SLOTS 129
+
+/**
+ * Struct: DataElementSlot
+ * -----------------------
+ * Where a field's datum lives in DataElements' buffer, or in the view when
+ * external.
+ */
+struct DataElementSlot {
+  unsigned int offset;
+  unsigned int size;
+  unsigned char present;
+  unsigned char external;
+};
+
+/**
+ * Struct: DataElements
+ * --------------------
+ * Fields of a message, indexed by field number. Every datum is copied into
+ * one contiguous buffer that grows as needed, so setting a field costs no
+ * allocation once the buffer is big enough. External slots point into view
+ * instead, a packet owned by the caller, and cost no copy at all. The buffer
+ * comes from allocator, or the heap if it's NULL.
+ */
+struct DataElements {
+  struct DataElementSlot slots[DATA_ELEMENT_SLOTS];
+  const C8583Allocator* allocator;
+  const unsigned char* view;
+  unsigned char* buffer;
+  unsigned int used;
+  unsigned int capacity;
 };
 
-void pushElement(struct DataElement** head_ref, const int field,
-                 const void* datum, const int size);
-short getElement(const struct DataElement* head_ref, const int field,
+short pushElement(struct DataElements* elements, const int field,
+                  const void* datum, const int size);
+short setElementView(struct DataElements* elements, const int field,
+                     const unsigned int offset, const unsigned int size);
+short getElement(const struct DataElements* elements, const int field,
                  void* datum, const int size);
-void freeDataElement(struct DataElement** headRef);
+const unsigned char* peekElement(const struct DataElements* elements,
+                                 const int field, int* size);
+void resetDataElement(struct DataElements* elements);
+void freeDataElement(struct DataElements* elements);
 
 #endif
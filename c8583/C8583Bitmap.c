@@ -5,60 +5,103 @@
 
 #include "C8583Bitmap.h"
 
-#include <stdio.h>
+#include <string.h>
 
-#define BYTE_WIDTH 8
+#define WORD_WIDTH 64
 
-static void charToBinLiteral(char buffer[9], char input) {
-  int i;
-  for (i = 0; i < 8; i++) {
-    char shift_byte = 0x01 << (7 - i);
-    buffer[i] = (shift_byte & input) ? '1' : '0';
-  }
-  buffer[i] = '\0';
+static int fieldToWordIndex(const int field) {
+  return (field - 1) / WORD_WIDTH;
 }
 
-void bitmapToBinLiteral(char* binaryLiteral, const unsigned char bitmap[16]) {
-  const int size = isSecondaryBitmap(bitmap) ? 16 : 8;
-  int i;
-  char buffer[9];
-  short pos = 0;
+static uint64_t fieldToWordBit(const int field) {
+  return (uint64_t)1 << (WORD_WIDTH - 1 - (field - 1) % WORD_WIDTH);
+}
 
-  for (i = 0; i < size; i++) {
-    charToBinLiteral(buffer, bitmap[i]);
-    pos += sprintf(&binaryLiteral[pos], "%s", buffer);
-  }
+void setFieldBit(C8583Bitmap* bitmap, const int field) {
+  if (field < 1 || field > SECONDARY_BITMAP) return;
+
+  bitmap->words[fieldToWordIndex(field)] |= fieldToWordBit(field);
+
+  if (field > PRIMARY_BITMAP) bitmap->words[0] |= fieldToWordBit(1);
+}
 
-  binaryLiteral[pos] = '\0';
+short isFieldBitSet(const C8583Bitmap* bitmap, const int field) {
+  if (field < 1 || field > SECONDARY_BITMAP) return 0;
+
+  return (bitmap->words[fieldToWordIndex(field)] & fieldToWordBit(field)) != 0;
 }
 
-static short fieldToBitIndex(const int field) {
-  const int remainder = field % BYTE_WIDTH;
-  return remainder ? BYTE_WIDTH - remainder : remainder;
+short isSecondaryBitmap(const C8583Bitmap* bitmap) {
+  return isFieldBitSet(bitmap, 1);
 }
 
-static short fieldToByteIndex(const int field) {
-  return (field - 1) / BYTE_WIDTH;
+short isBitmapEmpty(const C8583Bitmap* bitmap) {
+  return !bitmap->words[0] && !bitmap->words[1];
 }
 
-static unsigned char convertFieldToBit(const int field) { return 1 << field; }
+/**
+ * Returns the first field after field whose bit is set, 0 if there's none.
+ * nextFieldBit(bitmap, 0) is the first field set.
+ */
+int nextFieldBit(const C8583Bitmap* bitmap, const int field) {
+  int word = 0;
 
-void setFieldBit(unsigned char bitmap[16], const int field) {
-  if (!field) return;
+  if (field < 0 || field >= SECONDARY_BITMAP) return 0;
 
-  bitmap[fieldToByteIndex(field)] |= convertFieldToBit(fieldToBitIndex(field));
+  // bits of the fields after field, a field's bit is below the one before it
+  word = field / WORD_WIDTH;
+  if (bitmap->words[word] << (field % WORD_WIDTH)) {
+    uint64_t rest =
+        bitmap->words[word] & (~(uint64_t)0 >> (field % WORD_WIDTH));
+    return word * WORD_WIDTH + __builtin_clzll(rest) + 1;
+  }
 
-  if (field > PRIMARY_BITMAP && !isFieldBitSet(bitmap, 1)) {
-    bitmap[fieldToByteIndex(1)] |= convertFieldToBit(fieldToBitIndex(1));
+  if (word == 0 && bitmap->words[1]) {
+    return WORD_WIDTH + __builtin_clzll(bitmap->words[1]) + 1;
   }
+
+  return 0;
 }
 
-short isFieldBitSet(const unsigned char bitmap[16], const int field) {
-  if (!field) return 0;
+/**
+ * Returns the number of data fields set, the secondary bitmap indicator
+ * (field 1) isn't counted.
+ */
+int countFieldBits(const C8583Bitmap* bitmap) {
+  return __builtin_popcountll(bitmap->words[0] & ~fieldToWordBit(1)) +
+         __builtin_popcountll(bitmap->words[1]);
+}
+
+void bitmapToBytes(unsigned char bytes[BITMAP_SIZE],
+                   const C8583Bitmap* bitmap) {
+  int i;
 
-  return (bitmap[fieldToByteIndex(field)] >> fieldToBitIndex(field)) & 1;
+  for (i = 0; i < BITMAP_SIZE; i++) {
+    bytes[i] = (unsigned char)(bitmap->words[i / 8] >> (56 - (i % 8) * 8));
+  }
 }
 
-short isSecondaryBitmap(const unsigned char bitmap[16]) {
-  return isFieldBitSet(bitmap, 1);
+/**
+ * Reads len, 8 or 16, bytes of a packed bitmap.
+ */
+void bitmapFromBytes(C8583Bitmap* bitmap, const unsigned char* bytes,
+                     const int len) {
+  int i;
+
+  memset(bitmap, 0x00, sizeof(C8583Bitmap));
+  for (i = 0; i < len && i < BITMAP_SIZE; i++) {
+    bitmap->words[i / 8] |= (uint64_t)bytes[i] << (56 - (i % 8) * 8);
+  }
+}
+
+void bitmapToBinLiteral(char* binaryLiteral, const C8583Bitmap* bitmap) {
+  const int size =
+      isSecondaryBitmap(bitmap) ? SECONDARY_BITMAP : PRIMARY_BITMAP;
+  int field;
+
+  for (field = 1; field <= size; field++) {
+    binaryLiteral[field - 1] = isFieldBitSet(bitmap, field) ? '1' : '0';
+  }
+
+  binaryLiteral[size] = '\0';
 }
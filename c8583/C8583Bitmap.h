@@ -7,13 +7,32 @@
 #ifndef C8583_BITMAP_INCLUDED
 #define C8583_BITMAP_INCLUDED
 
+#include <stdint.h>
+
 #define PRIMARY_BITMAP 64
 #define SECONDARY_BITMAP 128
 #define BITMAP_SIZE 16
 
-void setFieldBit(unsigned char bitmap[16], const int field);
-short isFieldBitSet(const unsigned char bitmap[16], const int field);
-short isSecondaryBitmap(const unsigned char bitmap[16]);
-void bitmapToBinLiteral(char* binaryLiteral, const unsigned char bitmap[16]);
+/**
+ * Struct: C8583Bitmap
+ * -------------------
+ * Primary and secondary bitmaps in wire order: field 1 is the most significant
+ * bit of words[0], field 128 the least significant of words[1].
+ */
+typedef struct C8583Bitmap {
+  uint64_t words[2];
+} C8583Bitmap;
+
+void setFieldBit(C8583Bitmap* bitmap, const int field);
+short isFieldBitSet(const C8583Bitmap* bitmap, const int field);
+short isSecondaryBitmap(const C8583Bitmap* bitmap);
+short isBitmapEmpty(const C8583Bitmap* bitmap);
+int nextFieldBit(const C8583Bitmap* bitmap, const int field);
+int countFieldBits(const C8583Bitmap* bitmap);
+void bitmapToBytes(unsigned char bytes[BITMAP_SIZE],
+                   const C8583Bitmap* bitmap);
+void bitmapFromBytes(C8583Bitmap* bitmap, const unsigned char* bytes,
+                     const int len);
+void bitmapToBinLiteral(char* binaryLiteral, const C8583Bitmap* bitmap);
 
 #endif
@@ -6,267 +6,277 @@
 // internal
 #include "C8583Config.h"
 
-#include "C8583Utils.h"
+#include "../hexcodec/hexcodec.h"
 
 // std
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
+/**
+ * Every field in field order as X(field, type, attribute, inputEncoding,
+ * outputEncoding, length). Expanded into the config table and into one encoder
+ * and decoder per field.
+ */
+#define C8583_FIELDS(X)                                                        \
+  X(MESSAGE_TYPE_INDICATOR_0, FIXED_LENGTH, NUMERIC,                           \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(BITMAP_1, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING, ASCII_ENCODING, 16)  \
+  X(PRIMARY_ACCOUNT_NUMBER_2, LL_VAR, NUMERIC,                                 \
+    ASCII_ENCODING, ASCII_ENCODING, 19)                                        \
+  X(PROCESSING_CODE_3, FIXED_LENGTH, ALPHANUMERIC,                             \
+    ASCII_ENCODING, ASCII_ENCODING, 6)                                         \
+  X(TRANSACTION_AMOUNT_4, FIXED_LENGTH, NUMERIC,                               \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(AMOUNT_SETTLEMENT_5, FIXED_LENGTH, NUMERIC,                                \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(AMOUNT_CARDHOLDER_BILLING_6, FIXED_LENGTH, NUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(TRANSACTION_DATE_TIME_7, FIXED_LENGTH, NUMERIC,                            \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(AMOUNT_CARDHOLDER_BILLING_FEE_8, FIXED_LENGTH, NUMERIC,                    \
+    ASCII_ENCODING, ASCII_ENCODING, 8)                                         \
+  X(CONVERSION_RATE_SETTLEMENT_9, FIXED_LENGTH, NUMERIC,                       \
+    ASCII_ENCODING, ASCII_ENCODING, 8)                                         \
+  X(CONVERSION_RATE_CARDHOLDER_BILLING_10, FIXED_LENGTH, NUMERIC,              \
+    ASCII_ENCODING, ASCII_ENCODING, 8)                                         \
+  X(SYSTEM_TRACE_AUDIT_NUMBER_11, FIXED_LENGTH, NUMERIC,                       \
+    ASCII_ENCODING, ASCII_ENCODING, 6)                                         \
+  X(LOCAL_TRANSACTION_TIME_12, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 6)                                         \
+  X(LOCAL_TRANSACTION_DATE_13, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(EXPIRATION_DATE_14, FIXED_LENGTH, NUMERIC,                                 \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(SETTLEMENT_DATE_15, FIXED_LENGTH, NUMERIC,                                 \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(CURRENCY_CONVERSION_DATE_16, FIXED_LENGTH, NUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(CAPTURE_DATE_17, FIXED_LENGTH, NUMERIC,                                    \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(MERCHANT_CATEGORY_CODE_18, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(ACQUIRING_INSTITUTION_19, FIXED_LENGTH, NUMERIC,                           \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(PAN_EXTENDED_20, FIXED_LENGTH, NUMERIC,                                    \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(FORWARDING_INSTITUTION_21, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(POS_ENTRY_MODE_22, FIXED_LENGTH, NUMERIC,                                  \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(APPLICATION_PAN_SEQUENCE_NUMBER_23, FIXED_LENGTH, NUMERIC,                 \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(NETWORK_INTERNATIONAL_IDENTIFIER_24, FIXED_LENGTH, NUMERIC,                \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(POINT_OF_SERVICE_CONDITION_CODE_25, FIXED_LENGTH, NUMERIC,                 \
+    ASCII_ENCODING, ASCII_ENCODING, 2)                                         \
+  X(POINT_OF_SERVICE_CAPTURE_CODE_26, FIXED_LENGTH, NUMERIC,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 2)                                         \
+  X(AUTHORIZATION_IDENTIFICATION_RESPONSE_LENGTH_27, FIXED_LENGTH, NUMERIC,    \
+    ASCII_ENCODING, ASCII_ENCODING, 1)                                         \
+  X(AMOUNT_TRANSACTION_FEE_28, FIXED_LENGTH, HEX_NUMERICS,                     \
+    ASCII_ENCODING, ASCII_ENCODING, 9)                                         \
+  X(AMOUNT_SETTLEMENT_FEE_29, FIXED_LENGTH, HEX_NUMERICS,                      \
+    ASCII_ENCODING, ASCII_ENCODING, 9)                                         \
+  X(AMOUNT_TRANSACTION_PROCESSING_FEE_30, FIXED_LENGTH, HEX_NUMERICS,          \
+    ASCII_ENCODING, ASCII_ENCODING, 9)                                         \
+  X(AMOUNT_SETTLEMENT_PROCESSING_FEE_31, FIXED_LENGTH, HEX_NUMERICS,           \
+    ASCII_ENCODING, ASCII_ENCODING, 9)                                         \
+  X(ACQUIRING_INSTITUTION_IDENTIFICATION_CODE_32, LL_VAR, ALPHANUMERIC,        \
+    ASCII_ENCODING, ASCII_ENCODING, 11)                                        \
+  X(FORWARDING_INSTITUTION_IDENTIFICATION_CODE_33, LL_VAR, NUMERIC,            \
+    ASCII_ENCODING, ASCII_ENCODING, 11)                                        \
+  X(PRIMARY_ACCOUNT_NUMBER_EXTENDED_34, LL_VAR, NUMERIC_SPECIAL,               \
+    ASCII_ENCODING, ASCII_ENCODING, 28)                                        \
+  X(TRACK2_DATA_35, LL_VAR, Z, ASCII_ENCODING, ASCII_ENCODING, 38)             \
+  X(TRACK3_DATA_36, LLL_VAR, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 104)     \
+  X(RETRIVAL_REFERENCE_NUMBER_37, FIXED_LENGTH, ALPHANUMERIC,                  \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(AUTHORIZATION_IDENTIFICATION_RESPONSE_38, FIXED_LENGTH, NUMERIC,           \
+    ASCII_ENCODING, ASCII_ENCODING, 6)                                         \
+  X(RESPONSE_CODE_39, FIXED_LENGTH, ALPHANUMERIC,                              \
+    ASCII_ENCODING, ASCII_ENCODING, 2)                                         \
+  X(SERVICE_RESTRICTION_CODE_40, FIXED_LENGTH, NUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41, FIXED_LENGTH,                    \
+    ALPHANUMERIC_SPECIAL, ASCII_ENCODING, ASCII_ENCODING, 8)                   \
+  X(CARD_ACCEPTOR_IDENTIFICATION_CODE_42, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,  \
+    ASCII_ENCODING, ASCII_ENCODING, 15)                                        \
+  X(CARD_ACCEPTOR_NAME_OR_LOCATION_43, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,     \
+    ASCII_ENCODING, ASCII_ENCODING, 40)                                        \
+  X(ADDITIONAL_RESPONSE_DATA_44, LL_VAR, ALPHANUMERIC_SPECIAL,                 \
+    ASCII_ENCODING, ASCII_ENCODING, 25)                                        \
+  X(TRACK1_DATA_45, LL_VAR, ALPHANUMERIC_SPECIAL,                              \
+    ASCII_ENCODING, ASCII_ENCODING, 76)                                        \
+  X(ADDITIONAL_DATA_ISO_46, LLL_VAR, ALPHANUMERIC,                             \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(ADDITIONAL_DATA_NATIONAL_47, LLL_VAR, ALPHANUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(ADDITIONAL_DATA_PRIVATE_48, LLL_VAR, ALPHANUMERIC_SPECIAL,                 \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(CURRENCY_CODE_TRANSACTION_49, FIXED_LENGTH, NUMERIC,                       \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(CURRENCY_CODE_SETTLEMENT_50, FIXED_LENGTH, NUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(CURRENCY_CODE_CARDHOLDER_BILLING_51, FIXED_LENGTH, NUMERIC,                \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(PERSONAL_IDENTIFICATION_NUMBER_DATA_52, FIXED_LENGTH, BINARY,              \
+    ASCII_ENCODING, ASCII_ENCODING, 16)                                        \
+  X(SECURITY_RELATED_CONTROL_INFORMATION_53, FIXED_LENGTH, NUMERIC,            \
+    ASCII_ENCODING, ASCII_ENCODING, 96)                                        \
+  X(ADDITIONAL_AMOUNTS_54, LLL_VAR, ALPHANUMERIC,                              \
+    ASCII_ENCODING, ASCII_ENCODING, 120)                                       \
+  X(ICC_DATA_55, LLL_VAR, ALPHANUMERIC_SPECIAL,                                \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_ISO_56, LLL_VAR, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 4)      \
+  X(RESERVED_NATIONAL_57, LL_VAR, BINARY,                                      \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_NATIONAL_58, LLL_VAR, NUMERIC_SPECIAL,                            \
+    ASCII_ENCODING, ASCII_ENCODING, 11)                                        \
+  X(RESERVED_NATIONAL_59, LLL_VAR, ALPHANUMERIC_SPECIAL,                       \
+    ASCII_ENCODING, ASCII_ENCODING, 255)                                       \
+  X(RESERVED_NATIONAL_60, LLL_VAR, ALPHANUMERIC_SPECIAL,                       \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_PRIVATE_61, LLL_VAR, ALPHANUMERIC_SPECIAL,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_PRIVATE_62, LLL_VAR, ALPHANUMERIC_SPECIAL,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_PRIVATE_63, LLLL_VAR, ALPHANUMERIC_SPECIAL,                       \
+    ASCII_ENCODING, ASCII_ENCODING, 9999)                                      \
+  X(MESSAGE_AUTHENTICATION_CODE_64, FIXED_LENGTH, ALPHANUMERIC,                \
+    ASCII_ENCODING, ASCII_ENCODING, 64)                                        \
+  X(EXTENDED_BITMAP_INDICATOR_65, FIXED_LENGTH, BINARY,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 1)                                         \
+  X(SETTLEMENT_CODE_66, FIXED_LENGTH, NUMERIC,                                 \
+    ASCII_ENCODING, ASCII_ENCODING, 1)                                         \
+  X(EXTENDED_PAYMENT_CODE_67, FIXED_LENGTH, NUMERIC,                           \
+    ASCII_ENCODING, ASCII_ENCODING, 2)                                         \
+  X(RECEIVING_INSTITUTION_COUNTRY_CODE_68, FIXED_LENGTH, NUMERIC,              \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(SETTLEMENT_INSTITUTION_COUNTRY_CODE_69, FIXED_LENGTH, NUMERIC,             \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(NETWORK_MANAGEMENT_INFORMATION_CODE_70, FIXED_LENGTH, NUMERIC,             \
+    ASCII_ENCODING, ASCII_ENCODING, 3)                                         \
+  X(MESSAGE_NUMBER_71, FIXED_LENGTH, NUMERIC,                                  \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(LAST_MESSAGE_NUMBER_72, FIXED_LENGTH, NUMERIC,                             \
+    ASCII_ENCODING, ASCII_ENCODING, 4)                                         \
+  X(ACTION_DATE_73, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 6)  \
+  X(NUMBER_OF_CREDITS_74, FIXED_LENGTH, NUMERIC,                               \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(CREDITS_REVERSAL_NUMBER_75, FIXED_LENGTH, NUMERIC,                         \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(NUMBER_OF_DEBITS_76, FIXED_LENGTH, NUMERIC,                                \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(DEBITS_REVERSAL_NUMBER_77, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(TRANSFER_NUMBER_78, FIXED_LENGTH, NUMERIC,                                 \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(TRANSFER_REVERSAL_NUMBER_79, FIXED_LENGTH, NUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(NUMBER_OF_INQUIRIES_80, FIXED_LENGTH, NUMERIC,                             \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(NUMBER_OF_AUTHORIZATIONS_81, FIXED_LENGTH, NUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 10)                                        \
+  X(CREDITS_PROCESSING_FEE_AMOUNT_82, FIXED_LENGTH, NUMERIC,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(CREDIT_TRANSACTION_FEE_AMOUNT_83, FIXED_LENGTH, NUMERIC,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(DEBITS_PROCESSING_FEE_AMOUNT_84, FIXED_LENGTH, NUMERIC,                    \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(DEBITS_TRANSACTION_FEE_AMOUNT_85, FIXED_LENGTH, NUMERIC,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 12)                                        \
+  X(TOTAL_AMOUNT_OF_CREDITS_86, FIXED_LENGTH, NUMERIC,                         \
+    ASCII_ENCODING, ASCII_ENCODING, 16)                                        \
+  X(CREDITS_REVERSAL_AMOUNT_87, FIXED_LENGTH, NUMERIC,                         \
+    ASCII_ENCODING, ASCII_ENCODING, 16)                                        \
+  X(TOTAL_AMOUNT_OF_DEBITS_88, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 16)                                        \
+  X(DEBIT_REVESAL_AMOUNT_89, FIXED_LENGTH, NUMERIC,                            \
+    ASCII_ENCODING, ASCII_ENCODING, 16)                                        \
+  X(ORIGINAL_DATA_ELEMENTS_90, FIXED_LENGTH, NUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 42)                                        \
+  X(FILE_UPDATE_CODE_91, FIXED_LENGTH, ALPHANUMERIC,                           \
+    ASCII_ENCODING, ASCII_ENCODING, 1)                                         \
+  X(FILE_SECURITY_CODE_92, FIXED_LENGTH, ALPHANUMERIC,                         \
+    ASCII_ENCODING, ASCII_ENCODING, 2)                                         \
+  X(RESPONSE_INDICATOR_93, FIXED_LENGTH, ALPHANUMERIC,                         \
+    ASCII_ENCODING, ASCII_ENCODING, 5)                                         \
+  X(SERVICE_INDICATOR_94, FIXED_LENGTH, ALPHANUMERIC,                          \
+    ASCII_ENCODING, ASCII_ENCODING, 7)                                         \
+  X(REPLACEMENT_AMOUNTS_95, FIXED_LENGTH, ALPHANUMERIC,                        \
+    ASCII_ENCODING, ASCII_ENCODING, 42)                                        \
+  X(MESSAGE_SECURITY_CODE_96, FIXED_LENGTH, BINARY,                            \
+    BINARY_ENCODING, ASCII_ENCODING, 64)                                       \
+  X(NET_SETTLEMENT_AMOUNT_97, FIXED_LENGTH, HEX_NUMERICS,                      \
+    ASCII_ENCODING, ASCII_ENCODING, 17)                                        \
+  X(PAYEE_98, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,                              \
+    ASCII_ENCODING, ASCII_ENCODING, 25)                                        \
+  X(SETTLEMENT_INSTITUTION_IDENTIFICATION_CODE_99, FIXED_LENGTH, NUMERIC,      \
+    ASCII_ENCODING, ASCII_ENCODING, 11)                                        \
+  X(RECEIVING_INSTITUTION_IDENTIFICATION_CODE_100, LL_VAR, NUMERIC,            \
+    ASCII_ENCODING, ASCII_ENCODING, 11)                                        \
+  X(FILE_NAME_101, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,                         \
+    ASCII_ENCODING, ASCII_ENCODING, 17)                                        \
+  X(ACCOUNT_IDENTIFICATION1_102, LL_VAR, NUMERIC,                              \
+    ASCII_ENCODING, ASCII_ENCODING, 28)                                        \
+  X(ACCOUNT_IDENTIFICATION2_103, LL_VAR, NUMERIC,                              \
+    ASCII_ENCODING, ASCII_ENCODING, 28)                                        \
+  X(TRANSACTION_DESCRIPTION_104, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,           \
+    ASCII_ENCODING, ASCII_ENCODING, 100)                                       \
+  X(RESERVED_FOR_ISO_USE_105, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_ISO_USE_106, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_ISO_USE_107, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_ISO_USE_108, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_ISO_USE_109, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_ISO_USE_110, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_ISO_USE_111, LLL_VAR, ALPHANUMERIC_SPECIAL,                   \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_112, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_113, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_114, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_115, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_116, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_117, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_118, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_119, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_120, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_121, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_122, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_123, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_124, LLLL_VAR, ALPHANUMERIC_SPECIAL,             \
+    ASCII_ENCODING, ASCII_ENCODING, 9999)                                      \
+  X(RESERVED_FOR_NATIONAL_USE_125, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_126, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(RESERVED_FOR_NATIONAL_USE_127, LLL_VAR, ALPHANUMERIC_SPECIAL,              \
+    ASCII_ENCODING, ASCII_ENCODING, 999)                                       \
+  X(MESSAGE_AUTHENTICATION_CODE_128, FIXED_LENGTH, ALPHANUMERIC,               \
+    ASCII_ENCODING, ASCII_ENCODING, 64)
+
+#define C8583_CONFIG_ENTRY(field, type, attribute, in, out, length) \
+  {field, type, attribute, in, out, length},
+
 static const struct C8583Config gC8583Config[] = {
-    {MESSAGE_TYPE_INDICATOR_0, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 4},
-    {BITMAP_1, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING, ASCII_ENCODING, 16},
-    {PRIMARY_ACCOUNT_NUMBER_2, LL_VAR, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     19},
-    {PROCESSING_CODE_3, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 6},
-    {TRANSACTION_AMOUNT_4, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {AMOUNT_SETTLEMENT_5, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     12},
-    {AMOUNT_CARDHOLDER_BILLING_6, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {TRANSACTION_DATE_TIME_7, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {AMOUNT_CARDHOLDER_BILLING_FEE_8, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 8},
-    {CONVERSION_RATE_SETTLEMENT_9, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 8},
-    {CONVERSION_RATE_CARDHOLDER_BILLING_10, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 8},
-    {SYSTEM_TRACE_AUDIT_NUMBER_11, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 6},
-    {LOCAL_TRANSACTION_TIME_12, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 6},
-    {LOCAL_TRANSACTION_DATE_13, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 4},
-    {EXPIRATION_DATE_14, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     4},
-    {SETTLEMENT_DATE_15, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     4},
-    {CURRENCY_CONVERSION_DATE_16, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 4},
-    {CAPTURE_DATE_17, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 4},
-    {MERCHANT_CATEGORY_CODE_18, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 4},
-    {ACQUIRING_INSTITUTION_19, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {PAN_EXTENDED_20, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 3},
-    {FORWARDING_INSTITUTION_21, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {POS_ENTRY_MODE_22, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     3},
-    {APPLICATION_PAN_SEQUENCE_NUMBER_23, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {NETWORK_INTERNATIONAL_IDENTIFIER_24, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 4},
-    // Function code (ISO 8583:1993), or network international identifier (NII)
-    {POINT_OF_SERVICE_CONDITION_CODE_25, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 2},
-    {POINT_OF_SERVICE_CAPTURE_CODE_26, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 2},
-    {AUTHORIZATION_IDENTIFICATION_RESPONSE_LENGTH_27, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 1},
-    {AMOUNT_TRANSACTION_FEE_28, FIXED_LENGTH, HEX_NUMERICS, ASCII_ENCODING,
-     ASCII_ENCODING, 9},
-    {AMOUNT_SETTLEMENT_FEE_29, FIXED_LENGTH, HEX_NUMERICS, ASCII_ENCODING,
-     ASCII_ENCODING, 9},
-    {AMOUNT_TRANSACTION_PROCESSING_FEE_30, FIXED_LENGTH, HEX_NUMERICS,
-     ASCII_ENCODING, ASCII_ENCODING, 9},
-    {AMOUNT_SETTLEMENT_PROCESSING_FEE_31, FIXED_LENGTH, HEX_NUMERICS,
-     ASCII_ENCODING, ASCII_ENCODING, 9},
-    {ACQUIRING_INSTITUTION_IDENTIFICATION_CODE_32, LL_VAR, ALPHANUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 11},
-    {FORWARDING_INSTITUTION_IDENTIFICATION_CODE_33, LL_VAR, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 11},
-    {PRIMARY_ACCOUNT_NUMBER_EXTENDED_34, LL_VAR, NUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 28},
-    {TRACK2_DATA_35, LL_VAR, Z, ASCII_ENCODING, ASCII_ENCODING, 38},
-    {TRACK3_DATA_36, LLL_VAR, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 104},
-    {RETRIVAL_REFERENCE_NUMBER_37, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {AUTHORIZATION_IDENTIFICATION_RESPONSE_38, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 6},
-    {RESPONSE_CODE_39, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 2},
-    {SERVICE_RESTRICTION_CODE_40, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41, FIXED_LENGTH,
-     ALPHANUMERIC_SPECIAL, ASCII_ENCODING, ASCII_ENCODING, 8},
-    {CARD_ACCEPTOR_IDENTIFICATION_CODE_42, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 15},
-    {CARD_ACCEPTOR_NAME_OR_LOCATION_43, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 40},
-    //(1-23 street address, 24-36 city, 37-38 state, 39-40 country)
-    {ADDITIONAL_RESPONSE_DATA_44, LL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 25},
-    {TRACK1_DATA_45, LL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 76},
-    {ADDITIONAL_DATA_ISO_46, LLL_VAR, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {ADDITIONAL_DATA_NATIONAL_47, LLL_VAR, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {ADDITIONAL_DATA_PRIVATE_48, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {CURRENCY_CODE_TRANSACTION_49, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {CURRENCY_CODE_SETTLEMENT_50, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {CURRENCY_CODE_CARDHOLDER_BILLING_51, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 3},
-    {PERSONAL_IDENTIFICATION_NUMBER_DATA_52, FIXED_LENGTH, BINARY,
-     ASCII_ENCODING, ASCII_ENCODING, 16},
-    {SECURITY_RELATED_CONTROL_INFORMATION_53, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 96},
-    {ADDITIONAL_AMOUNTS_54, LLL_VAR, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 120},
-    {ICC_DATA_55, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING, ASCII_ENCODING,
-     999},
-    {RESERVED_ISO_56, LLL_VAR, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 4},
-    {RESERVED_NATIONAL_57, LL_VAR, BINARY, ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_NATIONAL_58, LLL_VAR, NUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 11},
-    {RESERVED_NATIONAL_59, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 255},
-    {RESERVED_NATIONAL_60, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_PRIVATE_61, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_PRIVATE_62, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_PRIVATE_63, LLLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 9999},
-    {MESSAGE_AUTHENTICATION_CODE_64, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 64},
-    {EXTENDED_BITMAP_INDICATOR_65, FIXED_LENGTH, BINARY, ASCII_ENCODING,
-     ASCII_ENCODING, 1},
-    {SETTLEMENT_CODE_66, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     1},
-    {EXTENDED_PAYMENT_CODE_67, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 2},
-    {RECEIVING_INSTITUTION_COUNTRY_CODE_68, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 3},
-    {SETTLEMENT_INSTITUTION_COUNTRY_CODE_69, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 3},
-    {NETWORK_MANAGEMENT_INFORMATION_CODE_70, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 3},
-    {MESSAGE_NUMBER_71, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     4},
-    {LAST_MESSAGE_NUMBER_72, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 4},
-    {ACTION_DATE_73, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING, 6},
-    {NUMBER_OF_CREDITS_74, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {CREDITS_REVERSAL_NUMBER_75, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {NUMBER_OF_DEBITS_76, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     10},
-    {DEBITS_REVERSAL_NUMBER_77, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {TRANSFER_NUMBER_78, FIXED_LENGTH, NUMERIC, ASCII_ENCODING, ASCII_ENCODING,
-     10},
-    {TRANSFER_REVERSAL_NUMBER_79, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {NUMBER_OF_INQUIRIES_80, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {NUMBER_OF_AUTHORIZATIONS_81, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 10},
-    {CREDITS_PROCESSING_FEE_AMOUNT_82, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {CREDIT_TRANSACTION_FEE_AMOUNT_83, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {DEBITS_PROCESSING_FEE_AMOUNT_84, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {DEBITS_TRANSACTION_FEE_AMOUNT_85, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 12},
-    {TOTAL_AMOUNT_OF_CREDITS_86, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 16},
-    {CREDITS_REVERSAL_AMOUNT_87, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 16},
-    {TOTAL_AMOUNT_OF_DEBITS_88, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 16},
-    {DEBIT_REVESAL_AMOUNT_89, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 16},
-    {ORIGINAL_DATA_ELEMENTS_90, FIXED_LENGTH, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 42},
-    {FILE_UPDATE_CODE_91, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 1},
-    {FILE_SECURITY_CODE_92, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 2},
-    {RESPONSE_INDICATOR_93, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 5},
-    {SERVICE_INDICATOR_94, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 7},
-    {REPLACEMENT_AMOUNTS_95, FIXED_LENGTH, ALPHANUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 42},
-    {MESSAGE_SECURITY_CODE_96, FIXED_LENGTH, BINARY, BINARY_ENCODING,
-     ASCII_ENCODING, 64},
-    {NET_SETTLEMENT_AMOUNT_97, FIXED_LENGTH, HEX_NUMERICS, ASCII_ENCODING,
-     ASCII_ENCODING, 17},
-    {PAYEE_98, FIXED_LENGTH, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 25},
-    {SETTLEMENT_INSTITUTION_IDENTIFICATION_CODE_99, FIXED_LENGTH, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 11},
-    {RECEIVING_INSTITUTION_IDENTIFICATION_CODE_100, LL_VAR, NUMERIC,
-     ASCII_ENCODING, ASCII_ENCODING, 11},
-    {FILE_NAME_101, FIXED_LENGTH, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 17},
-    {ACCOUNT_IDENTIFICATION1_102, LL_VAR, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 28},
-    {ACCOUNT_IDENTIFICATION2_103, LL_VAR, NUMERIC, ASCII_ENCODING,
-     ASCII_ENCODING, 28},
-    {TRANSACTION_DESCRIPTION_104, FIXED_LENGTH, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 100},
-    {RESERVED_FOR_ISO_USE_105, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_ISO_USE_106, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_ISO_USE_107, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_ISO_USE_108, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_ISO_USE_109, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_ISO_USE_110, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_ISO_USE_111, LLL_VAR, ALPHANUMERIC_SPECIAL, ASCII_ENCODING,
-     ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_112, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_113, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_114, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_115, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_116, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_117, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_118, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_119, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_120, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_121, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_122, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_123, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_124, LLLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 9999},
-    {RESERVED_FOR_NATIONAL_USE_125, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_126, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {RESERVED_FOR_NATIONAL_USE_127, LLL_VAR, ALPHANUMERIC_SPECIAL,
-     ASCII_ENCODING, ASCII_ENCODING, 999},
-    {MESSAGE_AUTHENTICATION_CODE_128, FIXED_LENGTH, ALPHANUMERIC,
-     BINARY_ENCODING, ASCII_ENCODING, 64},
-};
+    C8583_FIELDS(C8583_CONFIG_ENTRY)};
 
 static short needToAppendF(const struct C8583Config* config) {
   return (config->field == PRIMARY_ACCOUNT_NUMBER_2 ||
@@ -288,81 +298,46 @@ static short isFixedLen(const struct C8583Config* config) {
   return (config->type == FIXED_LENGTH) ? 1 : 0;
 }
 
-static struct IsoData* bcdToAscEncode(const unsigned char* datum,
-                                      const unsigned int size) {
-  struct IsoData* encodedData = NULL;
-  encodedData = (struct IsoData*)malloc(1 * sizeof(struct IsoData));
-
-  encodedData->size = size * 2 + 1;
-  // the extra one is only needed for bcdToAsc
-  encodedData->datum = (unsigned char*)malloc(sizeof(char) * encodedData->size);
-  c8583BcdToAsc(encodedData->datum, (unsigned char*)datum, size);
-  encodedData->size -= 1;
-
-  return encodedData;
-}
-
-static struct IsoData* ascToBcdEncode(const unsigned char* datum,
-                                      const unsigned int size,
-                                      const struct C8583Config* config) {
-  struct IsoData* encodedData = NULL;
-  short isOddLen = size % 2;
-
-  encodedData = (struct IsoData*)malloc(1 * sizeof(struct IsoData));
-  encodedData->size = isOddLen ? (size + 1) / 2 : size / 2;
-  encodedData->datum = (unsigned char*)malloc(sizeof(char) * encodedData->size);
-
-  if (isOddLen) {
-    int len = size + 1;
-
-    char* buffer = (char*)calloc(len, sizeof(char));
-
-    if (needToPrepend0(config)) {
-      buffer[0] = '0';
-      memcpy(&buffer[1], datum, size);
-      c8583AscToBcd(encodedData->datum, encodedData->size, buffer);
-    } else if (needToAppendF(config)) {
-      memcpy(buffer, datum, size);
-      buffer[size] = 'F';
-      c8583AscToBcd(encodedData->datum, encodedData->size, buffer);
-    } else {
-      c8583AscToBcd(encodedData->datum, encodedData->size, (char*)datum);
-    }
+static short ascToBcdEncode(unsigned char* packet, const unsigned char* datum,
+                            const unsigned int size,
+                            const struct C8583Config* config) {
+  const char* digits = (const char*)datum;
+  unsigned int evenSize = size - (size % 2);
+  char edge[2] = {'0', '0'};
 
-    free(buffer);
-  } else {
-    c8583AscToBcd(encodedData->datum, encodedData->size, (char*)datum);
+  if (size % 2 == 0) {
+    return hexDecode(packet, digits, size) < 0 ? 0 : 1;
   }
 
-  return encodedData;
-}
-
-static struct IsoData* equalInputAndOutPutEncode(const unsigned char* datum,
-                                                 const unsigned int size) {
-  struct IsoData* encodedData = NULL;
-  encodedData = (struct IsoData*)malloc(1 * sizeof(struct IsoData));
+  // odd numerics are right justified, the leading nibble is 0
+  if (needToPrepend0(config)) {
+    edge[1] = digits[0];
+    return (hexDecode(packet, edge, 2) < 0 ||
+            hexDecode(&packet[1], &digits[1], evenSize) < 0)
+               ? 0
+               : 1;
+  }
 
-  encodedData->size = size;
-  encodedData->datum = (unsigned char*)malloc(sizeof(char) * size);
-  memcpy(encodedData->datum, datum, size);
+  edge[0] = digits[evenSize];
+  if (needToAppendF(config)) edge[1] = 'F';
 
-  return encodedData;
+  return (hexDecode(packet, digits, evenSize) < 0 ||
+          hexDecode(&packet[evenSize / 2], edge, 2) < 0)
+             ? 0
+             : 1;
 }
 
-static struct IsoData* encodeFixedLenPart(const unsigned char* datum,
-                                          const unsigned int size,
-                                          const struct C8583Config* config,
-                                          char* message) {
+static int getEncodedSize(const unsigned int size,
+                          const struct C8583Config* config) {
   if (isAscToBcd(config)) {
-    return ascToBcdEncode(datum, size, config);
+    return (size + 1) / 2;
   } else if (isBcdToAsc(config)) {
-    return bcdToAscEncode(datum, size);
+    return size * 2;
   } else if (equalEncoding(config)) {
-    return equalInputAndOutPutEncode(datum, size);
-  } else {
-    strcpy(message, "Unknown encoding type");
-    return NULL;
+    return size;
   }
+
+  return -1;
 }
 
 static short outputIsBcd(const struct C8583Config* config) {
@@ -374,23 +349,22 @@ static short outputIsAsc(const struct C8583Config* config) {
 }
 
 #if 1
-static short lenToStr(unsigned char* ascLen, const int length,
-                      const enum FieldType fieldType, const short isBcd) {
+static short lenWidth(const enum FieldType fieldType, const short isBcd) {
   switch (fieldType) {
     case LL_VAR:
-      return sprintf((char*)ascLen, "%02d", length);
+      return 2;
 
     case LLL_VAR:
-      return sprintf((char*)ascLen, isBcd ? "%04d" : "%03d", length);
+      return isBcd ? 4 : 3;
 
     case LLLL_VAR:
-      return sprintf((char*)ascLen, "%04d", length);
+      return 4;
 
     case LLLLL_VAR:
-      return sprintf((char*)ascLen, isBcd ? "%06d" : "%05d", length);
+      return isBcd ? 6 : 5;
 
     case LLLLLL_VAR:
-      return sprintf((char*)ascLen, "%06d", length);
+      return 6;
 
     default:
       return 0;
@@ -401,30 +375,29 @@ static short isBinary(const struct C8583Config* config) {
   return (config->attribute == BINARY);
 }
 
-static short getBinaryVarLen(unsigned char* varLen, const int fieldLen,
-                             const struct C8583Config* config) {
-  unsigned char lenStr[9] = {'\0'};
-  short width = lenToStr(lenStr, fieldLen, config->type, 1);
-  int size = width / 2;
-  c8583AscToBcd(varLen, size, (const char*)lenStr);
-
-  return size;
-}
-
-static short getBcdVarLen(unsigned char* varLen, const int fieldLen,
+static short getBcdVarLen(unsigned char* varLen, int fieldLen,
                           const struct C8583Config* config) {
-  unsigned char lenStr[9] = {'\0'};
-  short width = lenToStr(lenStr, fieldLen, config->type, 1);
-  int size = width / 2;
+  short size = lenWidth(config->type, 1) / 2;
+  short i = 0;
 
-  c8583AscToBcd(varLen, size, (const char*)lenStr);
+  for (i = size - 1; i >= 0; i--) {
+    varLen[i] = (unsigned char)(((fieldLen / 10 % 10) << 4) | (fieldLen % 10));
+    fieldLen /= 100;
+  }
 
   return size;
 }
 
-static short getAscVarLen(unsigned char* varLen, const int fieldLen,
+static short getAscVarLen(unsigned char* varLen, int fieldLen,
                           const struct C8583Config* config) {
-  short width = lenToStr(varLen, fieldLen, config->type, 0);
+  short width = lenWidth(config->type, 0);
+  short i = 0;
+
+  for (i = width - 1; i >= 0; i--) {
+    varLen[i] = (unsigned char)('0' + fieldLen % 10);
+    fieldLen /= 10;
+  }
+
   return width;
 }
 
@@ -432,7 +405,7 @@ static short getDatumVarLen(unsigned char* varLen, const int fieldLen,
                             const struct C8583Config* config) {
   if (outputIsBcd(config)) {
     if (isBinary(config)) {
-      return getBinaryVarLen(varLen, fieldLen, config);
+      return getBcdVarLen(varLen, fieldLen, config);
     } else {
       return getBcdVarLen(varLen, fieldLen * 2, config);
     }
@@ -452,23 +425,6 @@ static short getDatumVarLen(unsigned char* varLen, const int fieldLen,
 }
 #endif
 
-static struct IsoData* encodeDatumWithVarLen(const unsigned char* datum,
-                                             const unsigned int size,
-                                             const struct C8583Config* config) {
-  int width = 0;
-  unsigned char varLen[12] = {'\0'};
-  struct IsoData* varDatum = (struct IsoData*)calloc(1, sizeof(struct IsoData));
-
-  width = getDatumVarLen(varLen, size, config);
-
-  varDatum->size = width + size;
-  varDatum->datum = (unsigned char*)calloc(varDatum->size, sizeof(char));
-  memcpy(varDatum->datum, varLen, width);
-  memcpy(&varDatum->datum[width], datum, size);
-
-  return varDatum;
-}
-
 short isFieldInRange(const int field) {
   return (field >= PRIMARY_ACCOUNT_NUMBER_2 && field < FIELD_END) ? 1 : 0;
 }
@@ -481,26 +437,54 @@ void getC8583Config(struct C8583Config* config, const short field) {
   memcpy(config, &gC8583Config[field], sizeof(struct C8583Config));
 }
 
-struct IsoData* encodeDatum(const unsigned char* datum, const unsigned int size,
-                            const struct C8583Config* config, char* message) {
-  struct IsoData* fixedDatum = NULL;
-  struct IsoData* varDatum = NULL;
+/**
+ * Inlined into the per-field encoders with a constant config, so the encoding
+ * branches fold away.
+ */
+__attribute__((always_inline)) static inline int encodeWith(
+    unsigned char* packet, const unsigned int size, const unsigned char* datum,
+    const unsigned int datumSize, const struct C8583Config* config,
+    char* message) {
+  unsigned char varLen[12] = {'\0'};
+  int width = 0;
+  int encodedSize = 0;
 
-  if (isFixedLen(config) && size != config->length) {
+  if (isFixedLen(config) && datumSize != config->length) {
     sprintf(message, "F[%d], Len(expected: %u, actual: %u)", config->field,
-            config->length, size);
-    return NULL;
+            config->length, datumSize);
+    return 0;
   }
 
-  fixedDatum = encodeFixedLenPart(datum, size, config, message);
-  if (fixedDatum == NULL) return NULL;
+  encodedSize = getEncodedSize(datumSize, config);
+  if (encodedSize < 0) {
+    strcpy(message, "Unknown encoding type");
+    return 0;
+  }
 
-  if (isFixedLen(config)) return fixedDatum;
-  varDatum = encodeDatumWithVarLen(fixedDatum->datum, fixedDatum->size, config);
+  if (!isFixedLen(config)) {
+    width = getDatumVarLen(varLen, encodedSize, config);
+  }
+
+  if (size < (unsigned int)(width + encodedSize)) {
+    sprintf(message, "not enough buffer to pack F[%d] and others",
+            config->field);
+    return 0;
+  }
 
-  freeIsoData(fixedDatum);
+  memcpy(packet, varLen, width);
 
-  return varDatum;
+  if (isAscToBcd(config)) {
+    if (!ascToBcdEncode(&packet[width], datum, datumSize, config)) {
+      sprintf(message, "F[%d] isn't hex", config->field);
+      return 0;
+    }
+  } else if (isBcdToAsc(config)) {
+    hexEncode((char*)&packet[width], datum, datumSize, HEX_CASE_UPPER);
+  } else {
+    memcpy(&packet[width], datum, datumSize);
+  }
+
+  return width + encodedSize;
 }
 
 static short isEnoughBuffer(char* message, const int field, unsigned int size,
@@ -513,69 +497,30 @@ static short isEnoughBuffer(char* message, const int field, unsigned int size,
   return 1;
 }
 
-static struct IsoData* decodeFixedLenDatum(const unsigned char* packet,
-                                           const unsigned int size,
-                                           const struct C8583Config* config,
-                                           char* message) {
-  struct IsoData* data = NULL;
-
-  data = (struct IsoData*)malloc(sizeof(struct IsoData));
-
-  if (config->inputEncoding == ASCII_ENCODING &&
-      config->outputEncoding == ASCII_ENCODING) {
-    data->size = config->length;
-
-    if (!isEnoughBuffer(message, config->field, data->size, size)) {
-      free(data);
-      return NULL;
-    }
-
-    data->datum =
-        (unsigned char*)malloc((data->size + 1) * sizeof(char));  //+1 for '\0'
-    memcpy(data->datum, packet, data->size);
-    data->datum[data->size] = 0;
+static short decodeFixedLenDatumView(struct IsoDataView* view,
+                                     const unsigned int size,
+                                     const struct C8583Config* config,
+                                     char* message) {
+  if (equalEncoding(config)) {
+    view->size = config->length;
   } else if (isAscToBcd(config)) {
-    data->size = (config->length + 1) /
+    view->size = (config->length + 1) /
                  2;  //+1 needed when len of input encoding is odd.
-
-    if (!isEnoughBuffer(message, config->field, data->size, size)) {
-      free(data);
-      return NULL;
-    }
-
-    data->datum = (unsigned char*)malloc(data->size * sizeof(char));
-    memcpy(data->datum, packet, data->size);
   } else if (isBcdToAsc(config)) {
-    data->size = config->length * 2;
-
-    if (!isEnoughBuffer(message, config->field, data->size, size)) {
-      free(data);
-      return NULL;
-    }
-
-    data->datum =
-        (unsigned char*)malloc((data->size + 1) * sizeof(char));  //+1 for '\0'
-    memcpy(data->datum, packet, data->size);
-    data->datum[data->size] = 0;
-  } else if (config->inputEncoding == BCD_ENCODING &&
-             config->outputEncoding == BCD_ENCODING) {
-    data->size = config->length;
-
-    if (!isEnoughBuffer(message, config->field, data->size, size)) {
-      free(data);
-      return NULL;
-    }
-
-    data->datum =
-        (unsigned char*)malloc(data->size * sizeof(char));  //+1 for '\0'
-    memcpy(data->datum, packet, data->size);
+    view->size = config->length * 2;
+  } else {
+    strcpy(message, "Unknown encoding type");
+    return 0;
   }
 
-  data->jumper = data->size;
+  if (!isEnoughBuffer(message, config->field, view->size, size)) {
+    return 0;
+  }
 
-  (void)message;
+  view->offset = 0;
+  view->jumper = view->size;
 
-  return data;
+  return 1;
 }
 
 static short getFieldVarWidth(const struct C8583Config* config) {
@@ -603,28 +548,41 @@ static short getFieldVarWidth(const struct C8583Config* config) {
 }
 
 static short bcdLenToInt(const unsigned char* bcdLen, const int lenSize) {
-  unsigned char buffer[21] = {'\0'};
-  unsigned char bcd[21];
+  short len = 0;
+  int i = 0;
 
-  memcpy(bcd, bcdLen, lenSize);
+  for (i = 0; i < lenSize; i++) {
+    if ((bcdLen[i] >> 4) > 9 || (bcdLen[i] & 0x0F) > 9) return -1;
+    len = len * 100 + (bcdLen[i] >> 4) * 10 + (bcdLen[i] & 0x0F);
+  }
 
-  c8583BcdToAsc(buffer, bcd, lenSize);
+  return len;
+}
+
+static short ascLenToInt(const unsigned char* ascLen, const int lenSize) {
+  short len = 0;
+  int i = 0;
 
-  return atoi((char*)buffer);
+  for (i = 0; i < lenSize; i++) {
+    if (ascLen[i] < '0' || ascLen[i] > '9') return -1;
+    len = len * 10 + (ascLen[i] - '0');
+  }
+
+  return len;
 }
 
 static short getVarDatumLen(const unsigned char* packet, const short width,
                             const struct C8583Config* config) {
+  short len = 0;
+
   if (config->attribute == BINARY) {
     return bcdLenToInt(packet, width);
   } else if (outputIsBcd(config)) {
-    return bcdLenToInt(packet, width) / 2;
-  } else {
-    char buff[10] = {0};
-
-    memcpy(buff, packet, width);
-    return atoi(buff);
+    len = bcdLenToInt(packet, width);
+    return len < 0 ? len : len / 2;
   }
+
+  return ascLenToInt(packet, width);
 }
 
 short isAscToBcd(const struct C8583Config* config) {
@@ -641,11 +599,11 @@ short isBcdToAsc(const struct C8583Config* config) {
              : 0;
 }
 
-static struct IsoData* decodeVarLenDatum(const unsigned char* packet,
-                                         const unsigned int size,
-                                         const struct C8583Config* config,
-                                         char* message) {
-  struct IsoData* data = NULL;
+static short decodeVarLenDatumView(struct IsoDataView* view,
+                                   const unsigned char* packet,
+                                   const unsigned int size,
+                                   const struct C8583Config* config,
+                                   char* message) {
   unsigned int width = 0;
   int len = 0;
 
@@ -653,44 +611,108 @@ static struct IsoData* decodeVarLenDatum(const unsigned char* packet,
 
   if (width > size) {
     sprintf(message, "Not enough buffer, stopping F[%d]", config->field);
-    return NULL;
+    return 0;
   }
 
   len = getVarDatumLen(packet, width, config);
 
   if (len < 0) {
     sprintf(message, "Can't get len of F[%d]", config->field);
-    return NULL;
+    return 0;
   }
 
-  data = (struct IsoData*)malloc(sizeof(struct IsoData));
+  if (!isEnoughBuffer(message, config->field, width + len, size)) {
+    return 0;
+  }
 
-  data->size = len;
+  view->offset = width;
+  view->size = len;
+  view->jumper = width + len;
 
-  if (outputIsAsc(config)) {
-    data->datum =
-        (unsigned char*)malloc((data->size + 1) * sizeof(char));  //+1 for '\0'
-    data->datum[data->size] = 0;
-  } else {
-    data->datum = (unsigned char*)malloc(data->size * sizeof(char));
-  }
+  return 1;
+}
 
-  memcpy(data->datum, &packet[width], data->size);
+__attribute__((always_inline)) static inline short decodeWith(
+    struct IsoDataView* view, const unsigned char* packet,
+    const unsigned int size, const struct C8583Config* config, char* message) {
+  return (config->type == FIXED_LENGTH)
+             ? decodeFixedLenDatumView(view, size, config, message)
+             : decodeVarLenDatumView(view, packet, size, config, message);
+}
 
-  data->jumper = width + data->size;
+int encodeDatum(unsigned char* packet, const unsigned int size,
+                const unsigned char* datum, const unsigned int datumSize,
+                const struct C8583Config* config, char* message) {
+  return encodeWith(packet, size, datum, datumSize, config, message);
+}
 
-  return data;
+short decodeDatumView(struct IsoDataView* view, const unsigned char* packet,
+                      const unsigned int size,
+                      const struct C8583Config* config, char* message) {
+  return decodeWith(view, packet, size, config, message);
 }
 
-struct IsoData* decodeDatum(const unsigned char* packet,
-                            const unsigned int size,
-                            const struct C8583Config* config, char* message) {
-  return (config->type == FIXED_LENGTH)
-             ? decodeFixedLenDatum(packet, size, config, message)
-             : decodeVarLenDatum(packet, size, config, message);
+typedef int (*FieldEncoder)(unsigned char* packet, const unsigned int size,
+                            const unsigned char* datum,
+                            const unsigned int datumSize, char* message);
+typedef short (*FieldDecoder)(struct IsoDataView* view,
+                              const unsigned char* packet,
+                              const unsigned int size, char* message);
+
+#define C8583_FIELD_CODEC(field, type, attribute, in, out, length)             \
+  static int encode_##field(unsigned char* packet, const unsigned int size,    \
+                            const unsigned char* datum,                        \
+                            const unsigned int datumSize, char* message) {     \
+    static const struct C8583Config config = {                                 \
+        field, type, attribute, in, out, length};                              \
+    return encodeWith(packet, size, datum, datumSize, &config, message);       \
+  }                                                                            \
+  static short decode_##field(struct IsoDataView* view,                        \
+                              const unsigned char* packet,                     \
+                              const unsigned int size, char* message) {        \
+    static const struct C8583Config config = {                                 \
+        field, type, attribute, in, out, length};                              \
+    return decodeWith(view, packet, size, &config, message);                   \
+  }
+
+C8583_FIELDS(C8583_FIELD_CODEC)
+
+#define C8583_ENCODER_ENTRY(field, type, attribute, in, out, length) \
+  encode_##field,
+#define C8583_DECODER_ENTRY(field, type, attribute, in, out, length) \
+  decode_##field,
+
+static const FieldEncoder gFieldEncoders[] = {
+    C8583_FIELDS(C8583_ENCODER_ENTRY)};
+static const FieldDecoder gFieldDecoders[] = {
+    C8583_FIELDS(C8583_DECODER_ENTRY)};
+
+/**
+ * Encode a datum with the codec generated for its field, same as encodeDatum
+ * with the field's config.
+ */
+int encodeField(const short field, unsigned char* packet,
+                const unsigned int size, const unsigned char* datum,
+                const unsigned int datumSize, char* message) {
+  if (field < MESSAGE_TYPE_INDICATOR_0 || field >= FIELD_END) {
+    sprintf(message, "F[%d] out of range", field);
+    return 0;
+  }
+
+  return gFieldEncoders[field](packet, size, datum, datumSize, message);
 }
 
-void freeIsoData(struct IsoData* isoData) {
-  if (isoData->datum) free(isoData->datum);
-  if (isoData) free(isoData);
+/**
+ * Decode a datum with the codec generated for its field, same as
+ * decodeDatumView with the field's config.
+ */
+short decodeFieldView(struct IsoDataView* view, const short field,
+                      const unsigned char* packet, const unsigned int size,
+                      char* message) {
+  if (field < MESSAGE_TYPE_INDICATOR_0 || field >= FIELD_END) {
+    sprintf(message, "F[%d] out of range", field);
+    return 0;
+  }
+
+  return gFieldDecoders[field](view, packet, size, message);
 }
@@ -21,11 +21,16 @@ extern "C" {
 
 #define USE_BCD_LEN_FOR_ASC
 
-struct IsoData {
-  unsigned char* datum;
+/**
+ * Where a datum lies in a packet, nothing is copied.
+ * @offset: offset of the datum from the start of the field
+ * @size: size of the datum
+ * @jumper: size of the field, length prefix included
+ */
+struct IsoDataView {
+  unsigned int offset;
   unsigned int size;
   unsigned int jumper;
-  char message[65];
 };
 
 enum FieldType {
@@ -67,12 +72,18 @@ short isBcdToAsc(const struct C8583Config* config);
 short isAscToBcd(const struct C8583Config* config);
 void getC8583Config(struct C8583Config* config, const short field);
 short getConfigSize(void);
-struct IsoData* encodeDatum(const unsigned char* datum, const unsigned int size,
-                            const struct C8583Config* config, char* message);
-struct IsoData* decodeDatum(const unsigned char* packet,
-                            const unsigned int size,
-                            const struct C8583Config* config, char* message);
-void freeIsoData(struct IsoData* isoData);
+int encodeDatum(unsigned char* packet, const unsigned int size,
+                const unsigned char* datum, const unsigned int datumSize,
+                const struct C8583Config* config, char* message);
+short decodeDatumView(struct IsoDataView* view, const unsigned char* packet,
+                      const unsigned int size,
+                      const struct C8583Config* config, char* message);
+int encodeField(const short field, unsigned char* packet,
+                const unsigned int size, const unsigned char* datum,
+                const unsigned int datumSize, char* message);
+short decodeFieldView(struct IsoDataView* view, const short field,
+                      const unsigned char* packet, const unsigned int size,
+                      char* message);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,215 @@
+/**
+ * File: C8583Emv.c
+ * ----------------
+ */
+
+#include "C8583Emv.h"
+
+#include <string.h>
+
+#include "../hexcodec/hexcodec.h"
+#include "FieldNames.h"
+
+/**
+ * Reads the byte at pos, in units of encoding. Returns -1 past size or on an
+ * invalid hex digit.
+ */
+static int readByte(const unsigned char* data, const int size, const int pos,
+                    const EmvTlvEncoding encoding) {
+  unsigned char byte = 0;
+
+  if (encoding == EMV_TLV_HEX) {
+    if (pos + 2 > size || hexDecode(&byte, (const char*)&data[pos], 2) < 0) {
+      return -1;
+    }
+    return byte;
+  }
+
+  return pos < size ? data[pos] : -1;
+}
+
+static int unitsPerByte(const EmvTlvEncoding encoding) {
+  return encoding == EMV_TLV_HEX ? 2 : 1;
+}
+
+static unsigned int tagSlot(const unsigned int tag) {
+  return (tag * 0x9E3779B1u) >> 25;
+}
+
+static short addEntry(EmvTlvIndex* index, const unsigned int tag,
+                      const int offset, const int length) {
+  unsigned int slot = tagSlot(tag);
+
+  if (index->count == EMV_TLV_MAX_ENTRIES) return 0;
+
+  index->entries[index->count].tag = tag;
+  index->entries[index->count].offset = (unsigned short)offset;
+  index->entries[index->count].length = (unsigned short)length;
+  index->count++;
+
+  // more slots than entries, there's always an empty one
+  while (index->slots[slot]) {
+    if (index->entries[index->slots[slot] - 1].tag == tag) return 1;
+    slot = (slot + 1) % EMV_TLV_SLOTS;
+  }
+  index->slots[slot] = (unsigned char)index->count;
+
+  return 1;
+}
+
+DllSpec short emvTlvIndex(EmvTlvIndex* index, const unsigned char* data,
+                          const int size, const EmvTlvEncoding encoding) {
+  const int unit = unitsPerByte(encoding);
+  int pos = 0;
+
+  memset(index, 0x00, sizeof(EmvTlvIndex));
+  index->data = data;
+  index->encoding = encoding;
+
+  if (data == NULL || size <= 0 || size > 0xFFFF) return 0;
+
+  while (pos < size) {
+    unsigned int tag = 0;
+    int length = 0;
+    int byte = readByte(data, size, pos, encoding);
+    int i = 0;
+
+    if (byte < 0) return 0;
+    if (byte == 0x00 || byte == 0xFF) {
+      pos += unit;
+      continue;
+    }
+
+    // tag, subsequent bytes follow a first byte of xxx11111 while b8 is set
+    tag = byte;
+    pos += unit;
+    if ((byte & 0x1F) == 0x1F) {
+      do {
+        byte = readByte(data, size, pos, encoding);
+        if (byte < 0 || tag > 0xFFFFFF) return 0;
+        tag = (tag << 8) | byte;
+        pos += unit;
+      } while (byte & 0x80);
+    }
+
+    // length, short form or long form of up to 2 bytes
+    byte = readByte(data, size, pos, encoding);
+    if (byte < 0 || byte == 0x80 || byte > 0x82) return 0;
+    pos += unit;
+    if (byte & 0x80) {
+      for (i = byte & 0x7F; i > 0; i--) {
+        byte = readByte(data, size, pos, encoding);
+        if (byte < 0) return 0;
+        length = (length << 8) | byte;
+        pos += unit;
+      }
+    } else {
+      length = byte;
+    }
+
+    length *= unit;
+    if (length > size - pos) return 0;
+    if (!addEntry(index, tag, pos, length)) return 0;
+    pos += length;
+  }
+
+  return (short)index->count;
+}
+
+DllSpec short emvTlvIndexIccData(EmvTlvIndex* index, const IsoMsg isoMsg) {
+  const unsigned char* datum = NULL;
+  int datumSize = 0;
+
+  if (!getDatumView(isoMsg, ICC_DATA_55, &datum, &datumSize)) {
+    memset(index, 0x00, sizeof(EmvTlvIndex));
+    return 0;
+  }
+
+  return emvTlvIndex(index, datum, datumSize, EMV_TLV_HEX);
+}
+
+DllSpec short emvTlvFind(const EmvTlvIndex* index, const unsigned int tag,
+                         const unsigned char** value, int* length) {
+  unsigned int slot = tagSlot(tag);
+
+  while (index->slots[slot]) {
+    const EmvTlvEntry* entry = &index->entries[index->slots[slot] - 1];
+
+    if (entry->tag == tag) {
+      *value = &index->data[entry->offset];
+      *length = entry->length;
+      return 1;
+    }
+    slot = (slot + 1) % EMV_TLV_SLOTS;
+  }
+
+  return 0;
+}
+
+/**
+ * Writes the bytes of a tag or a length in units of encoding. Returns the
+ * units written, 0 if out is too small.
+ */
+static int writeBytes(unsigned char* out, const int size,
+                      const unsigned char* bytes, const int count,
+                      const EmvTlvEncoding encoding) {
+  const int units = count * unitsPerByte(encoding);
+
+  if (units > size) return 0;
+
+  if (encoding == EMV_TLV_HEX) {
+    hexEncode((char*)out, bytes, count, HEX_CASE_UPPER);
+  } else {
+    memcpy(out, bytes, count);
+  }
+
+  return units;
+}
+
+DllSpec int emvTlvBuild(unsigned char* out, const int size,
+                        const EmvTlvView* views, const int count,
+                        const EmvTlvEncoding encoding) {
+  const int unit = unitsPerByte(encoding);
+  int pos = 0;
+  int i = 0;
+
+  for (i = 0; i < count; i++) {
+    unsigned char header[7];
+    int headerLen = 0;
+    int valueLen = views[i].length / unit;
+    int shift = 24;
+    int written = 0;
+
+    if (views[i].length < 0 || views[i].length % unit || valueLen > 0xFFFF ||
+        views[i].tag == 0) {
+      return -1;
+    }
+
+    while (shift > 0 && !((views[i].tag >> shift) & 0xFF)) shift -= 8;
+    for (; shift >= 0; shift -= 8) {
+      header[headerLen++] = (unsigned char)(views[i].tag >> shift);
+    }
+
+    if (valueLen > 0xFF) {
+      header[headerLen++] = 0x82;
+      header[headerLen++] = (unsigned char)(valueLen >> 8);
+    } else if (valueLen > 0x7F) {
+      header[headerLen++] = 0x81;
+    }
+    header[headerLen++] = (unsigned char)valueLen;
+
+    written = writeBytes(&out[pos], size - pos, header, headerLen, encoding);
+    if (!written || views[i].length > size - pos - written) return -1;
+    pos += written;
+
+    memcpy(&out[pos], views[i].value, views[i].length);
+    pos += views[i].length;
+  }
+
+  if (encoding == EMV_TLV_HEX) {
+    if (pos >= size) return -1;
+    out[pos] = '\0';
+  }
+
+  return pos;
+}
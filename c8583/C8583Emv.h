@@ -0,0 +1,147 @@
+/**
+ * File: C8583Emv.h
+ * ----------------
+ * Defines an index of the BER-TLV data objects of ICC data (DE 55), and a
+ * builder for it. Values aren't copied, the index records where they are.
+ */
+
+#ifndef C8583_EMV_INCLUDED
+#define C8583_EMV_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "C8583.h"
+
+#define EMV_TLV_MAX_ENTRIES 64
+#define EMV_TLV_SLOTS 128
+
+/**
+ * Enum: EmvTlvEncoding
+ * --------------------
+ * How the TLV bytes are carried, offsets and lengths are in units of it.
+ * @param EMV_TLV_BINARY one byte per byte
+ * @param EMV_TLV_HEX two hex digits per byte, as in DE 55
+ */
+
+typedef enum {
+  EMV_TLV_BINARY,
+  EMV_TLV_HEX,
+} EmvTlvEncoding;
+
+/**
+ * Struct: EmvTlvEntry
+ * -------------------
+ * @param tag Tag with all its bytes, e.g. 0x9F26
+ * @param offset Offset of the value in the indexed data
+ * @param length Length of the value in the indexed data
+ */
+
+typedef struct EmvTlvEntry {
+  unsigned int tag;
+  unsigned short offset;
+  unsigned short length;
+} EmvTlvEntry;
+
+/**
+ * Struct: EmvTlvIndex
+ * -------------------
+ * Data objects of ICC data in the order they appear. Constructed data objects,
+ * e.g. issuer scripts, are indexed as a whole. Of repeated tags the first is
+ * found.
+ * @param data Indexed data, must stay alive while the index is used
+ * @param encoding Encoding of data
+ * @param count Number of entries
+ * @param entries Data objects
+ * @param slots Open addressed table of tag to entry index + 1
+ */
+
+typedef struct EmvTlvIndex {
+  const unsigned char* data;
+  EmvTlvEncoding encoding;
+  int count;
+  EmvTlvEntry entries[EMV_TLV_MAX_ENTRIES];
+  unsigned char slots[EMV_TLV_SLOTS];
+} EmvTlvIndex;
+
+/**
+ * Struct: EmvTlvView
+ * ------------------
+ * A data object to build, see emvTlvBuild.
+ * @param tag Tag with all its bytes, e.g. 0x9F26
+ * @param value Value, in the encoding being built
+ * @param length Length of value in that encoding
+ */
+
+typedef struct EmvTlvView {
+  unsigned int tag;
+  const unsigned char* value;
+  int length;
+} EmvTlvView;
+
+/**
+ * Function: emvTlvIndex
+ * Usage: short result = emvTlvIndex(&index, data, size, EMV_TLV_HEX);
+ * ----------------------------------------------------------------
+ * Index the data objects of data in one pass. 0x00 and 0xFF padding between
+ * them is skipped.
+ * @return index Index of data
+ * @param data ICC data
+ * @param size Size of data
+ * @param encoding Encoding of data
+ * @return result Returns 0 if data is malformed or has more than
+ * EMV_TLV_MAX_ENTRIES data objects, otherwise the number of data objects
+ */
+
+DllSpec short emvTlvIndex(EmvTlvIndex* index, const unsigned char* data,
+                          const int size, const EmvTlvEncoding encoding);
+
+/**
+ * Function: emvTlvIndexIccData
+ * Usage: short result = emvTlvIndexIccData(&index, isoMsg);
+ * ----------------------------------------------------------------
+ * emvTlvIndex of DE 55 of isoMsg, hex encoded. The index points into
+ * isoMsg, or into the packet given to unpackDataView.
+ */
+
+DllSpec short emvTlvIndexIccData(EmvTlvIndex* index, const IsoMsg isoMsg);
+
+/**
+ * Function: emvTlvFind
+ * Usage: short found = emvTlvFind(&index, 0x9F26, &value, &length);
+ * ----------------------------------------------------------------
+ * Constant time lookup of a tag.
+ * @param index see emvTlvIndex
+ * @param tag Tag to find
+ * @return value Start of the value in the indexed data, not NUL terminated
+ * @return length Length of the value in the indexed data
+ * @return found Returns 0 if tag isn't in the index, otherwise 1
+ */
+
+DllSpec short emvTlvFind(const EmvTlvIndex* index, const unsigned int tag,
+                         const unsigned char** value, int* length);
+
+/**
+ * Function: emvTlvBuild
+ * Usage: int len = emvTlvBuild(out, size, views, count, EMV_TLV_HEX);
+ * ----------------------------------------------------------------
+ * Assemble ICC data from views, e.g. values found in an index.
+ * @return out ICC data, NUL terminated when hex encoded
+ * @param size Size of out
+ * @param views Data objects, in the order to build them
+ * @param count Number of views
+ * @param encoding Encoding of the values and of out
+ * @return len Returns -1 if out is too small or a view is invalid, otherwise
+ * the length written
+ */
+
+DllSpec int emvTlvBuild(unsigned char* out, const int size,
+                        const EmvTlvView* views, const int count,
+                        const EmvTlvEncoding encoding);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
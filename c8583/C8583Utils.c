@@ -8,40 +8,24 @@
 #include <stdlib.h>
 #include <string.h>
 
-short c8583BcdToAsc(unsigned char* asc, unsigned char* bcd, const int bcdLen) {
-  int i = 0;
-  short pos = 0;
+#include "../hexcodec/hexcodec.h"
 
+short c8583BcdToAsc(unsigned char* asc, unsigned char* bcd, const int bcdLen) {
   if (bcdLen <= 0) return -1;
 
-  for (i = 0; i < bcdLen; i++) {
-    pos += sprintf((char*)&asc[pos], "%02X", bcd[i]);
-  }
-
-  return 0;
-}
-
-static unsigned char atoh(const char c) {
-  if (c >= '0' && c <= '9') return (c - '0');
-  if (c >= 'A' && c <= 'F') return (c - 'A' + 10);
-  if (c >= 'a' && c <= 'f') return (c - 'a' + 10);
+  hexEncode((char*)asc, bcd, bcdLen, HEX_CASE_UPPER);
+  asc[bcdLen * 2] = '\0';
 
   return 0;
 }
 
 unsigned char c8583AscToBcd(unsigned char* bcd, const short bcdLen,
                             const char* asc) {
-  int ascLen, i, j;
-
-  if (bcdLen == 0) {
-    ascLen = strlen(asc);
-  } else {
-    ascLen = (bcdLen)*2;
-    memset(bcd, 0x00, bcdLen);
-  }
+  size_t ascLen = (bcdLen == 0) ? strlen(asc) : (size_t)bcdLen * 2;
 
-  for (i = 0, j = 0; j < ascLen; i++, j += 2) {
-    bcd[i] = (atoh(asc[2 * i]) << 4) | atoh(asc[2 * i + 1]);
+  if (hexDecode(bcd, asc, ascLen) < 0) {
+    if (bcdLen) memset(bcd, 0x00, bcdLen);
+    return 0;
   }
 
   return 1;
@@ -33,6 +33,7 @@ typedef enum {
   ERROR_CODE_HANDSHAKE_RUN_ERROR,
   ERROR_CODE_HOST_DECISION_ERROR,
   ERROR_CODE_ERROR,
+  ERROR_CODE_HANDSHAKE_DEADLINE_EXCEEDED,
 } ErrorCode;
 
 /**
@@ -34,6 +34,7 @@
 
 #include "des.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -250,6 +251,79 @@ static const uint32_t RHs[16] = {
          SB1[(T >> 24) & 0x3F];                                         \
   }
 
+/*
+ * DES and 3DES rounds between the initial and final permutations
+ */
+#define DES_ROUNDS(X, Y)      \
+  {                           \
+    for (i = 0; i < 8; i++) { \
+      DES_ROUND(Y, X);        \
+      DES_ROUND(X, Y);        \
+    }                         \
+  }
+
+#define DES3_ROUNDS(X, Y)     \
+  {                           \
+    DES_ROUNDS(X, Y);         \
+    for (i = 0; i < 8; i++) { \
+      DES_ROUND(X, Y);        \
+      DES_ROUND(Y, X);        \
+    }                         \
+    DES_ROUNDS(X, Y);         \
+  }
+
+/*
+ * Loop of the DES-CBC and 3DES-CBC functions. The chaining value is kept in
+ * words instead of being copied through iv and output for every block.
+ */
+#define DES_CRYPT_CBC(ROUNDS)                              \
+  {                                                        \
+    int i;                                                 \
+    uint32_t X, Y, T, *SK;                                 \
+    uint32_t C0, C1, P0 = 0, P1 = 0;                       \
+                                                           \
+    if (length % 8) return (ERR_DES_INVALID_INPUT_LENGTH); \
+                                                           \
+    GET_UINT32_BE(C0, iv, 0);                              \
+    GET_UINT32_BE(C1, iv, 4);                              \
+                                                           \
+    for (; length > 0; length -= 8) {                      \
+      SK = ctx->sk;                                        \
+      GET_UINT32_BE(X, input, 0);                          \
+      GET_UINT32_BE(Y, input, 4);                          \
+                                                           \
+      if (mode == DES_ENCRYPT) {                           \
+        X ^= C0;                                           \
+        Y ^= C1;                                           \
+      } else {                                             \
+        P0 = X;                                            \
+        P1 = Y;                                            \
+      }                                                    \
+                                                           \
+      DES_IP(X, Y);                                        \
+      ROUNDS(X, Y);                                        \
+      DES_FP(Y, X);                                        \
+                                                           \
+      if (mode == DES_ENCRYPT) {                           \
+        C0 = Y;                                            \
+        C1 = X;                                            \
+      } else {                                             \
+        Y ^= C0;                                           \
+        X ^= C1;                                           \
+        C0 = P0;                                           \
+        C1 = P1;                                           \
+      }                                                    \
+                                                           \
+      PUT_UINT32_BE(Y, output, 0);                         \
+      PUT_UINT32_BE(X, output, 4);                         \
+      input += 8;                                          \
+      output += 8;                                         \
+    }                                                      \
+                                                           \
+    PUT_UINT32_BE(C0, iv, 0);                              \
+    PUT_UINT32_BE(C1, iv, 4);                              \
+  }
+
 #define SWAP(a, b)  \
   {                 \
     uint32_t t = a; \
@@ -556,12 +630,7 @@ int des_crypt_ecb(des_context* ctx, const unsigned char input[8],
   GET_UINT32_BE(Y, input, 4);
 
   DES_IP(X, Y);
-
-  for (i = 0; i < 8; i++) {
-    DES_ROUND(Y, X);
-    DES_ROUND(X, Y);
-  }
-
+  DES_ROUNDS(X, Y);
   DES_FP(Y, X);
 
   PUT_UINT32_BE(Y, output, 0);
@@ -576,37 +645,7 @@ int des_crypt_ecb(des_context* ctx, const unsigned char input[8],
 int des_crypt_cbc(des_context* ctx, int mode, size_t length,
                   unsigned char iv[8], const unsigned char* input,
                   unsigned char* output) {
-  int i;
-  unsigned char temp[8];
-
-  if (length % 8) return (ERR_DES_INVALID_INPUT_LENGTH);
-
-  if (mode == DES_ENCRYPT) {
-    while (length > 0) {
-      for (i = 0; i < 8; i++) output[i] = (unsigned char)(input[i] ^ iv[i]);
-
-      des_crypt_ecb(ctx, output, output);
-      memcpy(iv, output, 8);
-
-      input += 8;
-      output += 8;
-      length -= 8;
-    }
-  } else /* DES_DECRYPT */
-  {
-    while (length > 0) {
-      memcpy(temp, input, 8);
-      des_crypt_ecb(ctx, input, output);
-
-      for (i = 0; i < 8; i++) output[i] = (unsigned char)(output[i] ^ iv[i]);
-
-      memcpy(iv, temp, 8);
-
-      input += 8;
-      output += 8;
-      length -= 8;
-    }
-  }
+  DES_CRYPT_CBC(DES_ROUNDS);
 
   return (0);
 }
@@ -626,22 +665,7 @@ int des3_crypt_ecb(des3_context* ctx, const unsigned char input[8],
   GET_UINT32_BE(Y, input, 4);
 
   DES_IP(X, Y);
-
-  for (i = 0; i < 8; i++) {
-    DES_ROUND(Y, X);
-    DES_ROUND(X, Y);
-  }
-
-  for (i = 0; i < 8; i++) {
-    DES_ROUND(X, Y);
-    DES_ROUND(Y, X);
-  }
-
-  for (i = 0; i < 8; i++) {
-    DES_ROUND(Y, X);
-    DES_ROUND(X, Y);
-  }
-
+  DES3_ROUNDS(X, Y);
   DES_FP(Y, X);
 
   PUT_UINT32_BE(Y, output, 0);
@@ -656,37 +680,7 @@ int des3_crypt_ecb(des3_context* ctx, const unsigned char input[8],
 int des3_crypt_cbc(des3_context* ctx, int mode, size_t length,
                    unsigned char iv[8], const unsigned char* input,
                    unsigned char* output) {
-  int i;
-  unsigned char temp[8];
-
-  if (length % 8) return (ERR_DES_INVALID_INPUT_LENGTH);
-
-  if (mode == DES_ENCRYPT) {
-    while (length > 0) {
-      for (i = 0; i < 8; i++) output[i] = (unsigned char)(input[i] ^ iv[i]);
-
-      des3_crypt_ecb(ctx, output, output);
-      memcpy(iv, output, 8);
-
-      input += 8;
-      output += 8;
-      length -= 8;
-    }
-  } else /* DES_DECRYPT */
-  {
-    while (length > 0) {
-      memcpy(temp, input, 8);
-      des3_crypt_ecb(ctx, input, output);
-
-      for (i = 0; i < 8; i++) output[i] = (unsigned char)(output[i] ^ iv[i]);
-
-      memcpy(iv, temp, 8);
-
-      input += 8;
-      output += 8;
-      length -= 8;
-    }
-  }
+  DES_CRYPT_CBC(DES3_ROUNDS);
 
   return (0);
 }
@@ -791,54 +785,136 @@ unsigned int des_cbc_decrypt(unsigned char* pout, unsigned char* pdata,
   return 0;
 }
 /*
- * 3DES-ECB buffer encryption API
+ * 3DES key schedule for both directions
  */
-unsigned int des3_ecb_encrypt(unsigned char* pout, unsigned char* pdata,
-                              unsigned int nlen, unsigned char* pkey,
-                              unsigned int klen) {
-  unsigned char* tmp;
-  unsigned int len, i;
-  unsigned char ch = '\0';
-  des3_context ctx3;
-
-  //<<<<<<< HEAD
-  if (klen == DES3_KEY2_SIZE) {         // 16字节
-    des3_set2key_enc(&ctx3, pkey);      // 根据长度设置key
-  } else if (klen == DES3_KEY3_SIZE) {  // 24字节
-    //=======
-    if (klen == DES3_KEY2_SIZE) {         // 16�ֽ�
-      des3_set2key_enc(&ctx3, pkey);      // ���ݳ�������key
-    } else if (klen == DES3_KEY3_SIZE) {  // 24�ֽ�
-      //>>>>>>> add all file
-      des3_set3key_enc(&ctx3, pkey);
-    }
+int des3_keyed_init(des3_keyed_ctx* ctx, const unsigned char* key,
+                    unsigned int klen) {
+  if (klen == DES3_KEY2_SIZE) {
+    des3_set2key(ctx->enc.sk, ctx->dec.sk, key);
+  } else if (klen == DES3_KEY3_SIZE) {
+    des3_set3key(ctx->enc.sk, ctx->dec.sk, key);
+  } else {
+    return (ERR_DES_INVALID_KEY_LENGTH);
   }
 
-  len = (nlen / 8 + (nlen % 8 ? 1 : 0)) * 8;
+  return (0);
+}
+
+void des3_keyed_free(des3_keyed_ctx* ctx) {
+  if (ctx == NULL) return;
+
+  zeroize(ctx, sizeof(des3_keyed_ctx));
+}
+
+/*
+ * 3DES-ECB buffer encryption with an expanded key, the last block is padded
+ * with zeros
+ */
+unsigned int des3_keyed_ecb_encrypt(des3_keyed_ctx* ctx, unsigned char* pout,
+                                    const unsigned char* pdata,
+                                    unsigned int nlen) {
+  unsigned char tmp[8] = {0};
+  unsigned int i;
+
+  for (i = 0; i + 8 <= nlen; i += 8) {
+    des3_crypt_ecb(&ctx->enc, (pdata + i), (pout + i));
+  }
+  if (i < nlen) {
+    memcpy(tmp, pdata + i, nlen - i);
+    des3_crypt_ecb(&ctx->enc, tmp, (pout + i));
+    i += 8;
+  }
+
+  return i;
+}
+
+/*
+ * 3DES-ECB buffer decryption with an expanded key
+ */
+unsigned int des3_keyed_ecb_decrypt(des3_keyed_ctx* ctx, unsigned char* pout,
+                                    const unsigned char* pdata,
+                                    unsigned int nlen) {
+  unsigned int i;
+
+  if (nlen % 8) return 1;
 
-  //<<<<<<< HEAD
-  // ch = 8 - nlen % 8;//可以设置补齐内容，常用0或0xFF
-  //=======
-  // ch = 8 - nlen % 8;//�������ò������ݣ�����0��0xFF
-  //>>>>>>> add all file
   for (i = 0; i < nlen; i += 8) {
-    des3_crypt_ecb(&ctx3, (pdata + i), (pout + i));
+    des3_crypt_ecb(&ctx->dec, (pdata + i), (pout + i));
   }
-  //<<<<<<< HEAD
-  if (len > nlen)  // 不足8字节补齐
-    //=======
-    if (len > nlen)  // ����8�ֽڲ���
-    //>>>>>>> add all file
-    {
-      tmp = (unsigned char*)malloc(len);
-      i -= 8;
-      memcpy(tmp, pdata + i, nlen - i);
-      memset(tmp + nlen % 8, ch, (8 - nlen % 8) % 8);
-      des3_crypt_ecb(&ctx3, tmp, (pout + i));
-      free(tmp);
+  return 0;
+}
+
+/*
+ * Expanded keys of the 3DES wrappers, least recently used is replaced.
+ * Entries are copied out under the lock, so callers never share a schedule.
+ */
+typedef struct {
+  unsigned char key[DES3_KEY3_SIZE];
+  unsigned int klen;
+  unsigned long lastUse;
+  des3_keyed_ctx ctx;
+} des3_schedule_entry;
+
+static des3_schedule_entry scheduleCache[DES3_SCHEDULE_CACHE_SIZE];
+static unsigned long scheduleClock;
+static pthread_mutex_t scheduleLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int des3_cached_schedule(des3_context* ctx, const unsigned char* key,
+                                unsigned int klen, int mode) {
+  des3_schedule_entry* entry = NULL;
+  int i;
+
+  if (klen != DES3_KEY2_SIZE && klen != DES3_KEY3_SIZE)
+    return (ERR_DES_INVALID_KEY_LENGTH);
+
+  pthread_mutex_lock(&scheduleLock);
+
+  for (i = 0; i < DES3_SCHEDULE_CACHE_SIZE; i++) {
+    if (scheduleCache[i].klen == klen &&
+        memcmp(scheduleCache[i].key, key, klen) == 0) {
+      entry = &scheduleCache[i];
+      break;
     }
+    if (entry == NULL || scheduleCache[i].lastUse < entry->lastUse) {
+      entry = &scheduleCache[i];
+    }
+  }
+
+  if (entry->klen != klen || memcmp(entry->key, key, klen) != 0) {
+    des3_keyed_init(&entry->ctx, key, klen);
+    memcpy(entry->key, key, klen);
+    entry->klen = klen;
+  }
+  entry->lastUse = ++scheduleClock;
+
+  memcpy(ctx, mode == DES_ENCRYPT ? &entry->ctx.enc : &entry->ctx.dec,
+         sizeof(des3_context));
+
+  pthread_mutex_unlock(&scheduleLock);
+  return (0);
+}
+
+void des3_schedule_cache_clear(void) {
+  pthread_mutex_lock(&scheduleLock);
+  zeroize(scheduleCache, sizeof(scheduleCache));
+  scheduleClock = 0;
+  pthread_mutex_unlock(&scheduleLock);
+}
+
+/*
+ * 3DES-ECB buffer encryption API
+ */
+unsigned int des3_ecb_encrypt(unsigned char* pout, unsigned char* pdata,
+                              unsigned int nlen, unsigned char* pkey,
+                              unsigned int klen) {
+  des3_keyed_ctx ctx3;
+  unsigned int len;
+
+  if (des3_cached_schedule(&ctx3.enc, pkey, klen, DES_ENCRYPT) != 0) return 0;
 
-  des3_free(&ctx3);
+  len = des3_keyed_ecb_encrypt(&ctx3, pout, pdata, nlen);
+
+  des3_free(&ctx3.enc);
   return len;
 }
 /*
@@ -847,21 +923,17 @@ unsigned int des3_ecb_encrypt(unsigned char* pout, unsigned char* pdata,
 unsigned int des3_ecb_decrypt(unsigned char* pout, unsigned char* pdata,
                               unsigned int nlen, unsigned char* pkey,
                               unsigned int klen) {
-  unsigned int i;
-  des3_context ctx3;
+  des3_keyed_ctx ctx3;
+  unsigned int ret;
 
   if (nlen % 8) return 1;
 
-  if (klen == DES3_KEY2_SIZE)
-    des3_set2key_dec(&ctx3, pkey);
-  else if (klen == DES3_KEY3_SIZE)
-    des3_set3key_dec(&ctx3, pkey);
+  if (des3_cached_schedule(&ctx3.dec, pkey, klen, DES_DECRYPT) != 0) return 1;
 
-  for (i = 0; i < nlen; i += 8) {
-    des3_crypt_ecb(&ctx3, (pdata + i), (pout + i));
-  }
-  des3_free(&ctx3);
-  return 0;
+  ret = des3_keyed_ecb_decrypt(&ctx3, pout, pdata, nlen);
+
+  des3_free(&ctx3.dec);
+  return ret;
 }
 /*
  * 3DES-CBC buffer encryption API
@@ -878,10 +950,7 @@ unsigned int des3_cbc_encrypt(unsigned char* pout, unsigned char* pdata,
   else
     pivb = piv;
 
-  if (klen == DES3_KEY2_SIZE)
-    des3_set2key_enc(&ctx, pkey);
-  else if (klen == DES3_KEY3_SIZE)
-    des3_set3key_enc(&ctx, pkey);
+  if (des3_cached_schedule(&ctx, pkey, klen, DES_ENCRYPT) != 0) return 0;
 
   des3_crypt_cbc(&ctx, 1, nlen, pivb, pdata, (pout));
 
@@ -904,10 +973,7 @@ unsigned int des3_cbc_decrypt(unsigned char* pout, unsigned char* pdata,
   else
     pivb = piv;
 
-  if (klen == DES3_KEY2_SIZE)
-    des3_set2key_dec(&ctx, pkey);
-  else if (klen == DES3_KEY3_SIZE)
-    des3_set3key_dec(&ctx, pkey);
+  if (des3_cached_schedule(&ctx, pkey, klen, DES_DECRYPT) != 0) return 1;
 
   des3_crypt_cbc(&ctx, 0, nlen, pivb, pdata, (pout));
 
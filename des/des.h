@@ -33,12 +33,16 @@
 
 #define ERR_DES_INVALID_INPUT_LENGTH \
   -0x0032 /**< The data input has an invalid length. */
+#define ERR_DES_INVALID_KEY_LENGTH \
+  -0x0034 /**< The key is neither 16 nor 24 bytes. */
 
 #define DES_KEY_SIZE 8
 
 #define DES3_KEY2_SIZE (16)
 #define DES3_KEY3_SIZE (24)
 
+#define DES3_SCHEDULE_CACHE_SIZE 8 /**< Keys expanded by the 3DES wrappers */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,6 +61,14 @@ typedef struct {
   uint32_t sk[96]; /*!<  3DES subkeys      */
 } des3_context;
 
+/**
+ * \brief          Triple-DES key expanded for both directions
+ */
+typedef struct {
+  des3_context enc; /*!<  encryption subkeys */
+  des3_context dec; /*!<  decryption subkeys */
+} des3_keyed_ctx;
+
 /**
  * \brief          Initialize DES context
  *
@@ -313,6 +325,61 @@ unsigned int des_cbc_decrypt(unsigned char* pout, unsigned char* pdata,
                              unsigned int nlen, unsigned char* pkey,
                              unsigned char* piv);
 
+/**
+ * \brief          Expand a 16 or 24-byte key once for both directions
+ *
+ * \param ctx      3DES keyed context to be initialized
+ * \param key      16 or 24-byte secret key
+ * \param klen     length of the key
+ *
+ * \return         0 if successful, or ERR_DES_INVALID_KEY_LENGTH
+ */
+int des3_keyed_init(des3_keyed_ctx* ctx, const unsigned char* key,
+                    unsigned int klen);
+
+/**
+ * \brief          Clear 3DES keyed context
+ *
+ * \param ctx      3DES keyed context to be cleared
+ */
+void des3_keyed_free(des3_keyed_ctx* ctx);
+
+/**
+ * \brief          3DES-ECB buffer encryption with an expanded key
+ *
+ * \param ctx		3DES keyed context
+ * \param pout		buffer holding the output data, nlen rounded up to 8
+ * \param pdata		buffer holding the input data
+ * \param nlen		length of the input data, the last block is zero padded
+ *
+ * \return         length of the output data
+ */
+unsigned int des3_keyed_ecb_encrypt(des3_keyed_ctx* ctx, unsigned char* pout,
+                                    const unsigned char* pdata,
+                                    unsigned int nlen);
+/**
+ * \brief          3DES-ECB buffer decryption with an expanded key
+ *
+ * \param ctx		3DES keyed context
+ * \param pout		buffer holding the output data
+ * \param pdata		buffer holding the input data
+ * \param nlen		length of the input data, a multiple of 8
+ *
+ * \return         0 if successful, or 1 if nlen isn't a multiple of 8
+ */
+unsigned int des3_keyed_ecb_decrypt(des3_keyed_ctx* ctx, unsigned char* pout,
+                                    const unsigned char* pdata,
+                                    unsigned int nlen);
+
+/**
+ * \brief          Forget the keys expanded by the 3DES wrappers below
+ *
+ *                 The wrappers keep the last DES3_SCHEDULE_CACHE_SIZE keys
+ *                 expanded, so a long-lived key (master, PIN) is expanded
+ *                 once. Call this to wipe them, e.g. on key change.
+ */
+void des3_schedule_cache_clear(void);
+
 /**
  * \brief          3DES-ECB buffer encryption
  *
@@ -322,7 +389,7 @@ unsigned int des_cbc_decrypt(unsigned char* pout, unsigned char* pdata,
  * \param pkey		buffer holding the key data
  * \param klen		length of the input key
  *
- * \return         0 if successful, or ERR_DES_INVALID_INPUT_LENGTH
+ * \return         length of the output data, 0 if klen is invalid
  */
 unsigned int des3_ecb_encrypt(unsigned char* pout, unsigned char* pdata,
                               unsigned int nlen, unsigned char* pkey,
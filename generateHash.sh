@@ -1,6 +1,6 @@
 #!/bin/bash
 
-cc -o generateHash generateHash.c platform/*.c sha256/*.c ezxml/*.c rc4/*.c
+cc -o generateHash generateHash.c platform/*.c sha256/*.c ezxml/*.c rc4/*.c hexcodec/*.c
 ./generateHash "080022380000008000059C00000425181954000019021954042620576GTO01701012NCAC00310861" "E189C5BF97C5F449373005A1237FCEF4"
 # Expected Output: D7FFEF6366B903E6716AEBD0429867E73EA92E5644BC2E96AA9A77D3417DD397
 # Actual Output: 444EC225AFAF89EBFB5AD3FAE570FF0064DFE6141FA78AE11B382BD610297903
@@ -0,0 +1,322 @@
+/**
+ * File: hexcodec.c
+ * ----------------
+ * Implements hexcodec.h's interface.
+ */
+
+#include "hexcodec.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HEXCODEC_X86
+#include <immintrin.h>
+#endif
+
+// loaded on every call, set by hexcodecSelect: accessed atomically
+static HexcodecKernel gKernel = HEXCODEC_AUTO;
+
+static const char gUpperDigits[] = "0123456789ABCDEF";
+static const char gLowerDigits[] = "0123456789abcdef";
+
+static int hexNibble(const unsigned char c) {
+  if (c >= '0' && c <= '9') return (c - '0');
+  if (c >= 'A' && c <= 'F') return (c - 'A' + 10);
+  if (c >= 'a' && c <= 'f') return (c - 'a' + 10);
+
+  return -1;
+}
+
+static void encodeScalar(char* hex, const unsigned char* bin, size_t binLen,
+                         HexCase hexCase) {
+  const char* digits = (hexCase == HEX_CASE_LOWER) ? gLowerDigits
+                                                    : gUpperDigits;
+  size_t i = 0;
+
+  for (i = 0; i < binLen; i++) {
+    hex[i * 2] = digits[bin[i] >> 4];
+    hex[i * 2 + 1] = digits[bin[i] & 0x0F];
+  }
+}
+
+static short decodeScalar(unsigned char* bin, const char* hex,
+                          size_t hexLen) {
+  size_t i = 0;
+
+  for (i = 0; i + 1 < hexLen; i += 2) {
+    int hi = hexNibble((unsigned char)hex[i]);
+    int lo = hexNibble((unsigned char)hex[i + 1]);
+
+    if ((hi | lo) < 0) return -1;
+    bin[i / 2] = (unsigned char)((hi << 4) | lo);
+  }
+
+  return 0;
+}
+
+#ifdef HEXCODEC_X86
+/*
+ * Nibbles become digits by adding '0', plus the gap to 'A' or 'a' if above 9.
+ * Digits become nibbles by subtracting '0' or 'a' (after folding case) and
+ * checking the result is in range; unsigned saturating subtraction does the
+ * range check.
+ */
+
+__attribute__((target("sse2"))) static __m128i nibblesToHexSse2(
+    __m128i nibbles, __m128i alphaGap) {
+  __m128i isAlpha = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+
+  return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+                      _mm_and_si128(isAlpha, alphaGap));
+}
+
+__attribute__((target("sse2"))) static size_t encodeSse2(
+    char* hex, const unsigned char* bin, size_t binLen, HexCase hexCase) {
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  const __m128i alphaGap = _mm_set1_epi8(
+      (hexCase == HEX_CASE_LOWER ? 'a' : 'A') - '0' - 10);
+  size_t i = 0;
+
+  for (i = 0; i + 16 <= binLen; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)&bin[i]);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    __m128i lo = _mm_and_si128(bytes, mask);
+
+    hi = nibblesToHexSse2(hi, alphaGap);
+    lo = nibblesToHexSse2(lo, alphaGap);
+    _mm_storeu_si128((__m128i*)&hex[i * 2], _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i*)&hex[i * 2 + 16], _mm_unpackhi_epi8(hi, lo));
+  }
+
+  return i;
+}
+
+__attribute__((target("sse2"))) static __m128i hexToNibblesSse2(
+    __m128i digits, __m128i* valid) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i number = _mm_sub_epi8(digits, _mm_set1_epi8('0'));
+  __m128i letter = _mm_sub_epi8(_mm_or_si128(digits, _mm_set1_epi8(0x20)),
+                                _mm_set1_epi8('a'));
+  __m128i isNumber =
+      _mm_cmpeq_epi8(_mm_subs_epu8(number, _mm_set1_epi8(9)), zero);
+  __m128i isLetter =
+      _mm_cmpeq_epi8(_mm_subs_epu8(letter, _mm_set1_epi8(5)), zero);
+
+  *valid = _mm_and_si128(*valid, _mm_or_si128(isNumber, isLetter));
+
+  return _mm_or_si128(
+      _mm_and_si128(isNumber, number),
+      _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+// 16 nibbles to 8 bytes, each in the low half of a 16-bit lane
+__attribute__((target("sse2"))) static __m128i joinNibblesSse2(
+    __m128i nibbles) {
+  __m128i hi =
+      _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+
+  return _mm_or_si128(hi, _mm_srli_epi16(nibbles, 8));
+}
+
+__attribute__((target("sse2"))) static long decodeSse2(unsigned char* bin,
+                                                       const char* hex,
+                                                       size_t hexLen) {
+  size_t i = 0;
+
+  for (i = 0; i + 32 <= hexLen; i += 32) {
+    __m128i valid = _mm_set1_epi8(-1);
+    __m128i first = hexToNibblesSse2(
+        _mm_loadu_si128((const __m128i*)&hex[i]), &valid);
+    __m128i second = hexToNibblesSse2(
+        _mm_loadu_si128((const __m128i*)&hex[i + 16]), &valid);
+
+    if (_mm_movemask_epi8(valid) != 0xFFFF) return -1;
+
+    _mm_storeu_si128(
+        (__m128i*)&bin[i / 2],
+        _mm_packus_epi16(joinNibblesSse2(first), joinNibblesSse2(second)));
+  }
+
+  return (long)i;
+}
+
+__attribute__((target("avx2"))) static __m256i nibblesToHexAvx2(
+    __m256i nibbles, __m256i alphaGap) {
+  __m256i isAlpha = _mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9));
+
+  return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')),
+                         _mm256_and_si256(isAlpha, alphaGap));
+}
+
+__attribute__((target("avx2"))) static size_t encodeAvx2(
+    char* hex, const unsigned char* bin, size_t binLen, HexCase hexCase) {
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+  const __m256i alphaGap = _mm256_set1_epi8(
+      (hexCase == HEX_CASE_LOWER ? 'a' : 'A') - '0' - 10);
+  size_t i = 0;
+
+  for (i = 0; i + 32 <= binLen; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)&bin[i]);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask);
+    __m256i lo = _mm256_and_si256(bytes, mask);
+    __m256i first, second;
+
+    hi = nibblesToHexAvx2(hi, alphaGap);
+    lo = nibblesToHexAvx2(lo, alphaGap);
+    // unpack works per 128-bit lane, put the lanes back in order
+    first = _mm256_unpacklo_epi8(hi, lo);
+    second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i*)&hex[i * 2],
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i*)&hex[i * 2 + 32],
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) static __m256i hexToNibblesAvx2(
+    __m256i digits, __m256i* valid) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i number = _mm256_sub_epi8(digits, _mm256_set1_epi8('0'));
+  __m256i letter = _mm256_sub_epi8(
+      _mm256_or_si256(digits, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  __m256i isNumber =
+      _mm256_cmpeq_epi8(_mm256_subs_epu8(number, _mm256_set1_epi8(9)), zero);
+  __m256i isLetter =
+      _mm256_cmpeq_epi8(_mm256_subs_epu8(letter, _mm256_set1_epi8(5)), zero);
+
+  *valid = _mm256_and_si256(*valid, _mm256_or_si256(isNumber, isLetter));
+
+  return _mm256_or_si256(
+      _mm256_and_si256(isNumber, number),
+      _mm256_and_si256(isLetter,
+                       _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2"))) static __m256i joinNibblesAvx2(
+    __m256i nibbles) {
+  __m256i hi = _mm256_slli_epi16(
+      _mm256_and_si256(nibbles, _mm256_set1_epi16(0x00FF)), 4);
+
+  return _mm256_or_si256(hi, _mm256_srli_epi16(nibbles, 8));
+}
+
+__attribute__((target("avx2"))) static long decodeAvx2(unsigned char* bin,
+                                                       const char* hex,
+                                                       size_t hexLen) {
+  size_t i = 0;
+
+  for (i = 0; i + 64 <= hexLen; i += 64) {
+    __m256i valid = _mm256_set1_epi8(-1);
+    __m256i first = hexToNibblesAvx2(
+        _mm256_loadu_si256((const __m256i*)&hex[i]), &valid);
+    __m256i second = hexToNibblesAvx2(
+        _mm256_loadu_si256((const __m256i*)&hex[i + 32]), &valid);
+    __m256i packed;
+
+    if (_mm256_movemask_epi8(valid) != -1) return -1;
+
+    // pack works per 128-bit lane, put the quarters back in order
+    packed =
+        _mm256_packus_epi16(joinNibblesAvx2(first), joinNibblesAvx2(second));
+    _mm256_storeu_si256((__m256i*)&bin[i / 2],
+                        _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+
+  return (long)i;
+}
+#endif
+
+static HexcodecKernel bestKernel(const HexcodecKernel wanted) {
+#ifdef HEXCODEC_X86
+  __builtin_cpu_init();
+
+  if ((wanted == HEXCODEC_AUTO || wanted == HEXCODEC_AVX2) &&
+      __builtin_cpu_supports("avx2")) {
+    return HEXCODEC_AVX2;
+  }
+  if (wanted != HEXCODEC_SCALAR && __builtin_cpu_supports("sse2")) {
+    return HEXCODEC_SSE2;
+  }
+#else
+  (void)wanted;
+#endif
+
+  return HEXCODEC_SCALAR;
+}
+
+static HexcodecKernel getKernel(void) {
+  HexcodecKernel kernel = __atomic_load_n(&gKernel, __ATOMIC_RELAXED);
+
+  // racing threads all store the same best kernel
+  if (kernel == HEXCODEC_AUTO) {
+    kernel = bestKernel(HEXCODEC_AUTO);
+    __atomic_store_n(&gKernel, kernel, __ATOMIC_RELAXED);
+  }
+
+  return kernel;
+}
+
+HexcodecKernel hexcodecSelect(HexcodecKernel kernel) {
+  kernel = bestKernel(kernel);
+  __atomic_store_n(&gKernel, kernel, __ATOMIC_RELAXED);
+  return kernel;
+}
+
+const char* hexcodecKernelName(HexcodecKernel kernel) {
+  switch (kernel) {
+    case HEXCODEC_SCALAR:
+      return "scalar";
+    case HEXCODEC_SSE2:
+      return "sse2";
+    case HEXCODEC_AVX2:
+      return "avx2";
+    default:
+      return "auto";
+  }
+}
+
+void hexEncode(char* hex, const unsigned char* bin, size_t binLen,
+               HexCase hexCase) {
+  size_t done = 0;
+
+#ifdef HEXCODEC_X86
+  HexcodecKernel kernel = getKernel();
+
+  if (kernel == HEXCODEC_AVX2) {
+    done = encodeAvx2(hex, bin, binLen, hexCase);
+  }
+  if (kernel != HEXCODEC_SCALAR) {
+    done += encodeSse2(&hex[done * 2], &bin[done], binLen - done, hexCase);
+  }
+#endif
+
+  encodeScalar(&hex[done * 2], &bin[done], binLen - done, hexCase);
+}
+
+long hexDecode(unsigned char* bin, const char* hex, size_t hexLen) {
+  size_t done = 0;
+
+  if (hexLen % 2) return -1;
+
+#ifdef HEXCODEC_X86
+  {
+    HexcodecKernel kernel = getKernel();
+    long status = 0;
+
+    if (kernel == HEXCODEC_AVX2) {
+      status = decodeAvx2(bin, hex, hexLen);
+      if (status < 0) return -1;
+      done = status;
+    }
+    if (kernel != HEXCODEC_SCALAR) {
+      status = decodeSse2(&bin[done / 2], &hex[done], hexLen - done);
+      if (status < 0) return -1;
+      done += status;
+    }
+  }
+#endif
+
+  if (decodeScalar(&bin[done / 2], &hex[done], hexLen - done) != 0) return -1;
+
+  return (long)(hexLen / 2);
+}
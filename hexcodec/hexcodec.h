@@ -0,0 +1,66 @@
+/**
+ * File: hexcodec.h
+ * ----------------
+ * Defines one interface for hex (a.k.a. ASCII <-> BCD) conversion. Uses
+ * AVX2 or SSE2 kernels when the CPU has them, a scalar loop otherwise.
+ */
+#ifndef _HEXCODEC_INCLUDED
+#define _HEXCODEC_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * @brief Case of the hex digits A-F written by hexEncode
+ *
+ */
+typedef enum {
+  HEX_CASE_UPPER,
+  HEX_CASE_LOWER,
+} HexCase;
+
+/**
+ * @brief Kernel used for conversions
+ *
+ */
+typedef enum {
+  HEXCODEC_AUTO,
+  HEXCODEC_SCALAR,
+  HEXCODEC_SSE2,
+  HEXCODEC_AVX2,
+} HexcodecKernel;
+
+/**
+ * @brief Write 2 * binLen hex digits of bin to hex, not NUL terminated
+ *
+ */
+void hexEncode(char* hex, const unsigned char* bin, size_t binLen,
+               HexCase hexCase);
+
+/**
+ * @brief Read hexLen hex digits from hex into hexLen / 2 bytes of bin. Both
+ * cases are accepted.
+ *
+ * @return long bytes written, -1 if hexLen is odd or a character isn't a hex
+ * digit, in which case bin's content is unspecified
+ */
+long hexDecode(unsigned char* bin, const char* hex, size_t hexLen);
+
+/**
+ * @brief Select the kernel, HEXCODEC_AUTO for the best one the CPU has. A
+ * kernel the CPU doesn't have falls back to the next best. Safe while other
+ * threads encode and decode, every kernel gives the same output.
+ *
+ * @return HexcodecKernel the kernel now in use
+ */
+HexcodecKernel hexcodecSelect(HexcodecKernel kernel);
+const char* hexcodecKernelName(HexcodecKernel kernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
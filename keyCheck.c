@@ -1,49 +1,29 @@
 #include "dbg.h"
 #include "des/des.h"
-
-static unsigned char atoh(const char c) {
-  if (c >= '0' && c <= '9') return (c - '0');
-  if (c >= 'A' && c <= 'F') return (c - 'A' + 10);
-  if (c >= 'a' && c <= 'f') return (c - 'a' + 10);
-
-  return 0;
-}
+#include "hexcodec/hexcodec.h"
 
 static short ascToBcd2(unsigned char* bcd, const short bcdLen,
                        const char* asc) {
-  int ascLen, i, j;
-
-  if (bcdLen == 0) {
-    ascLen = strlen(asc);
-  } else {
-    ascLen = (bcdLen) * 2;
+  if (hexDecode(bcd, asc, (size_t)bcdLen * 2) < 0) {
+    log_err("Error Converting to BCD");
     memset(bcd, 0x00, bcdLen);
+    return -1;
   }
 
-  for (i = 0, j = 0; j < ascLen; i++, j += 2) {
-    bcd[i] = (atoh(asc[2 * i]) << 4) | atoh(asc[2 * i + 1]);
-  }
-
-  return i;
+  return bcdLen;
 }
 
 static short bcdToAsc2(unsigned char* asc, const int ascLen,
                        const unsigned char* bcd, const int bcdLen) {
-  int i = 0;
-  short pos = 0;
-
-  if (bcdLen <= 0 || bcdLen * 2 > ascLen) {
+  if (bcdLen <= 0 || bcdLen * 2 >= ascLen) {
     log_err("Error Converting to ASCII");
     return -1;
   }
 
-  for (i = 0; i < bcdLen; i++) {
-    pos += sprintf((char*)&asc[pos], "%02X", bcd[i]);
-  }
-
-  asc[pos] = '\0';
+  hexEncode((char*)asc, bcd, bcdLen, HEX_CASE_UPPER);
+  asc[bcdLen * 2] = '\0';
 
-  return pos;
+  return bcdLen * 2;
 }
 
 static short checkKeyValue(const char* key, const char* kcv) {
@@ -8,33 +8,221 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../dbg.h"
 
+int comsIsFrameComplete(unsigned char* packet, const int bytesRead,
+                        const char* endTag) {
+  (void)endTag;
+
+  if (bytesRead < COMS_FRAME_HEADER_SIZE) return 0;
+
+  return ((packet[0] << 8) + packet[1]) + COMS_FRAME_HEADER_SIZE <= bytesRead;
+}
+
 #ifdef ITEX_OPENSSL
 #include <openssl/ssl.h>
 
-__attribute__((no_sanitize("undefined"))) static int resolveHost(
-    const char* hostname, char* ip) {
-  struct hostent* hent;
-  struct in_addr** addr_list;
-  int i;
-  if ((hent = gethostbyname(hostname)) == NULL) {
-    herror("gethostbyname error");
-    return 1;
-  }
-  addr_list = (struct in_addr**)hent->h_addr_list;
-  for (i = 0; addr_list[i] != NULL; i++) {
-    strcpy(ip, inet_ntoa(*addr_list[i]));
-    return 0;
+#include "comms_internals.h"
+
+static long monotonicMs(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * @brief Cached resolution of a host name
+ * @name: host name
+ * @resolved: its addresses
+ * @expiresAt: monotonic time after which it is looked up again
+ * @lastUsed: tick of the last store or lookup, the oldest entry is replaced
+ *
+ */
+struct DnsEntry {
+  char name[256];
+  ResolvedHost resolved;
+  long expiresAt;
+  unsigned long lastUsed;
+};
+
+static struct DnsEntry gDnsCache[COMS_DNS_CACHE_SIZE];
+static unsigned long gDnsTick = 0;
+static ComsDnsStats gDnsStats;
+static int gDnsCacheTtlMs = COMS_DNS_CACHE_TTL_MS;
+static pthread_mutex_t gDnsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Called with `gDnsLock` held. Returns the entry for `name`, or the least
+ * recently used one when `orOldest` is set.
+ */
+static struct DnsEntry* findDnsEntry(const char* name, short orOldest) {
+  struct DnsEntry* oldest = &gDnsCache[0];
+  int i = 0;
+
+  for (i = 0; i < COMS_DNS_CACHE_SIZE; i++) {
+    struct DnsEntry* entry = &gDnsCache[i];
+
+    if (entry->resolved.count &&
+        strncmp(entry->name, name, sizeof(entry->name)) == 0) {
+      return entry;
+    }
+    if (entry->lastUsed < oldest->lastUsed) oldest = entry;
   }
-  return 1;
+
+  return orOldest ? oldest : NULL;
+}
+
+static void addResolved(ResolvedHost* resolved, const struct addrinfo* info) {
+  memcpy(&resolved->addrs[resolved->count], info->ai_addr, info->ai_addrlen);
+  resolved->addrLens[resolved->count] = info->ai_addrlen;
+  resolved->count++;
+}
+
+/**
+ * Looks `name` up with getaddrinfo, keeping its order within each family but
+ * alternating families (RFC 8305), so a broken IPv6 or IPv4 path only delays
+ * the connect by one attempt.
+ */
+static int lookupHost(const char* name, ResolvedHost* resolved) {
+  struct addrinfo hints;
+  struct addrinfo* results = NULL;
+  const struct addrinfo* byFamily[2][COMS_DNS_MAX_ADDRS];
+  int counts[2] = {0, 0};
+  const struct addrinfo* info = NULL;
+  short family = 0;
+  int i = 0;
+  int ret = 0;
+
+  memset(&hints, '\0', sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  ret = getaddrinfo(name, NULL, &hints, &results);
+  if (ret != 0) {
+    log_err("getaddrinfo error for %s: %s", name, gai_strerror(ret));
+    return -1;
+  }
+
+  // [0] IPv4, [1] IPv6
+  for (info = results; info; info = info->ai_next) {
+    family = info->ai_family == AF_INET6;
+    if ((info->ai_family == AF_INET || family) &&
+        counts[family] < COMS_DNS_MAX_ADDRS) {
+      byFamily[family][counts[family]++] = info;
+    }
+  }
+
+  memset(resolved, '\0', sizeof(ResolvedHost));
+  family = results->ai_family == AF_INET6;
+  for (i = 0; resolved->count < COMS_DNS_MAX_ADDRS &&
+              (i < counts[0] || i < counts[1]);
+       i++) {
+    if (i < counts[family]) addResolved(resolved, byFamily[family][i]);
+    if (i < counts[!family] && resolved->count < COMS_DNS_MAX_ADDRS) {
+      addResolved(resolved, byFamily[!family][i]);
+    }
+  }
+  freeaddrinfo(results);
+
+  return resolved->count ? 0 : -1;
+}
+
+void comsPutDnsEntry(const char* name, const ResolvedHost* resolved) {
+  struct DnsEntry* entry = NULL;
+
+  pthread_mutex_lock(&gDnsLock);
+  entry = findDnsEntry(name, 1);
+  snprintf(entry->name, sizeof(entry->name), "%s", name);
+  memcpy(&entry->resolved, resolved, sizeof(ResolvedHost));
+  entry->expiresAt = monotonicMs() + gDnsCacheTtlMs;
+  entry->lastUsed = ++gDnsTick;
+  pthread_mutex_unlock(&gDnsLock);
+}
+
+/**
+ * Resolves `host` from the cache, looking it up when missing or expired.
+ * getaddrinfo doesn't report record TTLs, entries live the TTL set with
+ * `comsSetDnsCacheTtl`. Failed lookups aren't cached.
+ */
+static int resolveHost(const Host* host, ResolvedHost* resolved) {
+  struct DnsEntry* entry = NULL;
+  long now = monotonicMs();
+  short hit = 0;
+  int i = 0;
+
+  pthread_mutex_lock(&gDnsLock);
+  entry = findDnsEntry(host->url, 0);
+  hit = entry && entry->expiresAt > now;
+  if (hit) {
+    memcpy(resolved, &entry->resolved, sizeof(ResolvedHost));
+    entry->lastUsed = ++gDnsTick;
+    gDnsStats.hits++;
+  } else {
+    gDnsStats.lookups++;
+  }
+  pthread_mutex_unlock(&gDnsLock);
+
+  if (!hit) {
+    if (lookupHost(host->url, resolved) != 0) return -1;
+    comsPutDnsEntry(host->url, resolved);
+  }
+
+  for (i = 0; i < resolved->count; i++) {
+    struct sockaddr_storage* addr = &resolved->addrs[i];
+
+    if (addr->ss_family == AF_INET6) {
+      ((struct sockaddr_in6*)addr)->sin6_port = htons(host->port);
+    } else {
+      ((struct sockaddr_in*)addr)->sin_port = htons(host->port);
+    }
+  }
+
+  return 0;
+}
+
+void comsClearDnsCache(void) {
+  pthread_mutex_lock(&gDnsLock);
+  memset(gDnsCache, '\0', sizeof(gDnsCache));
+  pthread_mutex_unlock(&gDnsLock);
+}
+
+void comsSetDnsCacheTtl(int ttlMs) {
+  pthread_mutex_lock(&gDnsLock);
+  gDnsCacheTtlMs = ttlMs;
+  pthread_mutex_unlock(&gDnsLock);
+}
+
+void comsGetDnsStats(ComsDnsStats* stats) {
+  pthread_mutex_lock(&gDnsLock);
+  memcpy(stats, &gDnsStats, sizeof(ComsDnsStats));
+  pthread_mutex_unlock(&gDnsLock);
+}
+
+void comsResetDnsStats(void) {
+  pthread_mutex_lock(&gDnsLock);
+  memset(&gDnsStats, '\0', sizeof(ComsDnsStats));
+  pthread_mutex_unlock(&gDnsLock);
+}
+
+/**
+ * Resolve a host into the DNS cache ahead of its exchanges, so they don't
+ * block on the lookup.
+ */
+int comsResolveHost(const Host* host) {
+  ResolvedHost resolved;
+
+  return resolveHost(host, &resolved);
 }
 
 static void showSslCerts(SSL* ssl) {
@@ -56,165 +244,1014 @@ static void showSslCerts(SSL* ssl) {
   }
 }
 
+/**
+ * @brief Cached TLS session of a host
+ * @host: host the session was negotiated with
+ * @session: session to offer on the next connect
+ * @lastUsed: tick of the last store or lookup, the oldest entry is replaced
+ *
+ */
+struct TlsSessionEntry {
+  Host host;
+  SSL_SESSION* session;
+  unsigned long lastUsed;
+};
+
+static struct TlsSessionEntry gTlsSessions[COMS_TLS_SESSION_CACHE_SIZE];
+static unsigned long gTlsSessionTick = 0;
+static ComsTlsStats gTlsStats;
+// read on every TLS handshake, set from any thread: accessed atomically
+static short gTlsTicketsDisabled = 0;
+static pthread_mutex_t gTlsSessionLock = PTHREAD_MUTEX_INITIALIZER;
+static int gHostIndex = -1;
+
+static short isSameHost(const Host* a, const Host* b) {
+  return a->port == b->port && a->connectionType == b->connectionType &&
+         strncmp(a->url, b->url, sizeof(a->url)) == 0;
+}
+
+/**
+ * Called with `gTlsSessionLock` held. Returns the entry for `host`, or the
+ * least recently used one when `orOldest` is set.
+ */
+static struct TlsSessionEntry* findTlsSession(const Host* host,
+                                              short orOldest) {
+  struct TlsSessionEntry* oldest = &gTlsSessions[0];
+  int i = 0;
+
+  for (i = 0; i < COMS_TLS_SESSION_CACHE_SIZE; i++) {
+    struct TlsSessionEntry* entry = &gTlsSessions[i];
+
+    if (entry->session && isSameHost(&entry->host, host)) return entry;
+    if (entry->lastUsed < oldest->lastUsed) oldest = entry;
+  }
+
+  return orOldest ? oldest : NULL;
+}
+
+/**
+ * Returns a reference the caller must free, NULL if no resumable session is
+ * cached for `host`.
+ */
+static SSL_SESSION* getTlsSession(const Host* host) {
+  SSL_SESSION* session = NULL;
+  struct TlsSessionEntry* entry = NULL;
+
+  pthread_mutex_lock(&gTlsSessionLock);
+  entry = findTlsSession(host, 0);
+  if (entry && SSL_SESSION_is_resumable(entry->session)) {
+    session = entry->session;
+    SSL_SESSION_up_ref(session);
+    entry->lastUsed = ++gTlsSessionTick;
+  }
+  pthread_mutex_unlock(&gTlsSessionLock);
+
+  return session;
+}
+
+/**
+ * Takes ownership of `session`, NULL drops the host's cached session.
+ */
+static void putTlsSession(const Host* host, SSL_SESSION* session) {
+  SSL_SESSION* replaced = NULL;
+  struct TlsSessionEntry* entry = NULL;
+
+  pthread_mutex_lock(&gTlsSessionLock);
+  entry = findTlsSession(host, session != NULL);
+  if (entry) {
+    replaced = entry->session;
+    memcpy(&entry->host, host, sizeof(Host));
+    entry->session = session;
+    entry->lastUsed = ++gTlsSessionTick;
+  }
+  pthread_mutex_unlock(&gTlsSessionLock);
+
+  if (replaced) SSL_SESSION_free(replaced);
+}
+
+static void countTlsHandshake(SSL* ssl) {
+  pthread_mutex_lock(&gTlsSessionLock);
+  if (SSL_session_reused(ssl)) {
+    gTlsStats.resumedHandshakes++;
+  } else {
+    gTlsStats.fullHandshakes++;
+  }
+  pthread_mutex_unlock(&gTlsSessionLock);
+}
+
+/**
+ * New session callback. TLS 1.2 sessions arrive at the end of the handshake,
+ * TLS 1.3 tickets after it, with the first read.
+ */
+static int onNewTlsSession(SSL* ssl, SSL_SESSION* session) {
+  const Host* host = (const Host*)SSL_get_ex_data(ssl, gHostIndex);
+
+  if (host == NULL) return 0;
+  // a TLS 1.3 session is always a ticket, SSL_OP_NO_TICKET only covers 1.2
+  if (__atomic_load_n(&gTlsTicketsDisabled, __ATOMIC_RELAXED) &&
+      SSL_version(ssl) >= TLS1_3_VERSION) {
+    return 0;
+  }
+
+  putTlsSession(host, session);
+  return 1;
+}
+
+void comsSetTlsSessionTickets(short enable) {
+  __atomic_store_n(&gTlsTicketsDisabled, !enable, __ATOMIC_RELAXED);
+}
+
+void comsClearTlsSessions(void) {
+  int i = 0;
+
+  pthread_mutex_lock(&gTlsSessionLock);
+  for (i = 0; i < COMS_TLS_SESSION_CACHE_SIZE; i++) {
+    if (gTlsSessions[i].session) SSL_SESSION_free(gTlsSessions[i].session);
+  }
+  memset(gTlsSessions, '\0', sizeof(gTlsSessions));
+  pthread_mutex_unlock(&gTlsSessionLock);
+}
+
+void comsGetTlsStats(ComsTlsStats* stats) {
+  pthread_mutex_lock(&gTlsSessionLock);
+  memcpy(stats, &gTlsStats, sizeof(ComsTlsStats));
+  pthread_mutex_unlock(&gTlsSessionLock);
+}
+
+void comsResetTlsStats(void) {
+  pthread_mutex_lock(&gTlsSessionLock);
+  memset(&gTlsStats, '\0', sizeof(ComsTlsStats));
+  pthread_mutex_unlock(&gTlsSessionLock);
+}
+
+static SSL_CTX* gServerContext = NULL;
+static pthread_once_t gServerContextOnce = PTHREAD_ONCE_INIT;
+
+static void initMiddlewareContext(void) {
+  gServerContext = SSL_CTX_new(SSLv23_client_method());
+  if (gServerContext == NULL) return;
+
+  // sessions are kept in gTlsSessions per Host, not in OpenSSL's cache
+  gHostIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+  SSL_CTX_set_session_cache_mode(
+      gServerContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(gServerContext, onNewTlsSession);
+}
+
 static SSL_CTX* middlewareContext(void) {
-  static SSL_CTX* serverContext = NULL;
-  if (!serverContext) {
-    serverContext = SSL_CTX_new(SSLv23_client_method());
+  pthread_once(&gServerContextOnce, initMiddlewareContext);
+  return gServerContext;
+}
+
+struct ComsSession {
+  Host host;
+  int sockfd;
+  SSL* ssl;
+  int exchanges;
+};
+
+static void initComsSession(ComsSession* session, const Host* host) {
+  memset(session, '\0', sizeof(ComsSession));
+  memcpy(&session->host, host, sizeof(Host));
+  session->sockfd = -1;
+}
+
+static void closeConnection(ComsSession* session) {
+  if (session->ssl) {
+    SSL_shutdown(session->ssl);
+    SSL_free(session->ssl);
+    session->ssl = NULL;
   }
-  return serverContext;
+  if (session->sockfd >= 0) {
+    close(session->sockfd);
+    session->sockfd = -1;
+  }
+  session->exchanges = 0;
 }
 
-static int sslRead(SSL* sslHandle, unsigned char* buffer, int readSize,
-                   const ComSentinel recevSentinel, const char* endTag) {
-  int totalReceived = 0;
-  fd_set fds;
-  struct timeval timeout;
+/**
+ * Creates the SSL of `session` on its socket and offers the host's cached TLS
+ * session. Returns 1 if a cached session was offered, 0 if not, -1 on error.
+ */
+static int newTlsConnection(ComsSession* session) {
+  SSL_SESSION* cachedSession = NULL;
 
-  if (!sslHandle) {
+  session->ssl = SSL_new(middlewareContext());
+  if (session->ssl == NULL) {
+    return -1;
+  }
+
+  SSL_set_fd(session->ssl, session->sockfd);
+  SSL_set_ex_data(session->ssl, gHostIndex, &session->host);
+  if (__atomic_load_n(&gTlsTicketsDisabled, __ATOMIC_RELAXED)) {
+    SSL_set_options(session->ssl, SSL_OP_NO_TICKET);
+  }
+
+  cachedSession = getTlsSession(&session->host);
+  if (cachedSession) {
+    SSL_set_session(session->ssl, cachedSession);
+    SSL_SESSION_free(cachedSession);
+  }
+
+  return cachedSession != NULL;
+}
+
+static long deadlineAfter(int timeoutms) {
+  return monotonicMs() + (timeoutms > 0 ? timeoutms : DEFAULT_TIMEOUT);
+}
+
+/**
+ * Waits until `fd` has `events` or `deadline` passes. Returns 1 when ready,
+ * 0 on timeout, -1 on error.
+ */
+static int waitFd(int fd, short events, long deadline) {
+  struct pollfd pfd;
+  long remaining = 0;
+  int ret = 0;
+
+  while ((remaining = deadline - monotonicMs()) > 0) {
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    ret = poll(&pfd, 1, (int)remaining);
+    if (ret > 0) return 1;
+    if (ret < 0 && errno != EINTR) return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Starts connecting a non-blocking socket to `addr`, the connect is complete
+ * once the socket is writable. Returns the socket, -1 on error.
+ */
+static int startConnect(const struct sockaddr_storage* addr,
+                        socklen_t addrLen) {
+  int sockfd = socket(addr->ss_family, SOCK_STREAM, 0);
+  int flags = 0;
+
+  if (sockfd < 0) {
+    log_err(" Error : Could not create socket ");
+    return -1;
+  }
+
+  flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags < 0 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      (connect(sockfd, (const struct sockaddr*)addr, addrLen) < 0 &&
+       errno != EINPROGRESS)) {
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
+static short isConnected(int sockfd) {
+  int err = 0;
+  socklen_t errLen = sizeof(err);
+
+  if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0) {
     return 0;
   }
-  int count = 0;
-  while (count++ < 6) {
-    int received =
-        SSL_read(sslHandle, &buffer[totalReceived], readSize - totalReceived);
-    if (received > 0) {
-      totalReceived += received;
-      if (recevSentinel && recevSentinel(buffer, totalReceived, endTag)) {
-        break;
+
+  return err == 0;
+}
+
+/**
+ * Happy eyeballs (RFC 8305): connects to the resolved addresses in order,
+ * starting the next one every `COMS_CONNECT_STAGGER_MS` or as soon as one
+ * fails, and keeps the first to connect.
+ */
+static short raceConnect(ComsSession* session, const ResolvedHost* resolved,
+                         long deadline) {
+  struct pollfd pending[COMS_DNS_MAX_ADDRS];
+  int pendingCount = 0;
+  int next = 0;
+  long nextStartAt = 0;
+  int i = 0;
+
+  while (session->sockfd < 0) {
+    long now = monotonicMs();
+    long wait = deadline - now;
+
+    if (next < resolved->count && (pendingCount == 0 || now >= nextStartAt)) {
+      int sockfd =
+          startConnect(&resolved->addrs[next], resolved->addrLens[next]);
+
+      next++;
+      if (sockfd >= 0) {
+        pending[pendingCount].fd = sockfd;
+        pending[pendingCount].events = POLLOUT;
+        pending[pendingCount].revents = 0;
+        pendingCount++;
+        nextStartAt = now + COMS_CONNECT_STAGGER_MS;
       }
+      continue;
     }
 
-    int err = SSL_get_error(sslHandle, received);
-    switch (err) {
-      case SSL_ERROR_NONE: {
-        // no real error, just try again...
-        debug("SSL_ERROR_NONE %i", count);
-        continue;
-      }
+    if (pendingCount == 0 || wait <= 0) break;
+    if (next < resolved->count && nextStartAt - now < wait) {
+      wait = nextStartAt - now;
+    }
+
+    if (poll(pending, pendingCount, (int)wait) < 0 && errno != EINTR) break;
 
-      case SSL_ERROR_ZERO_RETURN: {
-        // peer disconnected...
-        debug("SSL_ERROR_ZERO_RETURN %i", count);
-        break;
+    for (i = pendingCount - 1; i >= 0; i--) {
+      if (!pending[i].revents) continue;
+
+      if (session->sockfd < 0 && isConnected(pending[i].fd)) {
+        session->sockfd = pending[i].fd;
+      } else {
+        close(pending[i].fd);
+        nextStartAt = now;
       }
+      pending[i] = pending[--pendingCount];
+    }
+  }
 
-      case SSL_ERROR_WANT_READ: {
-        // no data available right now, wait a few seconds in case
-        // new data arrives...
-        log_err("SSL_ERROR_WANT_READ %i", count);
+  for (i = 0; i < pendingCount; i++) {
+    close(pending[i].fd);
+  }
 
-        int sock = SSL_get_rfd(sslHandle);
-        FD_ZERO(&fds);
-        FD_SET(sock, &fds);
+  return session->sockfd >= 0 ? 0 : -1;
+}
 
-        timeout.tv_sec = 10;
-        timeout.tv_usec = 0;
+/**
+ * Waits for `ret` of an SSL call that would block, returns 1 to retry it
+ */
+static int waitSsl(ComsSession* session, int ret, long deadline) {
+  switch (SSL_get_error(session->ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+      return waitFd(session->sockfd, POLLIN, deadline) > 0;
+    case SSL_ERROR_WANT_WRITE:
+      return waitFd(session->sockfd, POLLOUT, deadline) > 0;
+    default:
+      return 0;
+  }
+}
 
-        err = select(sock + 1, &fds, NULL, NULL, &timeout);
-        if (err > 0) continue;  // more data to read...
+static short openConnection(ComsSession* session, long deadline) {
+  Host* host = &session->host;
+  ResolvedHost resolved;
+  int offeredTlsSession = 0;
+  int ret = 0;
 
-        if (err == 0) {
-          // timeout...
-        } else {
-          // error...
+  if (resolveHost(host, &resolved) != 0) {
+    log_err("Unable to resolve %s", host->url);
+    return -1;
+  }
+
+  if (raceConnect(session, &resolved, deadline) != 0) {
+    log_err(" Error : Connect Failed ");
+    return -1;
+  }
+
+  if (host->connectionType == CONNECTION_TYPE_SSL) {
+    offeredTlsSession = newTlsConnection(session);
+    if (offeredTlsSession < 0) {
+      goto clean_exit;
+    }
+
+    while ((ret = SSL_connect(session->ssl)) != 1) {
+      if (waitSsl(session, ret, deadline)) continue;
+
+      log_err("SSl conn.");
+      // don't offer a session the host may have choked on again
+      if (offeredTlsSession) putTlsSession(host, NULL);
+      goto clean_exit;
+    }
+    countTlsHandshake(session->ssl);
+    showSslCerts(session->ssl);
+  }
+
+  return 0;
+
+clean_exit:
+  closeConnection(session);
+  return -1;
+}
+
+/**
+ * A kept-alive connection that has data pending or has hit EOF before we
+ * sent anything was closed (or poisoned) by the host while it sat idle.
+ */
+static short isConnectionStale(const ComsSession* session) {
+  struct pollfd pfd;
+
+  if (session->ssl && SSL_pending(session->ssl) > 0) return 1;
+
+  pfd.fd = session->sockfd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  return poll(&pfd, 1, 0) != 0;
+}
+
+static int sendAll(ComsSession* session, const unsigned char* data,
+                   size_t len, long deadline) {
+  size_t written = 0;
+  int n = 0;
+
+  while (written < len) {
+    if (session->ssl) {
+      n = SSL_write(session->ssl, &data[written], len - written);
+      if (n <= 0) {
+        if (waitSsl(session, n, deadline)) continue;
+        return -1;
+      }
+    } else {
+      n = send(session->sockfd, &data[written], len - written, MSG_NOSIGNAL);
+      if (n < 0) {
+        if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) &&
+            waitFd(session->sockfd, POLLOUT, deadline) > 0) {
+          continue;
         }
+        return -1;
+      }
+    }
+    written += n;
+  }
+
+  return (int)written;
+}
+
+/**
+ * Reads what is available, waiting up to `deadline` for something to be.
+ * Returns the bytes read, 0 if the host closed the connection, -1 on error or
+ * timeout.
+ */
+static int receiveSome(ComsSession* session, unsigned char* buffer, int size,
+                       long deadline) {
+  int n = 0;
 
-        break;
+  while (1) {
+    if (session->ssl) {
+      n = SSL_read(session->ssl, buffer, size);
+      if (n > 0) return n;
+      if (SSL_get_error(session->ssl, n) == SSL_ERROR_ZERO_RETURN) return 0;
+      if (waitSsl(session, n, deadline)) continue;
+    } else {
+      n = recv(session->sockfd, buffer, size, 0);
+      if (n >= 0) return n;
+      if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) &&
+          waitFd(session->sockfd, POLLIN, deadline) > 0) {
+        continue;
       }
+    }
+
+    if (monotonicMs() >= deadline) log_err("Receive timed out");
+    return -1;
+  }
+}
 
-      default: {
-        log_err("error %i:%i", received, err);
-        break;
+/**
+ * Reads a response until `recevSentinel` says it is complete or the host
+ * closes the connection, -1 if `deadline` passes first. A
+ * `comsIsFrameComplete` frame is read as its header then exactly its body, so
+ * it returns on the last byte and never reads into a next message; an
+ * incomplete frame is an error. With no sentinel the response is everything
+ * read until the host closes the connection or the buffer is full.
+ */
+static int receive(ComsSession* session, unsigned char* buffer, int size,
+                   long deadline, const ComSentinel recevSentinel,
+                   const char* endTag) {
+  const short framed = recevSentinel == comsIsFrameComplete;
+  int received = 0;
+  int wanted = size;
+  int n = 0;
+
+  while (received < size) {
+    if (framed) {
+      wanted = COMS_FRAME_HEADER_SIZE;
+      if (received >= COMS_FRAME_HEADER_SIZE) {
+        wanted += (buffer[0] << 8) + buffer[1];
+      }
+      if (wanted > size) {
+        log_err("Frame of %d bytes is larger than the buffer", wanted);
+        return -1;
       }
     }
 
-    break;
+    n = receiveSome(session, &buffer[received], wanted - received, deadline);
+    if (n < 0) return -1;
+    if (n == 0) break;
+
+    received += n;
+    if (recevSentinel && recevSentinel(buffer, received, endTag)) {
+      return received;
+    }
   }
 
-  return totalReceived;
+  return framed ? -1 : received;
+}
+
+static int exchange(ComsSession* session, NetworkBuffer* response,
+                    NetworkBuffer* request, long deadline,
+                    const ComSentinel recevSentinel, const char* endTag) {
+  int n = 0;
+
+  n = sendAll(session, request->data, request->len, deadline);
+  if (n != request->len) {
+    return -1;
+  }
+
+  n = receive(session, response->data, sizeof(response->data) - 1, deadline,
+              recevSentinel, endTag);
+  if (n <= 0) return 0;
+
+  response->data[n] = '\0';
+  return n;
+}
+
+ComsSession* comsSessionCreate(const Host* host) {
+  ComsSession* session = (ComsSession*)malloc(sizeof(ComsSession));
+
+  if (session == NULL) {
+    log_err("Out of memory.");
+    return NULL;
+  }
+  initComsSession(session, host);
+
+  return session;
+}
+
+void comsSessionDestroy(ComsSession* session) {
+  if (session == NULL) return;
+
+  closeConnection(session);
+  free(session);
+}
+
+const Host* comsSessionHost(const ComsSession* session) {
+  return &session->host;
+}
+
+short comsSessionIsOpen(const ComsSession* session) {
+  return session->sockfd >= 0;
+}
+
+short comsSessionIsFor(const ComsSession* session, const Host* host) {
+  return session && session->host.port == host->port &&
+         session->host.connectionType == host->connectionType &&
+         strncmp(session->host.url, host->url, sizeof(host->url)) == 0;
+}
+
+int comsSessionSendReceive(ComsSession* session, NetworkBuffer* response,
+                           NetworkBuffer* request, int receiveTimeoutms,
+                           const ComSentinel recevSentinel,
+                           const char* endTag) {
+  const long deadline = deadlineAfter(receiveTimeoutms);
+  int n = 0;
+  long responseLen = response->len;
+
+  if (recevSentinel == NULL) {
+    log_err("No sentinel to end a response on a kept-alive connection");
+    return 0;
+  }
+
+  if (session->sockfd >= 0 && isConnectionStale(session)) {
+    debug("Kept-alive connection to %s:%d went stale, reconnecting",
+          session->host.url, session->host.port);
+    closeConnection(session);
+  }
+
+  if (session->sockfd < 0 && openConnection(session, deadline) != 0) {
+    return 0;
+  }
+
+  n = exchange(session, response, request, deadline, recevSentinel, endTag);
+  if (n <= 0 && session->exchanges > 0) {
+    // host closed the kept-alive connection between requests, retry once
+    debug("Kept-alive connection to %s:%d was closed, reconnecting",
+          session->host.url, session->host.port);
+    closeConnection(session);
+    response->len = responseLen;
+    if (openConnection(session, deadline) != 0) {
+      return 0;
+    }
+    n = exchange(session, response, request, deadline, recevSentinel, endTag);
+  }
+
+  if (n <= 0) {
+    closeConnection(session);
+    return 0;
+  }
+
+  session->exchanges++;
+  return n;
 }
 
 int comSendReceive(NetworkBuffer* response, NetworkBuffer* request, Host* host,
                    int receiveTimeoutms, const ComSentinel recevSentinel,
                    const char* endTag) {
-  int sockfd = 0, n = 0;
-  struct timeval timeout;
-  struct sockaddr_in serv_addr;
-  short ret = -1;
-  char resolvedIp[32] = {'\0'};
-
-  SSL* ssl;
+  ComsPool* pool = comsGetDefaultPool();
+  ComsSession session;
+  long deadline = 0;
+  int ret = 0;
 
-  timeout.tv_sec = 30;
-  timeout.tv_usec = 0;
+  // a response with no sentinel ends when the host closes, nothing to pool
+  if (pool && recevSentinel) {
+    return comsPoolSendReceive(pool, response, request, host,
+                               receiveTimeoutms, recevSentinel, endTag);
+  }
 
-  if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-    log_err(" Error : Could not create socket ");
+  deadline = deadlineAfter(receiveTimeoutms);
+  initComsSession(&session, host);
+  if (openConnection(&session, deadline) != 0) {
     return -1;
   }
 
-  memset(&serv_addr, '0', sizeof(serv_addr));
+  ret = exchange(&session, response, request, deadline, recevSentinel, endTag);
+  closeConnection(&session);
+
+  return ret;
+}
+
+typedef enum {
+  ASYNC_STATE_IDLE,
+  ASYNC_STATE_CONNECTING,
+  ASYNC_STATE_TLS_HANDSHAKE,
+  ASYNC_STATE_WRITING,
+  ASYNC_STATE_READING,
+  ASYNC_STATE_DONE,
+  ASYNC_STATE_FAILED,
+} ComsAsyncState;
+
+#define COMS_ASYNC_MAX_RESPONSE (sizeof(((NetworkBuffer*)0)->data) - 1)
 
-  serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons(host->port);
+struct ComsAsync {
+  ComsSession session;
+  ComsAsyncState state;
+  int wanted;
+  short reused;
+  short offeredTlsSession;
+  unsigned char* request;
+  size_t requestLen;
+  size_t written;
+  unsigned char* response;
+  size_t responseLen;
+  size_t responseCap;
+  ComSentinel recevSentinel;
+  const char* endTag;
+  ResolvedHost resolved;
+  int nextAddress;
+};
 
-  resolveHost(host->url, resolvedIp);
-  if (inet_pton(AF_INET, resolvedIp, &serv_addr.sin_addr) <= 0) {
-    log_err(" inet_pton error occured");
-    goto clean_exit;
+static ComsAsyncStatus asyncFailed(ComsAsync* async) {
+  closeConnection(&async->session);
+  async->state = ASYNC_STATE_FAILED;
+  async->wanted = COMS_EVENT_NONE;
+  return COMS_ASYNC_FAILED;
+}
+
+static ComsAsyncStatus asyncWait(ComsAsync* async, int events) {
+  async->wanted = events;
+  return COMS_ASYNC_PENDING;
+}
+
+/**
+ * Connects to the next resolved address. Addresses are tried one after the
+ * other, a single fd can't race them.
+ */
+static short asyncConnectNext(ComsAsync* async) {
+  ResolvedHost* resolved = &async->resolved;
+  int i = 0;
+
+  closeConnection(&async->session);
+  while ((i = async->nextAddress) < resolved->count) {
+    async->nextAddress++;
+    async->session.sockfd =
+        startConnect(&resolved->addrs[i], resolved->addrLens[i]);
+    if (async->session.sockfd >= 0) {
+      async->state = ASYNC_STATE_CONNECTING;
+      return 0;
+    }
   }
 
-  if (connect(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
-    log_err(" Error : Connect Failed ");
-    goto clean_exit;
+  log_err(" Error : Connect Failed ");
+  return -1;
+}
+
+static short asyncConnect(ComsAsync* async) {
+  if (resolveHost(&async->session.host, &async->resolved) != 0) {
+    log_err("Unable to resolve %s", async->session.host.url);
+    return -1;
+  }
+  async->nextAddress = 0;
+
+  return asyncConnectNext(async);
+}
+
+/**
+ * A kept-alive connection the host closed while idle fails on first use,
+ * reconnect once before giving up on the exchange.
+ */
+static short asyncReconnect(ComsAsync* async) {
+  if (!async->reused) return -1;
+
+  debug("Kept-alive connection to %s:%d was closed, reconnecting",
+        async->session.host.url, async->session.host.port);
+  async->reused = 0;
+  async->written = 0;
+  async->responseLen = 0;
+  closeConnection(&async->session);
+
+  return asyncConnect(async);
+}
+
+static short growResponse(ComsAsync* async) {
+  size_t cap = async->responseCap ? async->responseCap * 2 : 0x400;
+  unsigned char* response = NULL;
+
+  if (cap > COMS_ASYNC_MAX_RESPONSE) cap = COMS_ASYNC_MAX_RESPONSE;
+
+  // one more byte keeps the response NUL terminated for string sentinels
+  response = (unsigned char*)realloc(async->response, cap + 1);
+  if (response == NULL) {
+    log_err("Out of memory.");
+    return -1;
   }
+  async->response = response;
+  async->responseCap = cap;
 
-  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout,
-                 sizeof(timeout)) < 0) {
-    log_err(" Error : Set Recv Timeout Failed ");
+  return 0;
+}
+
+ComsAsync* comsAsyncCreate(void) {
+  ComsAsync* async = (ComsAsync*)calloc(1, sizeof(ComsAsync));
+
+  if (async == NULL) {
+    log_err("Out of memory.");
+    return NULL;
   }
+  async->session.sockfd = -1;
 
-  if (host->connectionType == CONNECTION_TYPE_SSL) {
-    ssl = SSL_new(middlewareContext());
-    if (ssl == NULL) {
-      goto clean_exit;
-    }
+  return async;
+}
 
-    SSL_set_fd(ssl, sockfd);
-    if (SSL_connect(ssl) <= 0) {
-      log_err("SSl conn.");
-      goto clean_ssl;
-    }
-    showSslCerts(ssl);
+void comsAsyncDestroy(ComsAsync* async) {
+  if (async == NULL) return;
 
-    n = SSL_write(ssl, request->data, request->len);
-    if ((size_t)n != request->len) {
-      goto clean_ssl;
-    }
+  closeConnection(&async->session);
+  free(async->request);
+  free(async->response);
+  free(async);
+}
 
-    n = sslRead(ssl, response->data, sizeof(response->data) - 1, recevSentinel,
-                endTag);
-  } else if (host->connectionType == CONNECTION_TYPE_PLAIN) {
-    n = write(sockfd, request, request->len);
-    if ((size_t)n != request->len) {
-      goto clean_exit;
-    }
+ComsAsyncStatus comsAsyncStart(ComsAsync* async, const Host* host,
+                               const NetworkBuffer* request,
+                               const ComSentinel recevSentinel,
+                               const char* endTag) {
+  unsigned char* buffer = NULL;
+
+  if (request->len <= 0) return asyncFailed(async);
 
-    n = read(sockfd, response->data, response->len - 1);
+  buffer = (unsigned char*)realloc(async->request, request->len);
+  if (buffer == NULL) {
+    log_err("Out of memory.");
+    return asyncFailed(async);
   }
+  memcpy(buffer, request->data, request->len);
+  async->request = buffer;
+  async->requestLen = request->len;
+  async->written = 0;
+  async->responseLen = 0;
+  async->recevSentinel = recevSentinel;
+  async->endTag = endTag;
 
-  ret = n > 0 ? n : 0;
+  if (async->state == ASYNC_STATE_DONE && async->session.sockfd >= 0 &&
+      isSameHost(&async->session.host, host) &&
+      !isConnectionStale(&async->session)) {
+    async->reused = 1;
+    async->state = ASYNC_STATE_WRITING;
+  } else {
+    closeConnection(&async->session);
+    initComsSession(&async->session, host);
+    async->reused = 0;
+    if (asyncConnect(async) != 0) return asyncFailed(async);
+  }
 
-clean_ssl:
-  if (host->connectionType == CONNECTION_TYPE_SSL) {
-    SSL_shutdown(ssl);
-    SSL_free(ssl);
+  return comsAsyncProgress(async);
+}
+
+ComsAsyncStatus comsAsyncProgress(ComsAsync* async) {
+  ComsSession* session = &async->session;
+
+  while (1) {
+    switch (async->state) {
+      case ASYNC_STATE_CONNECTING: {
+        struct pollfd pfd = {session->sockfd, POLLOUT, 0};
+
+        if (poll(&pfd, 1, 0) == 0) return asyncWait(async, COMS_EVENT_WRITE);
+
+        if (!isConnected(session->sockfd)) {
+          if (asyncConnectNext(async) == 0) continue;
+          return asyncFailed(async);
+        }
+
+        if (session->host.connectionType == CONNECTION_TYPE_SSL) {
+          async->offeredTlsSession = newTlsConnection(session);
+          if (async->offeredTlsSession < 0) return asyncFailed(async);
+          async->state = ASYNC_STATE_TLS_HANDSHAKE;
+        } else {
+          async->state = ASYNC_STATE_WRITING;
+        }
+        continue;
+      }
+
+      case ASYNC_STATE_TLS_HANDSHAKE: {
+        int ret = SSL_connect(session->ssl);
+
+        if (ret == 1) {
+          countTlsHandshake(session->ssl);
+          showSslCerts(session->ssl);
+          async->state = ASYNC_STATE_WRITING;
+          continue;
+        }
+
+        switch (SSL_get_error(session->ssl, ret)) {
+          case SSL_ERROR_WANT_READ:
+            return asyncWait(async, COMS_EVENT_READ);
+          case SSL_ERROR_WANT_WRITE:
+            return asyncWait(async, COMS_EVENT_WRITE);
+          default:
+            log_err("SSl conn.");
+            if (async->offeredTlsSession) putTlsSession(&session->host, NULL);
+            return asyncFailed(async);
+        }
+      }
+
+      case ASYNC_STATE_WRITING: {
+        const unsigned char* data = &async->request[async->written];
+        int len = async->requestLen - async->written;
+        int ret = 0;
+
+        if (session->ssl) {
+          ret = SSL_write(session->ssl, data, len);
+          if (ret <= 0) {
+            switch (SSL_get_error(session->ssl, ret)) {
+              case SSL_ERROR_WANT_READ:
+                return asyncWait(async, COMS_EVENT_READ);
+              case SSL_ERROR_WANT_WRITE:
+                return asyncWait(async, COMS_EVENT_WRITE);
+              default:
+                if (asyncReconnect(async) == 0) continue;
+                return asyncFailed(async);
+            }
+          }
+        } else {
+          ret = send(session->sockfd, data, len, MSG_NOSIGNAL);
+          if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+              return asyncWait(async, COMS_EVENT_WRITE);
+            }
+            if (asyncReconnect(async) == 0) continue;
+            return asyncFailed(async);
+          }
+        }
+
+        async->written += ret;
+        if (async->written == async->requestLen) {
+          async->state = ASYNC_STATE_READING;
+        }
+        continue;
+      }
+
+      case ASYNC_STATE_READING: {
+        int ret = 0;
+
+        if (async->responseLen == async->responseCap) {
+          if (async->responseCap == COMS_ASYNC_MAX_RESPONSE) {
+            async->state = ASYNC_STATE_DONE;
+            continue;
+          }
+          if (growResponse(async) != 0) return asyncFailed(async);
+        }
+
+        if (session->ssl) {
+          ret = SSL_read(session->ssl, &async->response[async->responseLen],
+                         async->responseCap - async->responseLen);
+          if (ret <= 0) {
+            switch (SSL_get_error(session->ssl, ret)) {
+              case SSL_ERROR_WANT_READ:
+                return asyncWait(async, COMS_EVENT_READ);
+              case SSL_ERROR_WANT_WRITE:
+                return asyncWait(async, COMS_EVENT_WRITE);
+              default:
+                ret = 0;
+                break;
+            }
+          }
+        } else {
+          ret = recv(session->sockfd, &async->response[async->responseLen],
+                     async->responseCap - async->responseLen, 0);
+          if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+              return asyncWait(async, COMS_EVENT_READ);
+            }
+            ret = 0;
+          }
+        }
+
+        if (ret == 0) {
+          // host closed the connection, what we have is the response unless
+          // it is a frame cut short
+          if (async->responseLen > 0 &&
+              async->recevSentinel == comsIsFrameComplete) {
+            log_err("Host closed the connection %zu bytes into a frame",
+                    async->responseLen);
+            return asyncFailed(async);
+          }
+          if (async->responseLen > 0) {
+            closeConnection(session);
+            async->state = ASYNC_STATE_DONE;
+            continue;
+          }
+          if (asyncReconnect(async) == 0) continue;
+          return asyncFailed(async);
+        }
+
+        async->reused = 0;
+        async->responseLen += ret;
+        async->response[async->responseLen] = '\0';
+        if (async->recevSentinel &&
+            async->recevSentinel(async->response, async->responseLen,
+                                 async->endTag)) {
+          async->state = ASYNC_STATE_DONE;
+        }
+        continue;
+      }
+
+      case ASYNC_STATE_DONE:
+        session->exchanges++;
+        async->wanted = COMS_EVENT_NONE;
+        return COMS_ASYNC_DONE;
+
+      default:
+        async->wanted = COMS_EVENT_NONE;
+        return COMS_ASYNC_FAILED;
+    }
   }
-clean_exit:
-  close(sockfd);
-  return ret;
 }
+
+int comsAsyncFd(const ComsAsync* async) { return async->session.sockfd; }
+
+int comsAsyncWantedEvents(const ComsAsync* async) { return async->wanted; }
+
+void comsAsyncGetResponse(const ComsAsync* async, NetworkBuffer* response) {
+  size_t len = async->responseLen;
+
+  if (len > sizeof(response->data) - 1) len = sizeof(response->data) - 1;
+  if (len) memcpy(response->data, async->response, len);
+  response->data[len] = '\0';
+  response->len = len;
+}
+
+void comsAsyncClose(ComsAsync* async) {
+  closeConnection(&async->session);
+  async->state = ASYNC_STATE_IDLE;
+  async->wanted = COMS_EVENT_NONE;
+}
+
 #else
+ComsSession* comsSessionCreate(const Host* host) {
+  (void)host;
+
+  return NULL;
+}
+
+void comsSessionDestroy(ComsSession* session) { (void)session; }
+
+const Host* comsSessionHost(const ComsSession* session) {
+  (void)session;
+
+  return NULL;
+}
+
+short comsSessionIsOpen(const ComsSession* session) {
+  (void)session;
+
+  return 0;
+}
+
+short comsSessionIsFor(const ComsSession* session, const Host* host) {
+  (void)session;
+  (void)host;
+
+  return 0;
+}
+
+int comsSessionSendReceive(ComsSession* session, NetworkBuffer* response,
+                           NetworkBuffer* request, int receiveTimeoutms,
+                           const ComSentinel recevSentinel,
+                           const char* endTag) {
+  (void)session;
+
+  return comSendReceive(response, request, NULL, receiveTimeoutms,
+                        recevSentinel, endTag);
+}
+
 int comSendReceive(NetworkBuffer* response, NetworkBuffer* request, Host* host,
                    int receiveTimeoutms, const ComSentinel recevSentinel,
                    const char* endTag) {
@@ -228,4 +1265,72 @@ int comSendReceive(NetworkBuffer* response, NetworkBuffer* request, Host* host,
   return 0;
 }
 
+ComsAsync* comsAsyncCreate(void) { return NULL; }
+
+void comsAsyncDestroy(ComsAsync* async) { (void)async; }
+
+ComsAsyncStatus comsAsyncStart(ComsAsync* async, const Host* host,
+                               const NetworkBuffer* request,
+                               const ComSentinel recevSentinel,
+                               const char* endTag) {
+  (void)async;
+  (void)host;
+  (void)request;
+  (void)recevSentinel;
+  (void)endTag;
+
+  return COMS_ASYNC_FAILED;
+}
+
+ComsAsyncStatus comsAsyncProgress(ComsAsync* async) {
+  (void)async;
+
+  return COMS_ASYNC_FAILED;
+}
+
+int comsAsyncFd(const ComsAsync* async) {
+  (void)async;
+
+  return -1;
+}
+
+int comsAsyncWantedEvents(const ComsAsync* async) {
+  (void)async;
+
+  return COMS_EVENT_NONE;
+}
+
+void comsAsyncGetResponse(const ComsAsync* async, NetworkBuffer* response) {
+  (void)async;
+
+  response->len = 0;
+}
+
+void comsAsyncClose(ComsAsync* async) { (void)async; }
+
+void comsSetTlsSessionTickets(short enable) { (void)enable; }
+
+void comsClearTlsSessions(void) {}
+
+void comsClearDnsCache(void) {}
+
+void comsSetDnsCacheTtl(int ttlMs) { (void)ttlMs; }
+
+void comsGetDnsStats(ComsDnsStats* stats) {
+  memset(stats, '\0', sizeof(ComsDnsStats));
+}
+
+void comsResetDnsStats(void) {}
+
+int comsResolveHost(const Host* host) {
+  (void)host;
+  return 0;
+}
+
+void comsGetTlsStats(ComsTlsStats* stats) {
+  memset(stats, '\0', sizeof(ComsTlsStats));
+}
+
+void comsResetTlsStats(void) {}
+
 #endif
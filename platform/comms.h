@@ -45,6 +45,17 @@ typedef struct NetworkBuffer {
 typedef int (*ComSentinel)(unsigned char* packet, const int bytesRead,
                            const char* endTag);
 
+#define COMS_FRAME_HEADER_SIZE 2
+
+/**
+ * @brief `ComSentinel` of messages framed by a 2-byte big-endian length
+ * header, e.g. ISO 8583 to NIBSS. Plain connections read such a message as
+ * the header then exactly the body.
+ *
+ */
+int comsIsFrameComplete(unsigned char* packet, const int bytesRead,
+                        const char* endTag);
+
 /**
  * @brief Function pointer to send and receive data
  *
@@ -58,6 +69,173 @@ int comSendReceive(NetworkBuffer* response, NetworkBuffer* request, Host* host,
                    int receiveTimeoutms, const ComSentinel recevSentinel,
                    const char* endTag);
 
+/**
+ * @brief Connection to one host kept open across several send/receive calls.
+ * The connection is opened on first use and re-opened once if the host
+ * closed it between calls. Every exchange needs a sentinel, the host closing
+ * the connection can't end a response on it.
+ *
+ */
+typedef struct ComsSession ComsSession;
+
+ComsSession* comsSessionCreate(const Host* host);
+void comsSessionDestroy(ComsSession* session);
+const Host* comsSessionHost(const ComsSession* session);
+short comsSessionIsOpen(const ComsSession* session);
+short comsSessionIsFor(const ComsSession* session, const Host* host);
+int comsSessionSendReceive(ComsSession* session, NetworkBuffer* response,
+                           NetworkBuffer* request, int receiveTimeoutms,
+                           const ComSentinel recevSentinel,
+                           const char* endTag);
+
+/**
+ * @brief Connection pool options
+ * @maxIdle: idle connections kept open across all hosts, 0 keeps none
+ * @maxPerHost: lent plus idle connections per host, 0 for no limit. Callers
+ * wait for a connection to be released when the limit is reached.
+ * @idleTimeoutMs: idle connections older than this are closed, 0 for never
+ *
+ */
+typedef struct ComsPoolOptions {
+  int maxIdle;
+  int maxPerHost;
+  int idleTimeoutMs;
+} ComsPoolOptions;
+
+/**
+ * @brief Pool of warm connections keyed by Host (url, port, connection
+ * type), safe to share between threads. A NULL pool is valid everywhere and
+ * means unpooled: acquire creates a session and release destroys it. An
+ * exchange with no sentinel is read until the host closes, so it goes over a
+ * connection of its own, never a pooled one.
+ *
+ */
+typedef struct ComsPool ComsPool;
+
+ComsPool* comsPoolCreate(const ComsPoolOptions* options);
+void comsPoolDestroy(ComsPool* pool);
+ComsSession* comsPoolAcquire(ComsPool* pool, const Host* host, int timeoutms);
+void comsPoolRelease(ComsPool* pool, ComsSession* session);
+int comsPoolSendReceive(ComsPool* pool, NetworkBuffer* response,
+                        NetworkBuffer* request, Host* host,
+                        int receiveTimeoutms, const ComSentinel recevSentinel,
+                        const char* endTag);
+
+/**
+ * @brief Route every `comSendReceive` call with a sentinel through `pool`,
+ * NULL to stop.
+ * The caller keeps ownership of the pool. Safe to call while other threads
+ * exchange, but the default pool must not be destroyed while a handshake or
+ * exchange may still be using it: stop them, or set another default and let
+ * them finish, first.
+ *
+ */
+void comsSetDefaultPool(ComsPool* pool);
+ComsPool* comsGetDefaultPool(void);
+
+/**
+ * @brief Socket events a non-blocking exchange waits for
+ *
+ */
+typedef enum {
+  COMS_EVENT_NONE = 0,
+  COMS_EVENT_READ = 1 << 0,
+  COMS_EVENT_WRITE = 1 << 1,
+} ComsEvent;
+
+/**
+ * @brief State of a non-blocking exchange
+ *
+ */
+typedef enum {
+  COMS_ASYNC_PENDING,
+  COMS_ASYNC_DONE,
+  COMS_ASYNC_FAILED,
+} ComsAsyncStatus;
+
+/**
+ * @brief Non-blocking send/receive driven by the caller's event loop. Start an
+ * exchange, wait for `comsAsyncWantedEvents` on `comsAsyncFd`, call
+ * `comsAsyncProgress` when they fire, until it returns DONE or FAILED. The
+ * connection is kept open for the next exchange to the same host.
+ *
+ * Starting an exchange resolves the host on the caller's thread and blocks
+ * on a DNS cache miss. Keep the event loop from blocking by resolving its
+ * hosts beforehand with `comsResolveHost` from another thread, again before
+ * `COMS_DNS_CACHE_TTL_MS` runs out.
+ *
+ */
+typedef struct ComsAsync ComsAsync;
+
+ComsAsync* comsAsyncCreate(void);
+void comsAsyncDestroy(ComsAsync* async);
+ComsAsyncStatus comsAsyncStart(ComsAsync* async, const Host* host,
+                               const NetworkBuffer* request,
+                               const ComSentinel recevSentinel,
+                               const char* endTag);
+ComsAsyncStatus comsAsyncProgress(ComsAsync* async);
+int comsAsyncFd(const ComsAsync* async);
+int comsAsyncWantedEvents(const ComsAsync* async);
+void comsAsyncGetResponse(const ComsAsync* async, NetworkBuffer* response);
+void comsAsyncClose(ComsAsync* async);
+
+#define COMS_DNS_CACHE_SIZE 32
+#define COMS_DNS_CACHE_TTL_MS 60000
+#define COMS_DNS_MAX_ADDRS 8
+#define COMS_CONNECT_STAGGER_MS 250
+
+/**
+ * @brief DNS cache counters since start up or `comsResetDnsStats`
+ * @lookups: host names looked up with getaddrinfo, missing or expired
+ * @hits: host names resolved from the cache
+ *
+ */
+typedef struct ComsDnsStats {
+  unsigned long lookups;
+  unsigned long hits;
+} ComsDnsStats;
+
+/**
+ * @brief Host names are resolved with getaddrinfo and cached, for
+ * `COMS_DNS_CACHE_TTL_MS` unless `comsSetDnsCacheTtl` says otherwise, so they
+ * aren't looked up again for every message. A new TTL applies to names cached
+ * from then on. Connects race the resolved IPv6 and IPv4 addresses, starting
+ * the next one every `COMS_CONNECT_STAGGER_MS`, and keep the first to
+ * connect. `comsResolveHost` puts a host in the cache ahead of its exchanges
+ * and returns 0 on success.
+ *
+ */
+void comsClearDnsCache(void);
+int comsResolveHost(const Host* host);
+void comsSetDnsCacheTtl(int ttlMs);
+void comsGetDnsStats(ComsDnsStats* stats);
+void comsResetDnsStats(void);
+
+#define COMS_TLS_SESSION_CACHE_SIZE 32
+
+/**
+ * @brief TLS handshake counters since start up or `comsResetTlsStats`
+ * @fullHandshakes: handshakes that negotiated a new session
+ * @resumedHandshakes: handshakes that resumed a cached session
+ *
+ */
+typedef struct ComsTlsStats {
+  unsigned long fullHandshakes;
+  unsigned long resumedHandshakes;
+} ComsTlsStats;
+
+/**
+ * @brief TLS sessions are cached per Host and offered on the next connect to
+ * the same host, which skips a round trip and the key exchange when the host
+ * accepts it. Session tickets (and with them TLS 1.3 resumption) are on by
+ * default; turning them off leaves TLS 1.2 session IDs only.
+ *
+ */
+void comsSetTlsSessionTickets(short enable);
+void comsClearTlsSessions(void);
+void comsGetTlsStats(ComsTlsStats* stats);
+void comsResetTlsStats(void);
+
 #ifdef __cplusplus
 }
 #endif
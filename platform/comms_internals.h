@@ -0,0 +1,40 @@
+/**
+ * File: comms_internals.h
+ * Declares the parts of comms.c shared with its tests
+ */
+#ifndef _ITEX_COMMS_INTERNALS_INCLUDED
+#define _ITEX_COMMS_INTERNALS_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/socket.h>
+
+#include "comms.h"
+
+/**
+ * @brief Addresses of a host name, in the order to connect to them
+ * @addrs: addresses, port not set
+ * @addrLens: sizes of `addrs`
+ * @count: number of addresses
+ *
+ */
+typedef struct ResolvedHost {
+  struct sockaddr_storage addrs[COMS_DNS_MAX_ADDRS];
+  socklen_t addrLens[COMS_DNS_MAX_ADDRS];
+  int count;
+} ResolvedHost;
+
+/**
+ * @brief Cache `resolved` as the addresses of `name` for the DNS cache TTL,
+ * connects to `name` then race them in order
+ *
+ */
+void comsPutDnsEntry(const char* name, const ResolvedHost* resolved);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,313 @@
+/**
+ * File: comsPool.c
+ * -------------------
+ * Implements the ComsPool part of comms.h interface.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../dbg.h"
+#include "comms.h"
+
+/**
+ * @brief Idle connection waiting to be lent again
+ * @session: open connection
+ * @idleSince: monotonic time the connection was returned
+ *
+ */
+struct ComsPoolIdle {
+  ComsSession* session;
+  long idleSince;
+  struct ComsPoolIdle* next;
+};
+
+/**
+ * @brief Connections counted against a host's `maxPerHost`
+ * @host: host the connections are to
+ * @live: lent plus idle connections
+ *
+ */
+struct ComsPoolHost {
+  Host host;
+  int live;
+  struct ComsPoolHost* next;
+};
+
+struct ComsPool {
+  ComsPoolOptions options;
+  struct ComsPoolIdle* idle;  // most recently returned first
+  int idleCount;
+  struct ComsPoolHost* hosts;
+  pthread_mutex_t lock;
+  pthread_cond_t released;
+};
+
+static ComsPool* gDefaultPool = NULL;
+static pthread_mutex_t gDefaultPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+static long monotonicMs(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+static short isSameHost(const Host* a, const Host* b) {
+  return a->port == b->port && a->connectionType == b->connectionType &&
+         strncmp(a->url, b->url, sizeof(a->url)) == 0;
+}
+
+static struct ComsPoolHost* getPoolHost(ComsPool* pool, const Host* host) {
+  struct ComsPoolHost* node = pool->hosts;
+
+  for (; node != NULL; node = node->next) {
+    if (isSameHost(&node->host, host)) return node;
+  }
+
+  node = (struct ComsPoolHost*)calloc(1, sizeof(struct ComsPoolHost));
+  if (node == NULL) return NULL;
+
+  memcpy(&node->host, host, sizeof(Host));
+  node->next = pool->hosts;
+  pool->hosts = node;
+
+  return node;
+}
+
+/**
+ * Unlinks `*link` from the idle list and moves its connection to `closing`,
+ * to be closed once the lock is released.
+ */
+static void retireIdle(ComsPool* pool, struct ComsPoolIdle** link,
+                       struct ComsPoolIdle** closing) {
+  struct ComsPoolIdle* node = *link;
+  struct ComsPoolHost* poolHost =
+      getPoolHost(pool, comsSessionHost(node->session));
+
+  *link = node->next;
+  pool->idleCount--;
+  if (poolHost) poolHost->live--;
+
+  node->next = *closing;
+  *closing = node;
+}
+
+static void sweepIdle(ComsPool* pool, long now,
+                      struct ComsPoolIdle** closing) {
+  struct ComsPoolIdle** link = &pool->idle;
+
+  while (*link != NULL) {
+    if (pool->options.idleTimeoutMs > 0 &&
+        now - (*link)->idleSince >= pool->options.idleTimeoutMs) {
+      retireIdle(pool, link, closing);
+    } else {
+      link = &(*link)->next;
+    }
+  }
+}
+
+static void closeRetired(struct ComsPoolIdle* closing) {
+  while (closing != NULL) {
+    struct ComsPoolIdle* next = closing->next;
+
+    comsSessionDestroy(closing->session);
+    free(closing);
+    closing = next;
+  }
+}
+
+ComsPool* comsPoolCreate(const ComsPoolOptions* options) {
+  ComsPool* pool = (ComsPool*)calloc(1, sizeof(ComsPool));
+
+  check_mem(pool);
+  if (options) {
+    memcpy(&pool->options, options, sizeof(ComsPoolOptions));
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->released, NULL);
+
+error:
+  return pool;
+}
+
+void comsPoolDestroy(ComsPool* pool) {
+  struct ComsPoolIdle* closing = NULL;
+  struct ComsPoolHost* poolHost = NULL;
+
+  if (pool == NULL) return;
+
+  pthread_mutex_lock(&gDefaultPoolLock);
+  if (gDefaultPool == pool) {
+    gDefaultPool = NULL;
+  }
+  pthread_mutex_unlock(&gDefaultPoolLock);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->idle != NULL) {
+    retireIdle(pool, &pool->idle, &closing);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  closeRetired(closing);
+
+  poolHost = pool->hosts;
+  while (poolHost != NULL) {
+    struct ComsPoolHost* next = poolHost->next;
+    free(poolHost);
+    poolHost = next;
+  }
+
+  pthread_cond_destroy(&pool->released);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+ComsSession* comsPoolAcquire(ComsPool* pool, const Host* host,
+                             int timeoutms) {
+  ComsSession* session = NULL;
+  struct ComsPoolIdle* closing = NULL;
+  struct ComsPoolIdle* reused = NULL;
+  long deadline = 0;
+
+  if (pool == NULL) return comsSessionCreate(host);
+
+  deadline = monotonicMs() + (timeoutms > 0 ? timeoutms : DEFAULT_TIMEOUT);
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    struct ComsPoolIdle** link = &pool->idle;
+    struct ComsPoolHost* poolHost = NULL;
+    long now = monotonicMs();
+    struct timespec wakeAt;
+
+    sweepIdle(pool, now, &closing);
+
+    for (; *link != NULL; link = &(*link)->next) {
+      if (isSameHost(comsSessionHost((*link)->session), host)) {
+        reused = *link;
+        *link = reused->next;
+        pool->idleCount--;
+        break;
+      }
+    }
+    if (reused) {
+      session = reused->session;
+      free(reused);
+      break;
+    }
+
+    poolHost = getPoolHost(pool, host);
+    if (poolHost == NULL) break;
+
+    if (pool->options.maxPerHost <= 0 ||
+        poolHost->live < pool->options.maxPerHost) {
+      session = comsSessionCreate(host);
+      if (session) poolHost->live++;
+      break;
+    }
+
+    if (now >= deadline) {
+      log_err("No connection to %s:%d available within %dms", host->url,
+              host->port, timeoutms);
+      break;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &wakeAt);
+    wakeAt.tv_sec += (deadline - now) / 1000;
+    wakeAt.tv_nsec += ((deadline - now) % 1000) * 1000000L;
+    if (wakeAt.tv_nsec >= 1000000000L) {
+      wakeAt.tv_sec++;
+      wakeAt.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&pool->released, &pool->lock, &wakeAt);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  closeRetired(closing);
+  return session;
+}
+
+void comsPoolRelease(ComsPool* pool, ComsSession* session) {
+  struct ComsPoolIdle* closing = NULL;
+  struct ComsPoolIdle* node = NULL;
+  struct ComsPoolHost* poolHost = NULL;
+  ComsSession* discarded = NULL;
+
+  if (session == NULL) return;
+  if (pool == NULL) {
+    comsSessionDestroy(session);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  poolHost = getPoolHost(pool, comsSessionHost(session));
+
+  if (comsSessionIsOpen(session) && pool->options.maxIdle > 0) {
+    node = (struct ComsPoolIdle*)malloc(sizeof(struct ComsPoolIdle));
+  }
+
+  if (node) {
+    node->session = session;
+    node->idleSince = monotonicMs();
+    node->next = pool->idle;
+    pool->idle = node;
+    pool->idleCount++;
+
+    // over the idle limit, drop the connection idle the longest
+    if (pool->idleCount > pool->options.maxIdle) {
+      struct ComsPoolIdle** link = &pool->idle;
+
+      while ((*link)->next != NULL) link = &(*link)->next;
+      retireIdle(pool, link, &closing);
+    }
+  } else {
+    if (poolHost) poolHost->live--;
+    discarded = session;
+  }
+
+  pthread_cond_broadcast(&pool->released);
+  pthread_mutex_unlock(&pool->lock);
+
+  comsSessionDestroy(discarded);
+  closeRetired(closing);
+}
+
+int comsPoolSendReceive(ComsPool* pool, NetworkBuffer* response,
+                        NetworkBuffer* request, Host* host,
+                        int receiveTimeoutms, const ComSentinel recevSentinel,
+                        const char* endTag) {
+  ComsSession* session = NULL;
+  int ret = 0;
+
+  if (recevSentinel == NULL) {
+    return comSendReceive(response, request, host, receiveTimeoutms, NULL,
+                          endTag);
+  }
+
+  session = comsPoolAcquire(pool, host, receiveTimeoutms);
+  if (session == NULL) return -1;
+
+  ret = comsSessionSendReceive(session, response, request, receiveTimeoutms,
+                               recevSentinel, endTag);
+  comsPoolRelease(pool, session);
+
+  return ret;
+}
+
+void comsSetDefaultPool(ComsPool* pool) {
+  pthread_mutex_lock(&gDefaultPoolLock);
+  gDefaultPool = pool;
+  pthread_mutex_unlock(&gDefaultPoolLock);
+}
+
+ComsPool* comsGetDefaultPool(void) {
+  ComsPool* pool = NULL;
+
+  pthread_mutex_lock(&gDefaultPoolLock);
+  pool = gDefaultPool;
+  pthread_mutex_unlock(&gDefaultPoolLock);
+
+  return pool;
+}
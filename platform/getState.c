@@ -5,10 +5,11 @@
 
 int getState(char* state, const size_t size) {
   time_t now = time(NULL);
-  struct tm now_t = *localtime(&now);
+  struct tm now_t;
   char dateTimeBuff[64] = {'\0'};
   char lastTrans[16] = {'\0'};
 
+  localtime_r(&now, &now_t);
   strftime(dateTimeBuff, sizeof(dateTimeBuff), "%a %d/%m/%Y %H:%M:%S", &now_t);
   strftime(lastTrans, sizeof(lastTrans), "%Y%m%d%H%M%S", &now_t);
 
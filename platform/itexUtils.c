@@ -1,19 +1,13 @@
 #include "itexUtils.h"
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../dbg.h"
+#include "../hexcodec/hexcodec.h"
 #include "../sha256/sha256.h"
 
-static unsigned char atoh(const char c) {
-  if (c >= '0' && c <= '9') return (c - '0');
-  if (c >= 'A' && c <= 'F') return (c - 'A' + 10);
-  if (c >= 'a' && c <= 'f') return (c - 'a' + 10);
-
-  return 0;
-}
-
 void rightTrim(char* input, const char ch) {
   int len = strlen(input);
 
@@ -52,39 +46,29 @@ void splitStr(char* firstPart, size_t fLen, char* secondPart, size_t sLen,
 }
 
 short ascToBcd(unsigned char* bcd, const short bcdLen, const char* asc) {
-  int ascLen, i, j;
-
-  if (bcdLen == 0) {
-    ascLen = strlen(asc);
-  } else {
-    ascLen = (bcdLen)*2;
-    memset(bcd, 0x00, bcdLen);
-  }
+  size_t ascLen = (bcdLen == 0) ? strlen(asc) : (size_t)bcdLen * 2;
+  long len = hexDecode(bcd, asc, ascLen);
 
-  for (i = 0, j = 0; j < ascLen; i++, j += 2) {
-    bcd[i] = (atoh(asc[2 * i]) << 4) | atoh(asc[2 * i + 1]);
+  if (len < 0) {
+    log_err("Error Converting to BCD");
+    if (bcdLen) memset(bcd, 0x00, bcdLen);
+    return -1;
   }
 
-  return i;
+  return len;
 }
 
 short bcdToAsc(unsigned char* asc, const int ascLen, const unsigned char* bcd,
                const int bcdLen) {
-  int i = 0;
-  short pos = 0;
-
-  if (bcdLen <= 0 || bcdLen * 2 > ascLen) {
+  if (bcdLen <= 0 || bcdLen * 2 >= ascLen) {
     log_err("Error Converting to ASCII");
     return -1;
   }
 
-  for (i = 0; i < bcdLen; i++) {
-    pos += sprintf((char*)&asc[pos], "%02X", bcd[i]);
-  }
-
-  asc[pos] = '\0';
+  hexEncode((char*)asc, bcd, bcdLen, HEX_CASE_UPPER);
+  asc[bcdLen * 2] = '\0';
 
-  return pos;
+  return bcdLen * 2;
 }
 
 short isApprovedResponse(const char* responseCode) {
@@ -94,50 +78,181 @@ short isApprovedResponse(const char* responseCode) {
 short generateMac(unsigned char* mac, const unsigned char* key,
                   const int keySize, const unsigned char* packet,
                   const int packetSize) {
+  MacSession session;
+  short len = 0;
+
   (void)keySize;
-  (void)packetSize;
 
-  calculateSHA256Digest((char*)packet, (char*)mac, (char*)key);
+  mac[0] = '\0';
+  if (macSessionInit(&session, (const char*)key) != 0) return 0;
+
+  len = macSessionDigest(&session, (char*)mac, 65, packet, packetSize,
+                         HEX_CASE_UPPER);
+  memset(&session, 0x00, sizeof(session));
+  if (len < 0) return 0;
+
   debug("MAC: %s", mac);
+  return len;
+}
 
-  return strlen((char*)mac);
+short get256Hash(char* hash, const int size, char* packet,
+                 const char* sessionKey) {
+  MacSession session;
+
+  memset(hash, 0x00, size);
+
+  if (macSessionInit(&session, sessionKey) != 0) return -1;
+
+  return macSessionDigest(&session, hash, size, (unsigned char*)packet,
+                          strlen(packet), HEX_CASE_LOWER) < 0
+             ? -1
+             : 0;
 }
 
-static void strToLower(char* convertBuffer, const char* buffer,
-                       const int length) {
-  int index = 0;
+/**
+ * @brief Decode a 32 hex digit session key and absorb it into a SHA-256
+ * context
+ *
+ * @param session
+ * @param hexKey
+ * @return short 0 on success, -1 if the key isn't 32 hex digits
+ */
+short macSessionInit(MacSession* session, const char* hexKey) {
+  memset(session, 0x00, sizeof(MacSession));
 
-  for (index = 0; index < length; index++) {
-    convertBuffer[index] =
-        isupper(buffer[index]) ? tolower(buffer[index]) : buffer[index];
+  if (hexKey == NULL || strlen(hexKey) < sizeof(session->key) * 2 ||
+      hexDecode(session->key, hexKey, sizeof(session->key) * 2) < 0) {
+    log_err("Invalid MAC session key");
+    memset(session->key, 0x00, sizeof(session->key));
+    return -1;
   }
+
+  sha256_starts(&session->keyed);
+  sha256_update(&session->keyed, session->key, sizeof(session->key));
+
+  return 0;
 }
 
-short get256Hash(char* hash, const int size, char* packet,
-                 const char* sessionKey) {
-  char buffer[65] = {'\0'};
-  sha256_context Context;
-  unsigned char keyBin[16];
+/**
+ * @brief Allocate a MacSession for hexKey
+ *
+ * @param hexKey
+ * @return MacSession* NULL if out of memory or the key is invalid
+ */
+MacSession* macSessionCreate(const char* hexKey) {
+  MacSession* session = (MacSession*)malloc(sizeof(MacSession));
+
+  if (session == NULL) return NULL;
+
+  if (macSessionInit(session, hexKey) != 0) {
+    free(session);
+    return NULL;
+  }
+
+  return session;
+}
+
+void macSessionDestroy(MacSession* session) {
+  if (session == NULL) return;
+
+  memset(session, 0x00, sizeof(MacSession));
+  free(session);
+}
+
+/**
+ * @brief Check if session was built from hexKey
+ *
+ * @param session may be NULL
+ * @param hexKey
+ * @return short
+ */
+short macSessionIsFor(const MacSession* session, const char* hexKey) {
+  unsigned char key[sizeof(session->key)];
+
+  if (session == NULL || hexKey == NULL ||
+      strlen(hexKey) < sizeof(key) * 2 ||
+      hexDecode(key, hexKey, sizeof(key) * 2) < 0) {
+    return 0;
+  }
+
+  return memcmp(key, session->key, sizeof(key)) == 0;
+}
+
+/**
+ * @brief SHA-256 of the session key followed by data, as hex
+ *
+ * @param session
+ * @param hash at least 65 bytes, NUL terminated
+ * @param size
+ * @param data
+ * @param dataSize
+ * @param hexCase
+ * @return short length of hash, -1 if size is too small
+ */
+short macSessionDigest(const MacSession* session, char* hash, const int size,
+                       const unsigned char* data, const int dataSize,
+                       HexCase hexCase) {
+  sha256_context context = session->keyed;
   unsigned char digest[32];
-  memset(hash, 0x00, size);
 
-  sha256_starts(&Context);
+  if (size <= (int)sizeof(digest) * 2) return -1;
 
-  ascToBcd(keyBin, sizeof(keyBin), sessionKey);
+  sha256_update(&context, (unsigned char*)data, dataSize);
+  sha256_finish(&context, digest);
 
-  sha256_update(&Context, keyBin, sizeof(keyBin));
-  sha256_update(&Context, (unsigned char*)packet, strlen(packet));
-  sha256_finish(&Context, digest);
+  hexEncode(hash, digest, sizeof(digest), hexCase);
+  hash[sizeof(digest) * 2] = '\0';
 
-  memset(buffer, 0x00, sizeof(buffer));
-  bcdToAsc((unsigned char*)buffer, sizeof(buffer), digest, sizeof(digest));
+  return sizeof(digest) * 2;
+}
 
-  memset(hash, 0x00, size);
-  strToLower(hash, buffer, strlen(buffer));
+/**
+ * @brief MacStream init over a MacSession, state is a MacSessionStream
+ *
+ * @param state
+ * @param key unused, the key is the state's session
+ * @param keySize unused
+ * @return short 0 on success
+ */
+short macSessionStreamInit(void* state, const unsigned char* key,
+                           const int keySize) {
+  MacSessionStream* stream = (MacSessionStream*)state;
 
+  (void)key;
+  (void)keySize;
+  if (stream->session == NULL) {
+    log_err("MAC stream has no session");
+    return -1;
+  }
+
+  stream->context = stream->session->keyed;
   return 0;
 }
 
+void macSessionStreamUpdate(void* state, const unsigned char* data,
+                            const int size) {
+  sha256_update(&((MacSessionStream*)state)->context, (unsigned char*)data,
+                size);
+}
+
+/**
+ * @brief MacStream final over a MacSession
+ *
+ * @param state
+ * @param mac at least 65 bytes
+ * @return short length of mac
+ */
+short macSessionStreamFinal(void* state, unsigned char* mac) {
+  unsigned char digest[32];
+
+  sha256_finish(&((MacSessionStream*)state)->context, digest);
+  hexEncode((char*)mac, digest, sizeof(digest), HEX_CASE_UPPER);
+  mac[sizeof(digest) * 2] = '\0';
+
+  debug("MAC: %s", mac);
+  return sizeof(digest) * 2;
+}
+
 short pad(char* inOutString, char symbol, short paddedLength, short padRight) {
   char buffer[512] = {'\0'};
   char inString[512] = {'\0'};
@@ -159,54 +274,6 @@ short pad(char* inOutString, char symbol, short paddedLength, short padRight) {
   return 0;
 }
 
-int hex2bin(const char* pcInBuffer, char* pcOutBuffer, int iLen) {
-  char* p;
-  int iBytes = 0;
-  const char* hextable = "0123456789ABCDEF";
-  int nibble = 0;
-  int nibble_val = 0;
-
-  while (iBytes < iLen) {
-    int c = *pcInBuffer++;
-    if (c == 0) break;
-
-    c = toupper(c);
-
-    p = strchr((char*)hextable, c);
-    if (p) {
-      if (nibble & 1) {
-        iBytes++;
-        *pcOutBuffer = (nibble_val << 4 | (p - hextable));
-        pcOutBuffer++;
-      } else {
-        nibble_val = (p - hextable);
-      }
-      nibble++;
-    } else {
-      nibble = 0;
-    }
-  }
-
-  return iBytes;
-}
-
-static int bin2hex(unsigned char* pcInBuffer, char* pcOutBuffer, int iLen) {
-  int iCount;
-  char* pcBuffer;
-  unsigned char* pcTemp;
-
-  memset(pcOutBuffer, 0, iLen);
-  pcTemp = pcInBuffer;
-  pcBuffer = pcOutBuffer;
-  for (iCount = 0; iCount < iLen; iCount++) {
-    unsigned char ucCh = *pcTemp;
-    pcBuffer += sprintf(pcBuffer, "%02x", (int)ucCh);
-    pcTemp++;
-  }  // while
-
-  return 0;
-}
-
 int decryptTamsKey(char (*clearSessionKeys)[33],
                    char (*encryptedSessionKeys)[33], const char* tid,
                    const char* masterKey, const int keySize) {
@@ -233,11 +300,15 @@ int decryptTamsKey(char (*clearSessionKeys)[33],
   for (i = 0; i < keySize; i++) {
     memset(keyBin, 0, sizeof(keyBin));
 
-    hex2bin(encryptedSessionKeys[i], (char*)keyBin, 16);
+    if (hexDecode(keyBin, encryptedSessionKeys[i], 32) < 0) {
+      log_err("Encrypted key %d isn't hex", i);
+      return -1;
+    }
 
     rc4_crypt(&state, keyBin, 16);
 
-    bin2hex(keyBin, clearSessionKeys[i], 16);
+    hexEncode(clearSessionKeys[i], keyBin, 16, HEX_CASE_LOWER);
+    clearSessionKeys[i][32] = '\0';
   }
 
   return 0;
@@ -277,6 +348,7 @@ short getTamsHash(char* hash, const char* data, const char* key) {
   short ret = EXIT_FAILURE;
   char body[0x1000] = {'\0'};
   char* token = NULL;
+  char* savePtr = NULL;
 
   check(data && key, "`data` or `key` can't be NULL");
 
@@ -284,7 +356,7 @@ short getTamsHash(char* hash, const char* data, const char* key) {
   memset(hashdata, 0, sizeof(hashdata));
   strcpy(body, data);
 
-  token = (char*)strtok(body, "&");
+  token = strtok_r(body, "&", &savePtr);
 
   while (token != NULL) {
     int i = 0;
@@ -297,7 +369,7 @@ short getTamsHash(char* hash, const char* data, const char* key) {
       }
     }
 
-    token = strtok(NULL, "&");
+    token = strtok_r(NULL, "&", &savePtr);
   }
 
   memset(digest, 0, sizeof(digest));
@@ -8,7 +8,31 @@ extern "C" {
 #include <stdio.h>
 
 #include "../ezxml/ezxml.h"
+#include "../hexcodec/hexcodec.h"
 #include "../rc4/rc4.h"
+#include "../sha256/sha256.h"
+
+/**
+ * @brief MAC state of a session key
+ * @key: decoded session key
+ * @keyed: SHA-256 context that has absorbed `key`, cloned for every MAC
+ *
+ */
+typedef struct MacSession {
+  unsigned char key[16];
+  sha256_context keyed;
+} MacSession;
+
+/**
+ * @brief MacStream state over a MacSession, the stream's key is unused
+ * @session: session to MAC with
+ * @context: SHA-256 context of the running MAC
+ *
+ */
+typedef struct MacSessionStream {
+  const MacSession* session;
+  sha256_context context;
+} MacSessionStream;
 
 short ascToBcd(unsigned char* bcd, const short bcdLen, const char* asc);
 short bcdToAsc(unsigned char* asc, const int ascLen, const unsigned char* bcd,
@@ -25,6 +49,18 @@ int decryptTamsKey(char (*clearSessionKeys)[33],
                    const char* masterKey, const int keySize);
 short get256Hash(char* hash, const int size, char* packet,
                  const char* sessionKey);
+short macSessionInit(MacSession* session, const char* hexKey);
+MacSession* macSessionCreate(const char* hexKey);
+void macSessionDestroy(MacSession* session);
+short macSessionIsFor(const MacSession* session, const char* hexKey);
+short macSessionDigest(const MacSession* session, char* hash, const int size,
+                       const unsigned char* data, const int dataSize,
+                       HexCase hexCase);
+short macSessionStreamInit(void* state, const unsigned char* key,
+                           const int keySize);
+void macSessionStreamUpdate(void* state, const unsigned char* data,
+                            const int size);
+short macSessionStreamFinal(void* state, unsigned char* mac);
 short checkTamsError(char* message, size_t bufLen, ezxml_t root);
 short getTamsHash(char* hash, const char* data, const char* key);
 char* url_encode_html5(unsigned char* s, char* enc);
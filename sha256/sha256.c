@@ -19,9 +19,16 @@
  */
 
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /*
 #include <posapi.h>
 #include <posapi_all.h>
@@ -33,12 +40,18 @@
 #include "md5.h"
 */
 
+#include "../hexcodec/hexcodec.h"
 #include "sha256.h"
 // #include "Keys.h"
 // #include "Bin2Hex.h"
 // extern Device MainDevice;
 
 #define KEY_SIZE 16
+#define SHA256_LANES 8
+
+// loaded on every block, set by sha256_select: accessed atomically
+static sha256_kernel gKernel = SHA256_KERNEL_AUTO;
+
 #define GET_UINT32(n, b, i)                                         \
   {                                                                 \
     (n) = ((uint32)(b)[(i)] << 24) | ((uint32)(b)[(i) + 1] << 16) | \
@@ -53,56 +66,6 @@
     (b)[(i) + 3] = (uint8)((n));       \
   }
 
-static int binTohex(unsigned char* pcInBuffer, char* pcOutBuffer, int iLen) {
-  int iCount;
-  char* pcBuffer;
-  unsigned char* pcTemp;
-
-  memset(pcOutBuffer, 0, iLen);
-  pcTemp = pcInBuffer;
-  pcBuffer = pcOutBuffer;
-  for (iCount = 0; iCount < iLen; iCount++) {
-    unsigned char ucCh = *pcTemp;
-    pcBuffer += sprintf(pcBuffer, "%02X", (int)ucCh);
-    pcTemp++;
-  }  // while
-
-  return 0;
-}
-
-static int hex2bin(const char* pcInBuffer, char* pcOutBuffer, int iLen) {
-  char* p;
-  int iBytes = 0;
-  const char* hextable = "0123456789ABCDEF";
-  int nibble = 0;
-  int nibble_val = 0;
-
-  while (iBytes < iLen) {
-    int c = *pcInBuffer++;
-    if (c == 0) break;
-
-    c = toupper(c);
-
-    p = (char*)strchr(hextable, c);
-    if (p) {
-      if (nibble & 1) {
-        iBytes++;
-        *pcOutBuffer = (nibble_val << 4 | (p - hextable));
-        pcOutBuffer++;
-      }  // if
-      else {
-        nibble_val = (p - hextable);
-      }  // else
-      nibble++;
-    }  // if
-    else {
-      nibble = 0;
-    }  // else
-  }    // while
-
-  return iBytes;
-}  // hex2bin
-
 void sha256_starts(sha256_context* ctx) {
   ctx->total[0] = 0;
   ctx->total[1] = 0;
@@ -117,27 +80,6 @@ void sha256_starts(sha256_context* ctx) {
   ctx->state[7] = 0x5BE0CD19;
 }
 
-void sha256_process(sha256_context* ctx, uint8 data[64]) {
-  uint32 temp1, temp2, W[64];
-  uint32 A, B, C, D, E, F, G, H;
-
-  GET_UINT32(W[0], data, 0);
-  GET_UINT32(W[1], data, 4);
-  GET_UINT32(W[2], data, 8);
-  GET_UINT32(W[3], data, 12);
-  GET_UINT32(W[4], data, 16);
-  GET_UINT32(W[5], data, 20);
-  GET_UINT32(W[6], data, 24);
-  GET_UINT32(W[7], data, 28);
-  GET_UINT32(W[8], data, 32);
-  GET_UINT32(W[9], data, 36);
-  GET_UINT32(W[10], data, 40);
-  GET_UINT32(W[11], data, 44);
-  GET_UINT32(W[12], data, 48);
-  GET_UINT32(W[13], data, 52);
-  GET_UINT32(W[14], data, 56);
-  GET_UINT32(W[15], data, 60);
-
 #define SHR(x, n) ((x & 0xFFFFFFFF) >> n)
 #define ROTR(x, n) (SHR(x, n) | (x << (32 - n)))
 
@@ -160,88 +102,330 @@ void sha256_process(sha256_context* ctx, uint8 data[64]) {
     h = temp1 + temp2;                       \
   }
 
-  A = ctx->state[0];
-  B = ctx->state[1];
-  C = ctx->state[2];
-  D = ctx->state[3];
-  E = ctx->state[4];
-  F = ctx->state[5];
-  G = ctx->state[6];
-  H = ctx->state[7];
-
-  P(A, B, C, D, E, F, G, H, W[0], 0x428A2F98);
-  P(H, A, B, C, D, E, F, G, W[1], 0x71374491);
-  P(G, H, A, B, C, D, E, F, W[2], 0xB5C0FBCF);
-  P(F, G, H, A, B, C, D, E, W[3], 0xE9B5DBA5);
-  P(E, F, G, H, A, B, C, D, W[4], 0x3956C25B);
-  P(D, E, F, G, H, A, B, C, W[5], 0x59F111F1);
-  P(C, D, E, F, G, H, A, B, W[6], 0x923F82A4);
-  P(B, C, D, E, F, G, H, A, W[7], 0xAB1C5ED5);
-  P(A, B, C, D, E, F, G, H, W[8], 0xD807AA98);
-  P(H, A, B, C, D, E, F, G, W[9], 0x12835B01);
-  P(G, H, A, B, C, D, E, F, W[10], 0x243185BE);
-  P(F, G, H, A, B, C, D, E, W[11], 0x550C7DC3);
-  P(E, F, G, H, A, B, C, D, W[12], 0x72BE5D74);
-  P(D, E, F, G, H, A, B, C, W[13], 0x80DEB1FE);
-  P(C, D, E, F, G, H, A, B, W[14], 0x9BDC06A7);
-  P(B, C, D, E, F, G, H, A, W[15], 0xC19BF174);
-  P(A, B, C, D, E, F, G, H, R(16), 0xE49B69C1);
-  P(H, A, B, C, D, E, F, G, R(17), 0xEFBE4786);
-  P(G, H, A, B, C, D, E, F, R(18), 0x0FC19DC6);
-  P(F, G, H, A, B, C, D, E, R(19), 0x240CA1CC);
-  P(E, F, G, H, A, B, C, D, R(20), 0x2DE92C6F);
-  P(D, E, F, G, H, A, B, C, R(21), 0x4A7484AA);
-  P(C, D, E, F, G, H, A, B, R(22), 0x5CB0A9DC);
-  P(B, C, D, E, F, G, H, A, R(23), 0x76F988DA);
-  P(A, B, C, D, E, F, G, H, R(24), 0x983E5152);
-  P(H, A, B, C, D, E, F, G, R(25), 0xA831C66D);
-  P(G, H, A, B, C, D, E, F, R(26), 0xB00327C8);
-  P(F, G, H, A, B, C, D, E, R(27), 0xBF597FC7);
-  P(E, F, G, H, A, B, C, D, R(28), 0xC6E00BF3);
-  P(D, E, F, G, H, A, B, C, R(29), 0xD5A79147);
-  P(C, D, E, F, G, H, A, B, R(30), 0x06CA6351);
-  P(B, C, D, E, F, G, H, A, R(31), 0x14292967);
-  P(A, B, C, D, E, F, G, H, R(32), 0x27B70A85);
-  P(H, A, B, C, D, E, F, G, R(33), 0x2E1B2138);
-  P(G, H, A, B, C, D, E, F, R(34), 0x4D2C6DFC);
-  P(F, G, H, A, B, C, D, E, R(35), 0x53380D13);
-  P(E, F, G, H, A, B, C, D, R(36), 0x650A7354);
-  P(D, E, F, G, H, A, B, C, R(37), 0x766A0ABB);
-  P(C, D, E, F, G, H, A, B, R(38), 0x81C2C92E);
-  P(B, C, D, E, F, G, H, A, R(39), 0x92722C85);
-  P(A, B, C, D, E, F, G, H, R(40), 0xA2BFE8A1);
-  P(H, A, B, C, D, E, F, G, R(41), 0xA81A664B);
-  P(G, H, A, B, C, D, E, F, R(42), 0xC24B8B70);
-  P(F, G, H, A, B, C, D, E, R(43), 0xC76C51A3);
-  P(E, F, G, H, A, B, C, D, R(44), 0xD192E819);
-  P(D, E, F, G, H, A, B, C, R(45), 0xD6990624);
-  P(C, D, E, F, G, H, A, B, R(46), 0xF40E3585);
-  P(B, C, D, E, F, G, H, A, R(47), 0x106AA070);
-  P(A, B, C, D, E, F, G, H, R(48), 0x19A4C116);
-  P(H, A, B, C, D, E, F, G, R(49), 0x1E376C08);
-  P(G, H, A, B, C, D, E, F, R(50), 0x2748774C);
-  P(F, G, H, A, B, C, D, E, R(51), 0x34B0BCB5);
-  P(E, F, G, H, A, B, C, D, R(52), 0x391C0CB3);
-  P(D, E, F, G, H, A, B, C, R(53), 0x4ED8AA4A);
-  P(C, D, E, F, G, H, A, B, R(54), 0x5B9CCA4F);
-  P(B, C, D, E, F, G, H, A, R(55), 0x682E6FF3);
-  P(A, B, C, D, E, F, G, H, R(56), 0x748F82EE);
-  P(H, A, B, C, D, E, F, G, R(57), 0x78A5636F);
-  P(G, H, A, B, C, D, E, F, R(58), 0x84C87814);
-  P(F, G, H, A, B, C, D, E, R(59), 0x8CC70208);
-  P(E, F, G, H, A, B, C, D, R(60), 0x90BEFFFA);
-  P(D, E, F, G, H, A, B, C, R(61), 0xA4506CEB);
-  P(C, D, E, F, G, H, A, B, R(62), 0xBEF9A3F7);
-  P(B, C, D, E, F, G, H, A, R(63), 0xC67178F2);
-
-  ctx->state[0] += A;
-  ctx->state[1] += B;
-  ctx->state[2] += C;
-  ctx->state[3] += D;
-  ctx->state[4] += E;
-  ctx->state[5] += F;
-  ctx->state[6] += G;
-  ctx->state[7] += H;
+static void processScalar(uint32_t state[8], const uint8* data,
+                          size_t blocks) {
+  uint32_t temp1, temp2, W[64];
+  uint32_t A, B, C, D, E, F, G, H;
+
+  for (; blocks > 0; blocks--, data += 64) {
+    GET_UINT32(W[0], data, 0);
+    GET_UINT32(W[1], data, 4);
+    GET_UINT32(W[2], data, 8);
+    GET_UINT32(W[3], data, 12);
+    GET_UINT32(W[4], data, 16);
+    GET_UINT32(W[5], data, 20);
+    GET_UINT32(W[6], data, 24);
+    GET_UINT32(W[7], data, 28);
+    GET_UINT32(W[8], data, 32);
+    GET_UINT32(W[9], data, 36);
+    GET_UINT32(W[10], data, 40);
+    GET_UINT32(W[11], data, 44);
+    GET_UINT32(W[12], data, 48);
+    GET_UINT32(W[13], data, 52);
+    GET_UINT32(W[14], data, 56);
+    GET_UINT32(W[15], data, 60);
+
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
+
+    P(A, B, C, D, E, F, G, H, W[0], 0x428A2F98);
+    P(H, A, B, C, D, E, F, G, W[1], 0x71374491);
+    P(G, H, A, B, C, D, E, F, W[2], 0xB5C0FBCF);
+    P(F, G, H, A, B, C, D, E, W[3], 0xE9B5DBA5);
+    P(E, F, G, H, A, B, C, D, W[4], 0x3956C25B);
+    P(D, E, F, G, H, A, B, C, W[5], 0x59F111F1);
+    P(C, D, E, F, G, H, A, B, W[6], 0x923F82A4);
+    P(B, C, D, E, F, G, H, A, W[7], 0xAB1C5ED5);
+    P(A, B, C, D, E, F, G, H, W[8], 0xD807AA98);
+    P(H, A, B, C, D, E, F, G, W[9], 0x12835B01);
+    P(G, H, A, B, C, D, E, F, W[10], 0x243185BE);
+    P(F, G, H, A, B, C, D, E, W[11], 0x550C7DC3);
+    P(E, F, G, H, A, B, C, D, W[12], 0x72BE5D74);
+    P(D, E, F, G, H, A, B, C, W[13], 0x80DEB1FE);
+    P(C, D, E, F, G, H, A, B, W[14], 0x9BDC06A7);
+    P(B, C, D, E, F, G, H, A, W[15], 0xC19BF174);
+    P(A, B, C, D, E, F, G, H, R(16), 0xE49B69C1);
+    P(H, A, B, C, D, E, F, G, R(17), 0xEFBE4786);
+    P(G, H, A, B, C, D, E, F, R(18), 0x0FC19DC6);
+    P(F, G, H, A, B, C, D, E, R(19), 0x240CA1CC);
+    P(E, F, G, H, A, B, C, D, R(20), 0x2DE92C6F);
+    P(D, E, F, G, H, A, B, C, R(21), 0x4A7484AA);
+    P(C, D, E, F, G, H, A, B, R(22), 0x5CB0A9DC);
+    P(B, C, D, E, F, G, H, A, R(23), 0x76F988DA);
+    P(A, B, C, D, E, F, G, H, R(24), 0x983E5152);
+    P(H, A, B, C, D, E, F, G, R(25), 0xA831C66D);
+    P(G, H, A, B, C, D, E, F, R(26), 0xB00327C8);
+    P(F, G, H, A, B, C, D, E, R(27), 0xBF597FC7);
+    P(E, F, G, H, A, B, C, D, R(28), 0xC6E00BF3);
+    P(D, E, F, G, H, A, B, C, R(29), 0xD5A79147);
+    P(C, D, E, F, G, H, A, B, R(30), 0x06CA6351);
+    P(B, C, D, E, F, G, H, A, R(31), 0x14292967);
+    P(A, B, C, D, E, F, G, H, R(32), 0x27B70A85);
+    P(H, A, B, C, D, E, F, G, R(33), 0x2E1B2138);
+    P(G, H, A, B, C, D, E, F, R(34), 0x4D2C6DFC);
+    P(F, G, H, A, B, C, D, E, R(35), 0x53380D13);
+    P(E, F, G, H, A, B, C, D, R(36), 0x650A7354);
+    P(D, E, F, G, H, A, B, C, R(37), 0x766A0ABB);
+    P(C, D, E, F, G, H, A, B, R(38), 0x81C2C92E);
+    P(B, C, D, E, F, G, H, A, R(39), 0x92722C85);
+    P(A, B, C, D, E, F, G, H, R(40), 0xA2BFE8A1);
+    P(H, A, B, C, D, E, F, G, R(41), 0xA81A664B);
+    P(G, H, A, B, C, D, E, F, R(42), 0xC24B8B70);
+    P(F, G, H, A, B, C, D, E, R(43), 0xC76C51A3);
+    P(E, F, G, H, A, B, C, D, R(44), 0xD192E819);
+    P(D, E, F, G, H, A, B, C, R(45), 0xD6990624);
+    P(C, D, E, F, G, H, A, B, R(46), 0xF40E3585);
+    P(B, C, D, E, F, G, H, A, R(47), 0x106AA070);
+    P(A, B, C, D, E, F, G, H, R(48), 0x19A4C116);
+    P(H, A, B, C, D, E, F, G, R(49), 0x1E376C08);
+    P(G, H, A, B, C, D, E, F, R(50), 0x2748774C);
+    P(F, G, H, A, B, C, D, E, R(51), 0x34B0BCB5);
+    P(E, F, G, H, A, B, C, D, R(52), 0x391C0CB3);
+    P(D, E, F, G, H, A, B, C, R(53), 0x4ED8AA4A);
+    P(C, D, E, F, G, H, A, B, R(54), 0x5B9CCA4F);
+    P(B, C, D, E, F, G, H, A, R(55), 0x682E6FF3);
+    P(A, B, C, D, E, F, G, H, R(56), 0x748F82EE);
+    P(H, A, B, C, D, E, F, G, R(57), 0x78A5636F);
+    P(G, H, A, B, C, D, E, F, R(58), 0x84C87814);
+    P(F, G, H, A, B, C, D, E, R(59), 0x8CC70208);
+    P(E, F, G, H, A, B, C, D, R(60), 0x90BEFFFA);
+    P(D, E, F, G, H, A, B, C, R(61), 0xA4506CEB);
+    P(C, D, E, F, G, H, A, B, R(62), 0xBEF9A3F7);
+    P(B, C, D, E, F, G, H, A, R(63), 0xC67178F2);
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
+  }
+}
+
+#ifdef SHA256_X86
+static const uint32_t K256[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+    0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+    0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+    0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+    0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+    0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+/*
+ * SHA extensions: sha256rnds2 runs two rounds on the state split as ABEF and
+ * CDGH, sha256msg1/msg2 extend the message schedule four words at a time.
+ */
+__attribute__((target("sha,sse4.1"))) static void processShaNi(
+    uint32_t state[8], const uint8* data, size_t blocks) {
+  const __m128i byteSwap =
+      _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+  __m128i abef, cdgh, abefSave, cdghSave, msg, tmp;
+  __m128i w[4];
+  int i = 0;
+
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+  cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+  abef = _mm_alignr_epi8(tmp, cdgh, 8);
+  cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+  for (; blocks > 0; blocks--, data += 64) {
+    abefSave = abef;
+    cdghSave = cdgh;
+
+    for (i = 0; i < 16; i++) {
+      if (i < 4) {
+        w[i] = _mm_shuffle_epi8(
+            _mm_loadu_si128((const __m128i*)(data + 16 * i)), byteSwap);
+      } else {
+        tmp = _mm_alignr_epi8(w[(i - 1) & 3], w[(i - 2) & 3], 4);
+        w[i & 3] = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i - 3) & 3]), tmp),
+            w[(i - 1) & 3]);
+      }
+
+      msg = _mm_add_epi32(w[i & 3],
+                          _mm_loadu_si128((const __m128i*)&K256[4 * i]));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0E));
+    }
+
+    abef = _mm_add_epi32(abef, abefSave);
+    cdgh = _mm_add_epi32(cdgh, cdghSave);
+  }
+
+  tmp = _mm_shuffle_epi32(abef, 0x1B);
+  cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, cdgh, 0xF0));
+  _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+/*
+ * AVX2 runs eight independent messages, one per 32-bit lane. state[i] holds
+ * word i of every lane and blocks holds one 64-byte block per lane.
+ */
+#define VROTR(x, n) \
+  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define VS0(x) \
+  _mm256_xor_si256(_mm256_xor_si256(VROTR(x, 7), VROTR(x, 18)), \
+                   _mm256_srli_epi32(x, 3))
+#define VS1(x) \
+  _mm256_xor_si256(_mm256_xor_si256(VROTR(x, 17), VROTR(x, 19)), \
+                   _mm256_srli_epi32(x, 10))
+#define VS2(x) \
+  _mm256_xor_si256(_mm256_xor_si256(VROTR(x, 2), VROTR(x, 13)), VROTR(x, 22))
+#define VS3(x) \
+  _mm256_xor_si256(_mm256_xor_si256(VROTR(x, 6), VROTR(x, 11)), VROTR(x, 25))
+
+__attribute__((target("avx2"))) static void processAvx2x8(
+    uint32_t state[8][SHA256_LANES], const uint8 blocks[SHA256_LANES][64]) {
+  const __m256i byteSwap = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const __m256i laneOffsets =
+      _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+  __m256i v[8], w[16], temp1, temp2;
+  int t = 0;
+
+  for (t = 0; t < 8; t++) {
+    v[t] = _mm256_loadu_si256((const __m256i*)state[t]);
+  }
+
+  for (t = 0; t < 64; t++) {
+    __m256i a = v[0], b = v[1], c = v[2], e = v[4], f = v[5], g = v[6];
+
+    if (t < 16) {
+      w[t] = _mm256_shuffle_epi8(
+          _mm256_i32gather_epi32((const int*)blocks,
+                                 _mm256_add_epi32(laneOffsets,
+                                                  _mm256_set1_epi32(t)),
+                                 4),
+          byteSwap);
+    } else {
+      w[t & 15] = _mm256_add_epi32(
+          _mm256_add_epi32(VS1(w[(t - 2) & 15]), w[(t - 7) & 15]),
+          _mm256_add_epi32(VS0(w[(t - 15) & 15]), w[t & 15]));
+    }
+
+    temp1 = _mm256_add_epi32(
+        _mm256_add_epi32(v[7], VS3(e)),
+        _mm256_add_epi32(
+            _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)),
+            _mm256_add_epi32(_mm256_set1_epi32((int)K256[t]), w[t & 15])));
+    temp2 = _mm256_add_epi32(
+        VS2(a), _mm256_or_si256(_mm256_and_si256(a, b),
+                                _mm256_and_si256(c, _mm256_or_si256(a, b))));
+
+    v[7] = g;
+    v[6] = f;
+    v[5] = e;
+    v[4] = _mm256_add_epi32(v[3], temp1);
+    v[3] = c;
+    v[2] = b;
+    v[1] = a;
+    v[0] = _mm256_add_epi32(temp1, temp2);
+  }
+
+  for (t = 0; t < 8; t++) {
+    __m256i old = _mm256_loadu_si256((const __m256i*)state[t]);
+    _mm256_storeu_si256((__m256i*)state[t], _mm256_add_epi32(old, v[t]));
+  }
+}
+#endif
+
+static int hasShaExtensions(void) {
+#ifdef SHA256_X86
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("sse4.1")) return 0;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return 0;
+
+  return (ebx & bit_SHA) != 0;
+#else
+  return 0;
+#endif
+}
+
+static int hasAvx2(void) {
+#ifdef SHA256_X86
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return 0;
+#endif
+}
+
+static sha256_kernel bestKernel(const sha256_kernel wanted) {
+  if ((wanted == SHA256_KERNEL_AUTO || wanted == SHA256_KERNEL_SHANI) &&
+      hasShaExtensions()) {
+    return SHA256_KERNEL_SHANI;
+  }
+  if ((wanted == SHA256_KERNEL_AUTO || wanted == SHA256_KERNEL_AVX2) &&
+      hasAvx2()) {
+    return SHA256_KERNEL_AVX2;
+  }
+
+  return SHA256_KERNEL_SCALAR;
+}
+
+static sha256_kernel getKernel(void) {
+  sha256_kernel kernel = __atomic_load_n(&gKernel, __ATOMIC_RELAXED);
+
+  // racing threads all store the same best kernel
+  if (kernel == SHA256_KERNEL_AUTO) {
+    kernel = bestKernel(SHA256_KERNEL_AUTO);
+    __atomic_store_n(&gKernel, kernel, __ATOMIC_RELAXED);
+  }
+
+  return kernel;
+}
+
+sha256_kernel sha256_select(sha256_kernel kernel) {
+  kernel = bestKernel(kernel);
+  __atomic_store_n(&gKernel, kernel, __ATOMIC_RELAXED);
+  return kernel;
+}
+
+const char* sha256_kernel_name(sha256_kernel kernel) {
+  switch (kernel) {
+    case SHA256_KERNEL_SCALAR:
+      return "scalar";
+    case SHA256_KERNEL_SHANI:
+      return "sha-ni";
+    case SHA256_KERNEL_AVX2:
+      return "avx2";
+    default:
+      return "auto";
+  }
+}
+
+static void processBlocks(uint32_t state[8], const uint8* data,
+                          size_t blocks) {
+#ifdef SHA256_X86
+  if (getKernel() == SHA256_KERNEL_SHANI) {
+    processShaNi(state, data, blocks);
+    return;
+  }
+#endif
+
+  processScalar(state, data, blocks);
+}
+
+void sha256_process(sha256_context* ctx, uint8 data[64]) {
+  processBlocks(ctx->state, data, 1);
 }
 
 void sha256_update(sha256_context* ctx, uint8* input, uint32 length) {
@@ -265,10 +449,10 @@ void sha256_update(sha256_context* ctx, uint8* input, uint32 length) {
     left = 0;
   }
 
-  while (length >= 64) {
-    sha256_process(ctx, input);
-    length -= 64;
-    input += 64;
+  if (length >= 64) {
+    processBlocks(ctx->state, input, length / 64);
+    input += length & ~0x3F;
+    length &= 0x3F;
   }
 
   if (length) {
@@ -308,6 +492,106 @@ void sha256_finish(sha256_context* ctx, uint8 digest[32]) {
   PUT_UINT32(ctx->state[7], digest, 28);
 }
 
+/*
+ * Block `block` of what update(ctx, input, length) then finish(ctx) would
+ * hash: the buffered bytes, input, the 0x80 pad byte and the bit length.
+ */
+static void laneBlock(uint8 out[64], const sha256_context* ctx,
+                      const uint8* input, uint32 length, size_t block,
+                      size_t blocks) {
+  const size_t left = ctx->total[0] & 0x3F;
+  const size_t end = left + length;
+  const size_t start = block * 64;
+  size_t from = 0, to = 0;
+
+  memset(out, 0, 64);
+
+  if (start < left) {
+    to = left < start + 64 ? left : start + 64;
+    memcpy(out, ctx->buffer + start, to - start);
+  }
+  from = start > left ? start : left;
+  to = end < start + 64 ? end : start + 64;
+  if (from < to) {
+    memcpy(out + (from - start), input + (from - left), to - from);
+  }
+  if (end >= start && end < start + 64) {
+    out[end - start] = 0x80;
+  }
+  if (block == blocks - 1) {
+    uint64_t bits = ((((uint64_t)ctx->total[1] << 32) | ctx->total[0]) +
+                     length) << 3;
+
+    PUT_UINT32((uint32_t)(bits >> 32), out, 56);
+    PUT_UINT32((uint32_t)bits, out, 60);
+  }
+}
+
+#ifdef SHA256_X86
+static void finishAvx2x8(sha256_context* ctx, uint8* const input[],
+                         const uint32 length[], uint8 digest[][32],
+                         size_t count) {
+  uint32_t state[8][SHA256_LANES];
+  uint8 blocks[SHA256_LANES][64];
+  size_t laneBlocks[SHA256_LANES];
+  size_t maxBlocks = 0;
+  size_t block = 0;
+  size_t lane = 0;
+  int i = 0;
+
+  for (lane = 0; lane < SHA256_LANES; lane++) {
+    const size_t n = lane < count ? lane : 0;
+    const size_t end = (ctx[n].total[0] & 0x3F) + length[n];
+
+    laneBlocks[lane] = lane < count ? (end + 8) / 64 + 1 : 0;
+    if (laneBlocks[lane] > maxBlocks) maxBlocks = laneBlocks[lane];
+    for (i = 0; i < 8; i++) state[i][lane] = ctx[n].state[i];
+  }
+
+  for (block = 0; block < maxBlocks; block++) {
+    for (lane = 0; lane < SHA256_LANES; lane++) {
+      if (block < laneBlocks[lane]) {
+        laneBlock(blocks[lane], &ctx[lane], input[lane], length[lane], block,
+                  laneBlocks[lane]);
+      } else {
+        memset(blocks[lane], 0, 64);
+      }
+    }
+
+    processAvx2x8(state, (const uint8(*)[64])blocks);
+
+    for (lane = 0; lane < count; lane++) {
+      if (block != laneBlocks[lane] - 1) continue;
+
+      for (i = 0; i < 8; i++) {
+        PUT_UINT32(state[i][lane], digest[lane], i * 4);
+      }
+    }
+  }
+}
+#endif
+
+void sha256_finish_multi(sha256_context* ctx, uint8* const input[],
+                         const uint32 length[], uint8 digest[][32],
+                         size_t count) {
+  size_t i = 0;
+
+#ifdef SHA256_X86
+  if (getKernel() == SHA256_KERNEL_AVX2) {
+    for (; i + 1 < count; i += SHA256_LANES) {
+      const size_t lanes = count - i < SHA256_LANES ? count - i : SHA256_LANES;
+
+      finishAvx2x8(&ctx[i], &input[i], &length[i], &digest[i], lanes);
+    }
+  }
+#endif
+
+  for (; i < count; i++) {
+    sha256_update(&ctx[i], input[i], length[i]);
+    sha256_finish(&ctx[i], digest[i]);
+  }
+}
+
 int calculateSHA256Digest(char* msg, char* hash, const char* sessionkey) {
   sha256_context Context;
   unsigned char keyBin[KEY_SIZE + 1];
@@ -318,13 +602,18 @@ int calculateSHA256Digest(char* msg, char* hash, const char* sessionkey) {
   sha256_starts(&Context);
   memset(keyBin, 0, sizeof(keyBin));
 
-  hex2bin(sessionkey, (char*)keyBin, KEY_SIZE);
+  if (strlen(sessionkey) < KEY_SIZE * 2 ||
+      hexDecode(keyBin, sessionkey, KEY_SIZE * 2) < 0) {
+    hash[0] = '\0';
+    return 0;
+  }
 
   sha256_update(&Context, keyBin, KEY_SIZE);
   sha256_update(&Context, (unsigned char*)msg, strlen(msg));
   sha256_finish(&Context, digest);
 
-  binTohex(digest, hash, KEY_SIZE + KEY_SIZE);
+  hexEncode(hash, digest, KEY_SIZE + KEY_SIZE, HEX_CASE_UPPER);
+  hash[(KEY_SIZE + KEY_SIZE) * 2] = '\0';
 
   return 1;
 }
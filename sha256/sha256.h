@@ -5,14 +5,29 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef uint8
-#define uint8 unsigned char
+#define uint8 uint8_t
 #endif
 
 #ifndef uint32
-#define uint32 unsigned long int
+#define uint32 uint32_t
 #endif
 
+/**
+ * Block function used by the functions below, picked at runtime. SHA-NI is
+ * the x86 SHA extensions; AVX2 hashes 8 messages at once and only speeds up
+ * sha256_finish_multi.
+ */
+typedef enum {
+  SHA256_KERNEL_AUTO,
+  SHA256_KERNEL_SCALAR,
+  SHA256_KERNEL_SHANI,
+  SHA256_KERNEL_AVX2,
+} sha256_kernel;
+
 typedef struct {
   uint32 total[2];
   uint32 state[8];
@@ -22,6 +37,23 @@ typedef struct {
 void sha256_starts(sha256_context* ctx);
 void sha256_update(sha256_context* ctx, uint8* input, uint32 length);
 void sha256_finish(sha256_context* ctx, uint8 digest[32]);
+
+/**
+ * Same as sha256_update(&ctx[i], input[i], length[i]) then
+ * sha256_finish(&ctx[i], digest[i]) for every i < count, e.g. to MAC a batch
+ * of messages with copies of one keyed context. The contexts are used up.
+ */
+void sha256_finish_multi(sha256_context* ctx, uint8* const input[],
+                         const uint32 length[], uint8 digest[][32],
+                         size_t count);
+
+/**
+ * Select the kernel, SHA256_KERNEL_AUTO for the best one the CPU has. A
+ * kernel the CPU doesn't have falls back to scalar. Returns the kernel now in
+ * use. Safe while other threads hash, every kernel gives the same digest.
+ */
+sha256_kernel sha256_select(sha256_kernel kernel);
+const char* sha256_kernel_name(sha256_kernel kernel);
 // void GetHashValue(char* pcData[], char* ReturnBuffer);
 int calculateSHA256Digest(char* msg, char* hash, const char* sessionkey);
 
@@ -8,10 +8,115 @@
  * @copyright Copyright (c) 2023
  *
  */
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "handshake_internals.h"
 
+const HandshakeOperationStep
+    handshakeOperationSteps[HANDSHAKE_OPERATION_STEPS_COUNT] = {
+        {HANDSHAKE_OPERATIONS_MASTER_KEY, HANDSHAKE_OPERATIONS_NONE,
+         offsetof(HandshakeOperations, getMasterKey),
+         "Error Getting Master Key"},
+        {HANDSHAKE_OPERATIONS_SESSION_KEY, HANDSHAKE_OPERATIONS_MASTER_KEY,
+         offsetof(HandshakeOperations, getSessionKey),
+         "Error Getting Session Key"},
+        {HANDSHAKE_OPERATIONS_PIN_KEY, HANDSHAKE_OPERATIONS_SESSION_KEY,
+         offsetof(HandshakeOperations, getPinKey), "Error Getting PIN Key"},
+        {HANDSHAKE_OPERATIONS_PARAMETER, HANDSHAKE_OPERATIONS_SESSION_KEY,
+         offsetof(HandshakeOperations, getParameters),
+         "Error Getting Parameters"},
+        {HANDSHAKE_OPERATIONS_CALLHOME, HANDSHAKE_OPERATIONS_SESSION_KEY,
+         offsetof(HandshakeOperations, doCallHome), "Error Doing Call Home"},
+        {HANDSHAKE_OPERATIONS_CAPK, HANDSHAKE_OPERATIONS_SESSION_KEY,
+         offsetof(HandshakeOperations, getCapk), "Error Getting CAPK"},
+        {HANDSHAKE_OPERATIONS_AID, HANDSHAKE_OPERATIONS_SESSION_KEY,
+         offsetof(HandshakeOperations, getAid), "Error Getting AID"},
+};
+
+/**
+ * @brief An operation run on its own copy of the handshake, concurrently
+ * with the other operations of its wave
+ * @handshake: copy the operation runs on
+ * @step: operation
+ * @run: its bound function
+ * @result: EXIT_SUCCESS or EXIT_FAILURE
+ * @thread: thread running it
+ * @started: `thread` was created
+ *
+ */
+typedef struct HandshakeOperationTask {
+  Handshake_t handshake;
+  const HandshakeOperationStep* step;
+  GetNetworkManagementData run;
+  short result;
+  pthread_t thread;
+  short started;
+} HandshakeOperationTask;
+
+/**
+ * @brief Get the function bound for an operation step
+ *
+ * @param handshakeInternals
+ * @param step
+ * @return GetNetworkManagementData
+ */
+GetNetworkManagementData getOperationFunction(
+    const HandshakeOperations* handshakeInternals,
+    const HandshakeOperationStep* step) {
+  return *(const GetNetworkManagementData*)((const char*)handshakeInternals +
+                                            step->offset);
+}
+
+/**
+ * @brief Get monotonic time in milliseconds
+ *
+ * @return long
+ */
+static long monotonicMs(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * @brief Get what is left of the handshake's `deadlineMs`, the timeout of its
+ * next exchange
+ *
+ * @param handshake
+ * @return int `DEFAULT_TIMEOUT` without a budget, 0 once it ran out
+ */
+int handshakeRemainingMs(const Handshake_t* handshake) {
+  long remaining = 0;
+
+  if (!handshake->deadlineAt) return DEFAULT_TIMEOUT;
+
+  remaining = handshake->deadlineAt - monotonicMs();
+  if (remaining <= 0) return 0;
+
+  return remaining < DEFAULT_TIMEOUT ? (int)remaining : DEFAULT_TIMEOUT;
+}
+
+/**
+ * @brief Fail the handshake with `ERROR_CODE_HANDSHAKE_DEADLINE_EXCEEDED` if
+ * its `deadlineMs` ran out
+ *
+ * @param handshake
+ * @return short 1 if it ran out
+ */
+short checkHandshakeDeadline(Handshake_t* handshake) {
+  if (handshakeRemainingMs(handshake)) return 0;
+
+  handshake->error.code = ERROR_CODE_HANDSHAKE_DEADLINE_EXCEEDED;
+  log_err("Handshake deadline of %ldms exceeded", handshake->deadlineMs);
+  snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
+           "Handshake deadline of %ldms exceeded", handshake->deadlineMs);
+  return 1;
+}
+
 /**
  * @brief Check if the device data in the handshake matches the expected format.
  *
@@ -90,8 +195,10 @@ static short validateHandshakeData(Handshake_t* handshake) {
  *
  * @param handshake A pointer to the Handshake_t struct to be initialized.
  */
-static void Handshake_Init(Handshake_t* handshake) {
+void Handshake_Init(Handshake_t* handshake) {
   handshake->error.code = ERROR_CODE_HANDSHAKE_INIT_ERROR;
+  handshake->deadlineAt =
+      handshake->deadlineMs > 0 ? monotonicMs() + handshake->deadlineMs : 0;
 
   check(validateHandshakeData(handshake) == EXIT_SUCCESS,
         "Error Validating `handshake`");
@@ -118,57 +225,237 @@ error:
  *
  * @param handshakeInternals The Handshake internals to bind the platform to.
  */
-static void bindPlatform(HandshakeOperations* handshakeInternals,
-                         Platform platform) {
+void bindPlatform(HandshakeOperations* handshakeInternals, Platform platform) {
   if (platform == PLATFORM_NIBSS) {
     bindNibss(handshakeInternals);
   }
 }
 
 /**
- * @brief Runs the handshake process.
+ * @brief Borrow a connection to `handshakeHost` if the handshake reuses
+ * connections and has none. A custom `comSendReceive` does its own
+ * connecting, it gets no connection and is called for every exchange. The
+ * default pool is read once, the connection goes back to that pool even if
+ * the default changes meanwhile.
  *
- * @param handshake A pointer to the Handshake_t struct.
+ * @param handshake
  */
-static void Handshake_Run(Handshake_t* handshake) {
-  handshake->error.code = ERROR_CODE_HANDSHAKE_RUN_ERROR;
-  HandshakeOperations handshakeInternals = {0};
+static void acquireComsSession(Handshake_t* handshake) {
+  if (!handshake->reuseConnection || handshake->comsSession ||
+      handshake->comSendReceive != comSendReceive) {
+    return;
+  }
 
-  bindPlatform(&handshakeInternals, handshake->platform);
+  handshake->comsPool = comsGetDefaultPool();
+  handshake->comsSession =
+      comsPoolAcquire(handshake->comsPool, &handshake->handshakeHost,
+                      handshakeRemainingMs(handshake));
+}
 
-  if (handshake->operations & HANDSHAKE_OPERATIONS_MASTER_KEY) {
-    check(handshakeInternals.getMasterKey(handshake) == EXIT_SUCCESS,
-          "Error Getting Master Key");
+/**
+ * @brief Give the handshake's connection back to the pool it came from
+ *
+ * @param handshake
+ */
+static void releaseComsSession(Handshake_t* handshake) {
+  comsPoolRelease(handshake->comsPool, handshake->comsSession);
+  handshake->comsSession = NULL;
+  handshake->comsPool = NULL;
+}
+
+/**
+ * @brief Run an operation task, on its own pooled connection if the
+ * handshake reuses connections
+ *
+ * @param arg HandshakeOperationTask
+ * @return void*
+ */
+static void* runOperationTask(void* arg) {
+  HandshakeOperationTask* task = (HandshakeOperationTask*)arg;
+  Handshake_t* handshake = &task->handshake;
+
+  acquireComsSession(handshake);
+  task->result = task->run(handshake);
+  releaseComsSession(handshake);
+
+  macSessionDestroy(handshake->macSession);
+  handshake->macSession = NULL;
+
+  return NULL;
+}
+
+/**
+ * @brief Copy what an operation stored in its copy of the handshake back
+ *
+ * @param handshake
+ * @param task
+ */
+static void mergeOperationTask(Handshake_t* handshake,
+                               const HandshakeOperationTask* task) {
+  NetworkManagementResponse* into = &handshake->networkManagementResponse;
+  const NetworkManagementResponse* from =
+      &task->handshake.networkManagementResponse;
+
+  if (task->result != EXIT_SUCCESS) {
+    if (handshake->error.code == ERROR_CODE_HANDSHAKE_RUN_ERROR &&
+        !handshake->error.message[0]) {
+      memcpy(&handshake->error, &task->handshake.error, sizeof(Error));
+    }
+    return;
+  }
+
+  memcpy(into->responseCode, from->responseCode, sizeof(into->responseCode));
+  if (task->step->operation == HANDSHAKE_OPERATIONS_PIN_KEY) {
+    memcpy(&into->pin, &from->pin, sizeof(Key));
+  } else if (task->step->operation == HANDSHAKE_OPERATIONS_PARAMETER) {
+    memcpy(&into->parameters, &from->parameters, sizeof(Parameters));
+  }
+}
+
+/**
+ * @brief Run a wave of operations on the handshake one after the other, on
+ * its pooled connection if it reuses connections
+ *
+ * @param handshake
+ * @param handshakeInternals
+ * @param steps
+ * @param count
+ * @return short EXIT_SUCCESS if all succeeded
+ */
+static short runOperationsInOrder(Handshake_t* handshake,
+                                  const HandshakeOperations* handshakeInternals,
+                                  const HandshakeOperationStep** steps,
+                                  size_t count) {
+  size_t i = 0;
+
+  acquireComsSession(handshake);
+
+  for (i = 0; i < count; i++) {
+    if (getOperationFunction(handshakeInternals, steps[i])(handshake) !=
+        EXIT_SUCCESS) {
+      log_err("%s", steps[i]->errorMessage);
+      return EXIT_FAILURE;
+    }
   }
-  if (handshake->operations & HANDSHAKE_OPERATIONS_SESSION_KEY) {
-    check(handshakeInternals.getSessionKey(handshake) == EXIT_SUCCESS,
-          "Error Getting Session Key");
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Run a wave of operations that don't depend on each other. With
+ * `concurrentOperations` each runs on a copy of the handshake in its own
+ * thread and their results are merged in step order, otherwise they run in
+ * order on the handshake.
+ *
+ * @param handshake
+ * @param handshakeInternals
+ * @param steps
+ * @param count
+ * @return short EXIT_SUCCESS if all succeeded
+ */
+static short runOperationWave(Handshake_t* handshake,
+                              const HandshakeOperations* handshakeInternals,
+                              const HandshakeOperationStep** steps,
+                              size_t count) {
+  HandshakeOperationTask* tasks = NULL;
+  short ret = EXIT_SUCCESS;
+  size_t i = 0;
+
+  if (count == 1 || !handshake->concurrentOperations) {
+    return runOperationsInOrder(handshake, handshakeInternals, steps, count);
   }
-  if (handshake->operations & HANDSHAKE_OPERATIONS_PIN_KEY) {
-    check(handshakeInternals.getPinKey(handshake) == EXIT_SUCCESS,
-          "Error Getting PIN Key");
+
+  // hand the connection back so a task can take it, holding it would leave
+  // the tasks one short against a pool with a small maxPerHost
+  releaseComsSession(handshake);
+
+  tasks = (HandshakeOperationTask*)calloc(count, sizeof(*tasks));
+  if (tasks == NULL) {
+    log_err("Out of memory.");
+    return EXIT_FAILURE;
   }
-  if (handshake->operations & HANDSHAKE_OPERATIONS_PARAMETER) {
-    check(handshakeInternals.getParameters(handshake) == EXIT_SUCCESS,
-          "Error Getting Parameters");
+
+  for (i = 0; i < count; i++) {
+    memcpy(&tasks[i].handshake, handshake, sizeof(Handshake_t));
+    tasks[i].handshake.comsSession = NULL;
+    tasks[i].handshake.comsPool = NULL;
+    tasks[i].handshake.macSession = NULL;
+    tasks[i].step = steps[i];
+    tasks[i].run = getOperationFunction(handshakeInternals, steps[i]);
+    tasks[i].started = pthread_create(&tasks[i].thread, NULL,
+                                      runOperationTask, &tasks[i]) == 0;
+    if (!tasks[i].started) runOperationTask(&tasks[i]);
   }
-  if (handshake->operations & HANDSHAKE_OPERATIONS_CALLHOME) {
-    check(handshakeInternals.doCallHome(handshake) == EXIT_SUCCESS,
-          "Error Doing Call Home");
+
+  for (i = 0; i < count; i++) {
+    if (tasks[i].started) pthread_join(tasks[i].thread, NULL);
+    if (tasks[i].result != EXIT_SUCCESS) {
+      log_err("%s", steps[i]->errorMessage);
+      ret = EXIT_FAILURE;
+    }
+    mergeOperationTask(handshake, &tasks[i]);
   }
-  if (handshake->operations & HANDSHAKE_OPERATIONS_CAPK) {
-    check(handshakeInternals.getCapk(handshake) == EXIT_SUCCESS,
-          "Error Getting CAPK");
+
+  free(tasks);
+  return ret;
+}
+
+/**
+ * @brief Runs the handshake process. Operations run in waves, each wave the
+ * ones whose `dependsOn` are done, so with `concurrentOperations` PIN key,
+ * parameters, call home, CAPK and AID are exchanged concurrently after the
+ * session key.
+ *
+ * @param handshake A pointer to the Handshake_t struct.
+ */
+static void Handshake_Run(Handshake_t* handshake) {
+  handshake->error.code = ERROR_CODE_HANDSHAKE_RUN_ERROR;
+  HandshakeOperations handshakeInternals = {0};
+  const HandshakeOperationStep* wave[HANDSHAKE_OPERATION_STEPS_COUNT];
+  HandshakeOperationBitmap pending = HANDSHAKE_OPERATIONS_NONE;
+  size_t count = 0;
+  size_t i = 0;
+
+  bindPlatform(&handshakeInternals, handshake->platform);
+
+  handshake->comsSession = NULL;
+  handshake->comsPool = NULL;
+  handshake->macSession = NULL;
+
+  for (i = 0; i < HANDSHAKE_OPERATION_STEPS_COUNT; i++) {
+    pending |= handshakeOperationSteps[i].operation & handshake->operations;
   }
-  if (handshake->operations & HANDSHAKE_OPERATIONS_CAPK) {
-    check(handshakeInternals.getAid(handshake) == EXIT_SUCCESS,
-          "Error Getting AID");
+
+  while (pending) {
+    check(!checkHandshakeDeadline(handshake), "Handshake deadline exceeded");
+
+    for (i = 0, count = 0; i < HANDSHAKE_OPERATION_STEPS_COUNT; i++) {
+      const HandshakeOperationStep* step = &handshakeOperationSteps[i];
+
+      if ((pending & step->operation) && !(pending & step->dependsOn)) {
+        wave[count++] = step;
+      }
+    }
+    check(count, "Operations %#x depend on each other", pending);
+
+    check(runOperationWave(handshake, &handshakeInternals, wave, count) ==
+              EXIT_SUCCESS,
+          "Handshake Run Error");
+    for (i = 0; i < count; i++) {
+      pending &= ~wave[i]->operation;
+    }
   }
 
   handshake->error.code = ERROR_CODE_NO_ERROR;
   memset(handshake->error.message, '\0', sizeof(handshake->error.message));
 error:
-  return;
+  if (handshake->error.code != ERROR_CODE_NO_ERROR) {
+    // an exchange cut short by the budget failed because of it
+    checkHandshakeDeadline(handshake);
+  }
+  releaseComsSession(handshake);
+  macSessionDestroy(handshake->macSession);
+  handshake->macSession = NULL;
 }
 
 /**
@@ -183,6 +470,9 @@ void Handshake(Handshake_t* handshake) {
 
   if (handshake->shouldGetDeviceConfig) {
     Handshake_GetDeviceConfig(handshake);
+    if (handshake->error.code == ERROR_CODE_HANDSHAKE_MAPTID_ERROR) {
+      checkHandshakeDeadline(handshake);
+    }
     check(handshake->error.code == ERROR_CODE_NO_ERROR, "%s",
           handshake->error.message);
   }
@@ -203,6 +203,22 @@ typedef struct NetworkManagementResponse {
  * @comSendReceive: send and receive function pointer
  * @getCallHomeData: get call home data function pointer
  * @comSentinel: com sentinel function pointer
+ * @reuseConnection: keep one connection to `handshakeHost` open for all
+ * operations of a run instead of connecting per operation. Only applies with
+ * the built-in `comSendReceive`, any other is still called for every exchange.
+ * @concurrentOperations: run operations that don't depend on each other, e.g.
+ * PIN key, parameters and CAPK, at the same time, each on its own thread and,
+ * with `reuseConnection`, its own pooled connection. `comSendReceive`,
+ * `getCallHomeData` and `comSentinel` are then called from several threads at
+ * once and must be thread safe.
+ * @deadlineMs: budget of the whole handshake in milliseconds, each exchange
+ * gets what is left of it. 0 for no budget, each exchange then gets
+ * `DEFAULT_TIMEOUT`.
+ * @comsSession: connection kept open while running, managed internally
+ * @comsPool: pool `comsSession` was lent by and goes back to, managed
+ * internally
+ * @macSession: MAC state of the session key while running, managed internally
+ * @deadlineAt: monotonic time `deadlineMs` runs out, managed internally
  * @error: error
  *
  */
@@ -216,6 +232,9 @@ typedef struct Handshake_t {
 
   // enums
   short shouldGetDeviceConfig;
+  short reuseConnection;
+  short concurrentOperations;
+  long deadlineMs;
   HandshakeOperationBitmap operations;
   Platform platform;
 
@@ -234,18 +253,97 @@ typedef struct Handshake_t {
   GetCallHomeData getCallHomeData;
   ComSentinel comSentinel;
 
+  // connection
+  ComsSession* comsSession;
+  ComsPool* comsPool;
+  MacSession* macSession;
+  long deadlineAt;
+
   Error error;
 } Handshake_t;
 
 #define HANDSHAKE_INIT_DATA {'\0'}
 
+#define HANDSHAKE_BATCH_DEFAULT_WORKERS 16
+#define HANDSHAKE_BATCH_MAX_WORKERS 256
+
+/**
+ * @brief Function pointer called when a terminal in a batch is done. It is
+ * called from the worker threads, so it must be thread safe.
+ *
+ */
+typedef void (*HandshakeBatchCallback)(Handshake_t* handshake, size_t index,
+                                       void* userData);
+
+/**
+ * @brief Handshake batch options
+ * @workers: number of worker threads, `HANDSHAKE_BATCH_DEFAULT_WORKERS` if 0
+ * @onComplete: completion callback, optional
+ * @userData: passed to `onComplete`
+ *
+ */
+typedef struct HandshakeBatchOptions {
+  size_t workers;
+  HandshakeBatchCallback onComplete;
+  void* userData;
+} HandshakeBatchOptions;
+
+/**
+ * @brief Handshake batch stats
+ * @total: number of terminals in the batch
+ * @succeeded: terminals with `ERROR_CODE_NO_ERROR`
+ * @skipped: terminals with `ERROR_CODE_ALREADY_INITIALIZED`
+ * @failed: terminals with any other error
+ * @elapsedMs: wall time of the batch
+ *
+ */
+typedef struct HandshakeBatchStats {
+  size_t total;
+  size_t succeeded;
+  size_t skipped;
+  size_t failed;
+  long elapsedMs;
+} HandshakeBatchStats;
+
 void logTMSResponse(const TMSResponse* tmsResponse);
 void logKey(const Key* key, const char* title);
 void logParameter(Parameters* parameters);
 void logNetworkManagementResponse(
     NetworkManagementResponse* networkManagementResponse);
 
+/**
+ * @brief Handshake run as a resumable state machine on a non-blocking socket,
+ * so one event loop can drive many handshakes. Wait for
+ * `HandshakeCtx_WantedEvents` (`ComsEvent` bits) on `HandshakeCtx_Fd` and
+ * report them with `HandshakeCtx_OnReadable`/`HandshakeCtx_OnWritable` until
+ * `HandshakeCtx_IsDone`; the result is in the handshake's `error`. The fd may
+ * change between operations, re-register it after every call.
+ *
+ * Also wait no longer than `HandshakeCtx_TimeoutMs` and report the timeout
+ * with either callback. Like a blocking exchange, each exchange gets what is
+ * left of `deadlineMs`, or `DEFAULT_TIMEOUT` without one; past `deadlineMs`
+ * the handshake fails with `ERROR_CODE_HANDSHAKE_DEADLINE_EXCEEDED`.
+ *
+ * Exchanges use the built-in comms, `comSendReceive` and `reuseConnection` are
+ * ignored. Resolve `handshakeHost` and `callHomeHost` with `comsResolveHost`
+ * beforehand, a DNS cache miss blocks the event loop. `shouldGetDeviceConfig`
+ * is not supported, get the device config with `Handshake` first.
+ *
+ */
+typedef struct HandshakeCtx HandshakeCtx;
+
 void Handshake(Handshake_t* handshake);
+HandshakeBatchStats HandshakeBatch(Handshake_t* items, size_t n,
+                                   const HandshakeBatchOptions* options);
+
+HandshakeCtx* HandshakeCtx_Start(Handshake_t* handshake);
+int HandshakeCtx_Fd(const HandshakeCtx* ctx);
+int HandshakeCtx_WantedEvents(const HandshakeCtx* ctx);
+int HandshakeCtx_TimeoutMs(const HandshakeCtx* ctx);
+void HandshakeCtx_OnReadable(HandshakeCtx* ctx);
+void HandshakeCtx_OnWritable(HandshakeCtx* ctx);
+short HandshakeCtx_IsDone(const HandshakeCtx* ctx);
+void HandshakeCtx_Free(HandshakeCtx* ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,178 @@
+/**
+ * @file handshake_batch.c
+ * @author Elijah Balogun (elijah.balogun@cyberpay.net.ng)
+ * @brief Implements Handshake Batch
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "handshake_internals.h"
+
+/**
+ * @brief Shared state of a batch run, one per `HandshakeBatch` call
+ * @items: terminals to handshake
+ * @count: number of terminals
+ * @next: index of the next terminal to hand out
+ * @options: batch options
+ * @stats: aggregate stats
+ * @lock: guards `next` and `stats`
+ *
+ */
+typedef struct HandshakeBatchState {
+  Handshake_t* items;
+  size_t count;
+  size_t next;
+  const HandshakeBatchOptions* options;
+  HandshakeBatchStats stats;
+  pthread_mutex_t lock;
+} HandshakeBatchState;
+
+/**
+ * @brief Get monotonic time in milliseconds
+ *
+ * @return long
+ */
+static long monotonicMs(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * @brief Take the index of the next terminal to handshake
+ *
+ * @param state
+ * @param index
+ * @return short 1 if an index was taken, 0 when the batch is drained
+ */
+static short takeNextItem(HandshakeBatchState* state, size_t* index) {
+  short taken = 0;
+
+  pthread_mutex_lock(&state->lock);
+  if (state->next < state->count) {
+    *index = state->next++;
+    taken = 1;
+  }
+  pthread_mutex_unlock(&state->lock);
+
+  return taken;
+}
+
+/**
+ * @brief Record the outcome of a terminal's handshake
+ *
+ * @param state
+ * @param handshake
+ */
+static void recordResult(HandshakeBatchState* state,
+                         const Handshake_t* handshake) {
+  pthread_mutex_lock(&state->lock);
+  if (handshake->error.code == ERROR_CODE_NO_ERROR) {
+    state->stats.succeeded++;
+  } else if (handshake->error.code == ERROR_CODE_ALREADY_INITIALIZED) {
+    state->stats.skipped++;
+  } else {
+    state->stats.failed++;
+  }
+  pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * @brief Worker thread, handshakes terminals until the batch is drained
+ *
+ * @param arg HandshakeBatchState
+ * @return void*
+ */
+static void* batchWorker(void* arg) {
+  HandshakeBatchState* state = (HandshakeBatchState*)arg;
+  size_t index = 0;
+
+  while (takeNextItem(state, &index)) {
+    Handshake_t* handshake = &state->items[index];
+
+    Handshake(handshake);
+    recordResult(state, handshake);
+
+    if (state->options && state->options->onComplete) {
+      state->options->onComplete(handshake, index, state->options->userData);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Get the number of workers to spawn for a batch
+ *
+ * @param options
+ * @param count
+ * @return size_t
+ */
+static size_t getWorkerCount(const HandshakeBatchOptions* options,
+                             size_t count) {
+  size_t workers = HANDSHAKE_BATCH_DEFAULT_WORKERS;
+
+  if (options && options->workers) {
+    workers = options->workers;
+  }
+  if (workers > HANDSHAKE_BATCH_MAX_WORKERS) {
+    workers = HANDSHAKE_BATCH_MAX_WORKERS;
+  }
+
+  return workers > count ? count : workers;
+}
+
+/**
+ * @brief Performs handshakes for a batch of terminals on a pool of worker
+ * threads.
+ *
+ * @param items terminals to handshake
+ * @param n number of terminals
+ * @param options batch options, may be NULL
+ * @return HandshakeBatchStats
+ */
+HandshakeBatchStats HandshakeBatch(Handshake_t* items, size_t n,
+                                   const HandshakeBatchOptions* options) {
+  HandshakeBatchState state;
+  pthread_t threads[HANDSHAKE_BATCH_MAX_WORKERS];
+  size_t workers = 0;
+  size_t spawned = 0;
+  size_t i = 0;
+  long start = monotonicMs();
+
+  memset(&state, '\0', sizeof(state));
+  state.items = items;
+  state.count = items ? n : 0;
+  state.options = options;
+  state.stats.total = state.count;
+  pthread_mutex_init(&state.lock, NULL);
+
+  workers = getWorkerCount(options, state.count);
+  for (spawned = 0; spawned < workers; spawned++) {
+    if (pthread_create(&threads[spawned], NULL, batchWorker, &state) != 0) {
+      log_err("Unable to start batch worker %zu", spawned);
+      break;
+    }
+  }
+
+  // no thread could be started, drain the batch on the caller's thread
+  if (!spawned) {
+    batchWorker(&state);
+  }
+
+  for (i = 0; i < spawned; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&state.lock);
+  state.stats.elapsedMs = monotonicMs() - start;
+
+  return state.stats;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file handshake_ctx.c
+ * @author Elijah Balogun (elijah.balogun@cyberpay.net.ng)
+ * @brief Implements non-blocking Handshake
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "handshake_internals.h"
+
+/**
+ * @brief Non-blocking handshake
+ * @handshake: handshake being run
+ * @handshakeInternals: platform operations
+ * @step: index in `handshakeOperationSteps` of the running operation
+ * @coms: exchange of the running operation
+ * @exchangeDeadlineAt: monotonic time the running exchange times out, what
+ * was left of `deadlineMs` or `DEFAULT_TIMEOUT` when it started
+ * @done: handshake finished, `handshake->error` holds the result
+ *
+ */
+struct HandshakeCtx {
+  Handshake_t* handshake;
+  HandshakeOperations handshakeInternals;
+  size_t step;
+  ComsAsync* coms;
+  long exchangeDeadlineAt;
+  short done;
+};
+
+/**
+ * @brief Get monotonic time in milliseconds
+ *
+ * @return long
+ */
+static long monotonicMs(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * @brief Finish the handshake and release its connection
+ *
+ * @param ctx
+ * @param succeeded
+ */
+static void finishHandshake(HandshakeCtx* ctx, short succeeded) {
+  if (succeeded) {
+    ctx->handshake->error.code = ERROR_CODE_NO_ERROR;
+    memset(ctx->handshake->error.message, '\0',
+           sizeof(ctx->handshake->error.message));
+  }
+  if (ctx->coms) {
+    comsAsyncClose(ctx->coms);
+  }
+  macSessionDestroy(ctx->handshake->macSession);
+  ctx->handshake->macSession = NULL;
+  ctx->done = 1;
+}
+
+/**
+ * @brief Set the error message of a failed handshake unless an operation has
+ *
+ * @param handshake
+ * @param message
+ */
+static void setHandshakeError(Handshake_t* handshake, const char* message) {
+  if (handshake->error.message[0]) return;
+
+  snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
+           "%s", message);
+}
+
+/**
+ * @brief Run operations until one waits on the network or all are done
+ *
+ * @param ctx
+ * @param status exchange status of the running operation, pending if no
+ * operation is running
+ */
+static void runSteps(HandshakeCtx* ctx, ComsAsyncStatus status) {
+  Handshake_t* handshake = ctx->handshake;
+  const HandshakeOperationStep* step = NULL;
+  HandshakeRequest request;
+  NetworkBuffer response = {{'\0'}, 0};
+
+  while (1) {
+    if (status == COMS_ASYNC_PENDING) {
+      while (ctx->step < HANDSHAKE_OPERATION_STEPS_COUNT &&
+             !(handshake->operations &
+               handshakeOperationSteps[ctx->step].operation)) {
+        ctx->step++;
+      }
+      if (ctx->step == HANDSHAKE_OPERATION_STEPS_COUNT) {
+        finishHandshake(ctx, 1);
+        return;
+      }
+      if (checkHandshakeDeadline(handshake)) {
+        finishHandshake(ctx, 0);
+        return;
+      }
+
+      step = &handshakeOperationSteps[ctx->step];
+      request.buffer.len = 0;
+      check(ctx->handshakeInternals.buildRequest(
+                handshake, step->operation, &request) == EXIT_SUCCESS,
+            "%s", step->errorMessage);
+      if (!request.buffer.len) {
+        ctx->step++;
+        continue;
+      }
+
+      ctx->exchangeDeadlineAt = monotonicMs() + handshakeRemainingMs(handshake);
+      status = comsAsyncStart(ctx->coms, request.host, &request.buffer,
+                              request.sentinel, NULL);
+      if (status == COMS_ASYNC_PENDING) return;
+    }
+
+    step = &handshakeOperationSteps[ctx->step];
+    if (status != COMS_ASYNC_DONE) {
+      log_err("%s: error sending or receiving request", step->errorMessage);
+      setHandshakeError(handshake, step->errorMessage);
+      goto error;
+    }
+
+    comsAsyncGetResponse(ctx->coms, &response);
+    check(ctx->handshakeInternals.parseResponse(handshake, step->operation,
+                                                &response) == EXIT_SUCCESS,
+          "%s", step->errorMessage);
+
+    ctx->step++;
+    status = COMS_ASYNC_PENDING;
+  }
+
+error:
+  setHandshakeError(handshake, "Handshake Run Error");
+  finishHandshake(ctx, 0);
+}
+
+/**
+ * @brief Progress the running exchange on a socket event
+ *
+ * @param ctx
+ */
+static void onSocketEvent(HandshakeCtx* ctx) {
+  ComsAsyncStatus status = COMS_ASYNC_PENDING;
+
+  if (ctx == NULL || ctx->done) return;
+
+  if (checkHandshakeDeadline(ctx->handshake)) {
+    finishHandshake(ctx, 0);
+    return;
+  }
+
+  if (monotonicMs() >= ctx->exchangeDeadlineAt) {
+    log_err("Exchange timed out");
+    status = COMS_ASYNC_FAILED;
+  } else {
+    status = comsAsyncProgress(ctx->coms);
+    if (status == COMS_ASYNC_PENDING) return;
+  }
+
+  runSteps(ctx, status);
+}
+
+/**
+ * @brief Validate a handshake and start its first operation. The returned
+ * context may already be done, e.g. if validation failed.
+ *
+ * @param handshake
+ * @return HandshakeCtx* NULL if out of memory
+ */
+HandshakeCtx* HandshakeCtx_Start(Handshake_t* handshake) {
+  HandshakeCtx* ctx = (HandshakeCtx*)calloc(1, sizeof(HandshakeCtx));
+
+  check_mem(ctx);
+  ctx->handshake = handshake;
+  handshake->macSession = NULL;
+
+  Handshake_Init(handshake);
+  check(handshake->error.code == ERROR_CODE_NO_ERROR, "Handshake Init Error");
+
+  if (handshake->shouldGetDeviceConfig) {
+    handshake->error.code = ERROR_CODE_HANDSHAKE_INIT_ERROR;
+    log_err("`shouldGetDeviceConfig` is not supported by HandshakeCtx");
+    snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
+             "`shouldGetDeviceConfig` is not supported by HandshakeCtx");
+    goto error;
+  }
+
+  handshake->error.code = ERROR_CODE_HANDSHAKE_RUN_ERROR;
+  bindPlatform(&ctx->handshakeInternals, handshake->platform);
+  if (!ctx->handshakeInternals.buildRequest ||
+      !ctx->handshakeInternals.parseResponse) {
+    log_err("Platform has no non-blocking operations");
+    snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
+             "Platform has no non-blocking operations");
+    goto error;
+  }
+
+  ctx->coms = comsAsyncCreate();
+  if (ctx->coms == NULL) {
+    setHandshakeError(handshake, "Out of memory");
+    goto error;
+  }
+
+  runSteps(ctx, COMS_ASYNC_PENDING);
+  return ctx;
+
+error:
+  if (ctx) {
+    finishHandshake(ctx, 0);
+  }
+  return ctx;
+}
+
+/**
+ * @brief Get the file descriptor to wait on
+ *
+ * @param ctx
+ * @return int -1 when done
+ */
+int HandshakeCtx_Fd(const HandshakeCtx* ctx) {
+  if (ctx == NULL || ctx->done) return -1;
+
+  return comsAsyncFd(ctx->coms);
+}
+
+/**
+ * @brief Get the `ComsEvent` bits to wait for
+ *
+ * @param ctx
+ * @return int
+ */
+int HandshakeCtx_WantedEvents(const HandshakeCtx* ctx) {
+  if (ctx == NULL || ctx->done) return COMS_EVENT_NONE;
+
+  return comsAsyncWantedEvents(ctx->coms);
+}
+
+/**
+ * @brief Get how long to wait for events at most
+ *
+ * @param ctx
+ * @return int milliseconds, -1 when done
+ */
+int HandshakeCtx_TimeoutMs(const HandshakeCtx* ctx) {
+  long remaining = 0;
+
+  if (ctx == NULL || ctx->done) return -1;
+
+  remaining = ctx->exchangeDeadlineAt - monotonicMs();
+  return remaining > 0 ? (int)remaining : 0;
+}
+
+/**
+ * @brief Report that the file descriptor is readable
+ *
+ * @param ctx
+ */
+void HandshakeCtx_OnReadable(HandshakeCtx* ctx) { onSocketEvent(ctx); }
+
+/**
+ * @brief Report that the file descriptor is writable
+ *
+ * @param ctx
+ */
+void HandshakeCtx_OnWritable(HandshakeCtx* ctx) { onSocketEvent(ctx); }
+
+/**
+ * @brief Check if the handshake is finished
+ *
+ * @param ctx
+ * @return short
+ */
+short HandshakeCtx_IsDone(const HandshakeCtx* ctx) {
+  return ctx == NULL || ctx->done;
+}
+
+/**
+ * @brief Free a context, closing its connection if still running
+ *
+ * @param ctx
+ */
+void HandshakeCtx_Free(HandshakeCtx* ctx) {
+  if (ctx == NULL) return;
+
+  comsAsyncDestroy(ctx->coms);
+  free(ctx);
+}
@@ -333,9 +333,10 @@ void Handshake_GetDeviceConfig(Handshake_t* handshake) {
   check(request.len > 0, "Error building request");
   debug("Request: '%s' (%ld)", request.data, request.len);
 
-  response.len = handshake->comSendReceive(&response, &request,
-                                           &handshake->deviceConfigHost,
-                                           DEFAULT_TIMEOUT, NULL, NULL);
+  check(!checkHandshakeDeadline(handshake), "Handshake deadline exceeded");
+  response.len = handshake->comSendReceive(
+      &response, &request, &handshake->deviceConfigHost,
+      handshakeRemainingMs(handshake), NULL, NULL);
   check(response.len > 0, "Error sending or receiving request");
   debug("Response: '%s (%ld)'", response.data, response.len);
 
@@ -31,6 +31,35 @@ extern "C" {
  */
 typedef short (*GetNetworkManagementData)(Handshake_t* handshake);
 
+/**
+ * @brief Request of one handshake operation
+ * @buffer: framed request, `len` 0 when the operation needs no exchange
+ * @host: host to send the request to
+ * @sentinel: tells when the response is complete
+ *
+ */
+typedef struct HandshakeRequest {
+  NetworkBuffer buffer;
+  Host* host;
+  ComSentinel sentinel;
+} HandshakeRequest;
+
+/**
+ * Function pointer type for a function that builds the request of
+ * `operation`, the first half of a GetNetworkManagementData.
+ */
+typedef short (*BuildHandshakeRequest)(Handshake_t* handshake,
+                                       HandshakeOperationBitmap operation,
+                                       HandshakeRequest* request);
+
+/**
+ * Function pointer type for a function that parses the response of
+ * `operation` into `handshake`, the second half of a GetNetworkManagementData.
+ */
+typedef short (*ParseHandshakeResponse)(Handshake_t* handshake,
+                                        HandshakeOperationBitmap operation,
+                                        NetworkBuffer* response);
+
 /**
  * @brief Struct containing function pointers for retrieving various network
  * management data.
@@ -50,9 +79,78 @@ typedef struct HandshakeOperations {
   GetNetworkManagementData getCapk;
   /**< Function pointer for retrieving the Aid. */
   GetNetworkManagementData getAid;
+  /**< Function pointer for building the request of an operation. */
+  BuildHandshakeRequest buildRequest;
+  /**< Function pointer for parsing the response of an operation. */
+  ParseHandshakeResponse parseResponse;
 } HandshakeOperations;
 
+/**
+ * @brief A handshake operation and where it is bound in HandshakeOperations
+ * @operation: operation bit
+ * @dependsOn: operations that must be done first, those not being performed
+ * are taken as done by an earlier run
+ * @offset: offset of its GetNetworkManagementData in HandshakeOperations
+ * @errorMessage: logged when the operation fails
+ *
+ */
+typedef struct HandshakeOperationStep {
+  HandshakeOperationBitmap operation;
+  HandshakeOperationBitmap dependsOn;
+  size_t offset;
+  const char* errorMessage;
+} HandshakeOperationStep;
+
+#define HANDSHAKE_OPERATION_STEPS_COUNT 7
+
+/**
+ * Operations in an order that satisfies their `dependsOn`, each one may depend
+ * on the keys of the ones before it.
+ */
+extern const HandshakeOperationStep
+    handshakeOperationSteps[HANDSHAKE_OPERATION_STEPS_COUNT];
+
+GetNetworkManagementData getOperationFunction(
+    const HandshakeOperations* handshakeInternals,
+    const HandshakeOperationStep* step);
+
+int handshakeRemainingMs(const Handshake_t* handshake);
+short checkHandshakeDeadline(Handshake_t* handshake);
+
+#define PRIVATE_FIELD_TAG_WIDTH 2
+#define PRIVATE_FIELD_LEN_WIDTH 3
+#define PRIVATE_FIELD_HEADER_WIDTH \
+  (PRIVATE_FIELD_TAG_WIDTH + PRIVATE_FIELD_LEN_WIDTH)
+#define PRIVATE_FIELD_MAX_LEN 999
+
+/**
+ * @brief Tag of a NIBSS private field (DE 62/63), a sequence of 2 digit tags,
+ * 3 digit lengths and values, and the char array member of a record it maps
+ * to
+ * @tag: tag
+ * @offset: offset of the member in the record
+ * @size: size of the member
+ *
+ */
+typedef struct PrivateFieldTag {
+  int tag;
+  size_t offset;
+  size_t size;
+} PrivateFieldTag;
+
+#define PRIVATE_FIELD_TAG(tag, type, member) \
+  { (tag), offsetof(type, member), sizeof(((type*)0)->member) }
+
+int parsePrivateField(void* record, const PrivateFieldTag* tags,
+                      const size_t count, const char* data,
+                      const size_t size);
+int buildPrivateField(char* buf, const size_t size, const void* record,
+                      const PrivateFieldTag* tags, const size_t count);
+
 void bindNibss(HandshakeOperations* handshakeInternals);
+void bindPlatform(HandshakeOperations* handshakeInternals, Platform platform);
+
+void Handshake_Init(Handshake_t* handshake);
 
 void Handshake_GetDeviceConfig(Handshake_t* handshake);
 
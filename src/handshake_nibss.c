@@ -13,6 +13,9 @@
 
 #include "handshake_internals.h"
 
+// room for an IsoMsg and the fields of a network management request
+#define ISO_ARENA_SIZE 0x1000
+
 /**
  * @brief Network Management Type
  *
@@ -84,6 +87,30 @@ static const char* networkManagementTypeToString(
   }
 }
 
+/**
+ * @brief Values of the DE 62/63 of a request
+ *
+ */
+typedef struct PrivateFieldRequest {
+  char posUid[32];
+  char appVersion[32];
+  char model[32];
+  char state[0x10000];
+  char imsi[32];
+} PrivateFieldRequest;
+
+/**
+ * Tags of the DE 62 of a call home request, a parameters download request and
+ * the DE 63 of CAPK and AID download requests send only the first.
+ */
+static const PrivateFieldTag PRIVATE_FIELD_REQUEST_TAGS[] = {
+    PRIVATE_FIELD_TAG(1, PrivateFieldRequest, posUid),
+    PRIVATE_FIELD_TAG(9, PrivateFieldRequest, appVersion),
+    PRIVATE_FIELD_TAG(10, PrivateFieldRequest, model),
+    PRIVATE_FIELD_TAG(11, PrivateFieldRequest, state),
+    PRIVATE_FIELD_TAG(12, PrivateFieldRequest, imsi),
+};
+
 /**
  * @brief Build DE 62
  *
@@ -95,32 +122,33 @@ static const char* networkManagementTypeToString(
  */
 static int buildDE62(char* buf, size_t bufLen, Handshake_t* handshake,
                      NetworkManagementType networkManagementType) {
-  short pos = 0;
   short ret = EXIT_FAILURE;
-  char state[0x10000] = {'\0'};
+  size_t count = 1;
+  PrivateFieldRequest request;
 
   check_debug(networkManagementType == NETWORK_MANAGEMENT_PARAMETER_DOWNLOAD ||
                   networkManagementType == NETWORK_MANAGEMENT_CALL_HOME,
               "Build DE 62 for only `Parameters Download` or `Call Home`");
 
-  pos += snprintf(&buf[pos], bufLen - pos, "%s%03d%s", "01",
-                  (int)strlen(handshake->deviceInfo.posUid),
-                  handshake->deviceInfo.posUid);
-  if (networkManagementType == NETWORK_MANAGEMENT_PARAMETER_DOWNLOAD)
-    return EXIT_SUCCESS;
+  memset(&request, 0x00, sizeof(request));
+  strncpy(request.posUid, handshake->deviceInfo.posUid,
+          sizeof(request.posUid) - 1);
 
-  pos += snprintf(&buf[pos], bufLen - pos, "%s%03d%s", "09",
-                  (int)strlen(handshake->appInfo.version),
-                  handshake->appInfo.version);
-  pos += snprintf(&buf[pos], bufLen - pos, "%s%03d%s", "10",
-                  (int)strlen(handshake->deviceInfo.model),
-                  handshake->deviceInfo.model);
-  check(handshake->getCallHomeData(state, sizeof(state)),
-        "Error Getting State");
-  pos += snprintf(&buf[pos], bufLen - pos, "%s%03d%s", "11", (int)strlen(state),
-                  state);
-  snprintf(&buf[pos], bufLen - pos, "%s%03d%s", "12",
-           (int)strlen(handshake->simInfo.imsi), handshake->simInfo.imsi);
+  if (networkManagementType == NETWORK_MANAGEMENT_CALL_HOME) {
+    strncpy(request.appVersion, handshake->appInfo.version,
+            sizeof(request.appVersion) - 1);
+    strncpy(request.model, handshake->deviceInfo.model,
+            sizeof(request.model) - 1);
+    check(handshake->getCallHomeData(request.state, sizeof(request.state)),
+          "Error Getting State");
+    strncpy(request.imsi, handshake->simInfo.imsi, sizeof(request.imsi) - 1);
+    count = sizeof(PRIVATE_FIELD_REQUEST_TAGS) /
+            sizeof(PRIVATE_FIELD_REQUEST_TAGS[0]);
+  }
+
+  check(buildPrivateField(buf, bufLen, &request, PRIVATE_FIELD_REQUEST_TAGS,
+                          count) >= 0,
+        "Error Building DE 62");
 
   ret = EXIT_SUCCESS;
 error:
@@ -139,15 +167,18 @@ error:
 static int buildDE63(char* buf, size_t bufLen, const Handshake_t* handshake,
                      NetworkManagementType networkManagementType) {
   short ret = EXIT_FAILURE;
-  char state[0x10000] = {'\0'};
+  PrivateFieldRequest request;
 
   check_debug(networkManagementType == NETWORK_MANAGEMENT_CAPK_DOWNLOAD ||
                   networkManagementType == NETWORK_MANAGEMENT_AID_DOWNLOAD,
               "Build DE 63 for only `CAPK Download` or `AID Download`");
 
-  snprintf(buf, bufLen, "%s%03d%s", "01",
-           (int)strlen(handshake->deviceInfo.posUid),
-           handshake->deviceInfo.posUid);
+  memset(request.posUid, 0x00, sizeof(request.posUid));
+  strncpy(request.posUid, handshake->deviceInfo.posUid,
+          sizeof(request.posUid) - 1);
+  check(buildPrivateField(buf, bufLen, &request, PRIVATE_FIELD_REQUEST_TAGS,
+                          1) >= 0,
+        "Error Building DE 63");
 
   ret = EXIT_SUCCESS;
 error:
@@ -220,6 +251,24 @@ static void getDecryptionKey(Handshake_t* handshake,
   }
 }
 
+/**
+ * @brief Get the MAC session of the session key, (re)built if the key changed
+ *
+ * @param handshake
+ * @return MacSession* NULL if the session key is invalid
+ */
+static MacSession* getMacSession(Handshake_t* handshake) {
+  const char* sessionKey =
+      (const char*)handshake->networkManagementResponse.session.key;
+
+  if (!macSessionIsFor(handshake->macSession, sessionKey)) {
+    macSessionDestroy(handshake->macSession);
+    handshake->macSession = macSessionCreate(sessionKey);
+  }
+
+  return handshake->macSession;
+}
+
 /**
  * @brief Build Network Management ISO Message
  *
@@ -238,13 +287,18 @@ static int buildNetworkManagementIso(
   char processingCode[8] = {'\0'};
   char de62Buf[0x1000] = {'\0'};
   char de63Buf[0x100] = {'\0'};
+  unsigned char isoArena[ISO_ARENA_SIZE];
   time_t now = time(NULL);
-  struct tm now_t = *localtime(&now);
-  IsoMsg isoMsg = createIso8583();
+  struct tm now_t;
+  IsoMsg isoMsg = createIso8583InArena(isoArena, sizeof(isoArena));
   short ret = -1;
   short useMac = 0;
+  MacSessionStream macState = {NULL};
+  const MacStream macStream = {macSessionStreamInit, macSessionStreamUpdate,
+                               macSessionStreamFinal, &macState};
   const unsigned char NETWORK_MANAGEMENT_MTI[] = "0800";
 
+  localtime_r(&now, &now_t);
   snprintf(processingCode, sizeof(processingCode), "%s0000",
            networkManagementTypeToProcessCode(networkManagementType));
   strftime(dateTimeBuff, sizeof(dateTimeBuff), "%m%d%H%M%S", &now_t);
@@ -290,11 +344,9 @@ static int buildNetworkManagementIso(
   logIsoMsg(isoMsg, stderr);
 
   if (useMac) {
-    ret = packDataWithMac(
-        isoMsg, packetBuf, len,
-        handshake->networkManagementResponse.session.key,
-        strlen((char*)handshake->networkManagementResponse.session.key),
-        generateMac);
+    macState.session = getMacSession(handshake);
+    check(macState.session, "Error creating MAC session");
+    ret = packDataWithMacStream(isoMsg, packetBuf, len, NULL, 0, &macStream);
   } else {
     ret = packData(isoMsg, packetBuf, len);
   }
@@ -304,55 +356,18 @@ error:
 }
 
 /**
- * @brief Get the Length object
- *
- * @param line
- * @param width
- * @return int
+ * Tags of the DE 62 of a parameters download response
  */
-static int getLength(char* line, int width) {
-  int ret = 0;
-  size_t len = strlen(line);
-
-  if (len && ((size_t)width < len)) {
-    char value[23] = {'\0'};
-    char buffer[0x1000] = {'\0'};
-
-    strncpy(value, line, width);
-    snprintf(buffer, sizeof(buffer), "%s", &line[width]);
-    memset(line, '\0', len);
-    snprintf(line, len, "%s", buffer);
-
-    ret = atoi(value);
-  }
-
-  return ret;
-}
-
-/**
- * @brief Get the Value object
- *
- * @param line
- * @param value
- * @param width
- * @return int
- */
-static int getValue(char* line, char* value, int width) {
-  size_t len = strlen(line);
-
-  if (len && (size_t)width <= len) {
-    char buffer[10000] = {'\0'};
-
-    snprintf(buffer, sizeof(buffer), "%s", &line[width]);
-    strncpy(value, line, width);
-    memset(line, '\0', len);
-    snprintf(line, len, "%s", buffer);
-
-    return width;
-  }
-
-  return 0;
-}
+static const PrivateFieldTag DE62_RESPONSE_TAGS[] = {
+    PRIVATE_FIELD_TAG(2, Parameters, serverDateAndTime),
+    PRIVATE_FIELD_TAG(3, Parameters, cardAcceptorID),
+    PRIVATE_FIELD_TAG(4, Parameters, timeout),
+    PRIVATE_FIELD_TAG(5, Parameters, currencyCode),
+    PRIVATE_FIELD_TAG(6, Parameters, countryCode),
+    PRIVATE_FIELD_TAG(7, Parameters, callHomeTime),
+    PRIVATE_FIELD_TAG(8, Parameters, merchantCategoryCode),
+    PRIVATE_FIELD_TAG(52, Parameters, merchantNameAndLocation),
+};
 
 /**
  * @brief Parse DE 62
@@ -364,106 +379,14 @@ static int getValue(char* line, char* value, int width) {
  */
 static short parseDE62(Handshake_t* handshake, const char* de62,
                        const int size) {
-  const int TAG_WIDTH = 2;
-  const int LEN_WIDTH = 3;
-  char buffer[0x512] = {'\0'};
-  int result = 0;
-
-  sprintf(buffer, "%s", de62);
-
-  while (1) {
-    char nextTag[3] = {'\0'};
-
-    if (!getValue(buffer, nextTag, TAG_WIDTH) || result >= size) break;
-
-    if (strcmp(nextTag, "02") == 0) {
-      result += getValue(
-          buffer,
-          handshake->networkManagementResponse.parameters.serverDateAndTime,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "03") == 0) {
-      result += getValue(
-          buffer,
-          handshake->networkManagementResponse.parameters.cardAcceptorID,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "04") == 0) {
-      result += getValue(
-          buffer, handshake->networkManagementResponse.parameters.timeout,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "05") == 0) {
-      result += getValue(
-          buffer, handshake->networkManagementResponse.parameters.currencyCode,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "06") == 0) {
-      result += getValue(
-          buffer, handshake->networkManagementResponse.parameters.countryCode,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "07") == 0) {
-      result += getValue(
-          buffer, handshake->networkManagementResponse.parameters.callHomeTime,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "08") == 0) {
-      result += getValue(
-          buffer,
-          handshake->networkManagementResponse.parameters.merchantCategoryCode,
-          getLength(buffer, LEN_WIDTH));
-    } else if (strcmp(nextTag, "52") == 0) {
-      result += getValue(buffer,
-                         handshake->networkManagementResponse.parameters
-                             .merchantNameAndLocation,
-                         getLength(buffer, LEN_WIDTH));
-    }
-    result += (TAG_WIDTH + LEN_WIDTH);
-  }
-
-  return 0;
-}
-
-/**
- * @brief Get the Network Data Helper object
- *
- * @param responseBuf
- * @param bufLen
- * @param handshake
- * @param networkManagementType
- * @return short
- */
-static short getNetworkDataHelper(unsigned char* responseBuf, size_t bufLen,
-                                  Handshake_t* handshake,
-                                  NetworkManagementType networkManagementType) {
-  unsigned char packetBuf[0x1000] = {'\0'};
-  NetworkBuffer request = {{'\0'}, 0};
-  NetworkBuffer response = {{'\0'}, 0};
-  int len = 0;
-  short ret = EXIT_FAILURE;
+  int ret = parsePrivateField(
+      &handshake->networkManagementResponse.parameters, DE62_RESPONSE_TAGS,
+      sizeof(DE62_RESPONSE_TAGS) / sizeof(DE62_RESPONSE_TAGS[0]), de62,
+      strnlen(de62, size));
 
-  memset(packetBuf, '\0', sizeof(packetBuf));
-  len = buildNetworkManagementIso(packetBuf, sizeof(packetBuf), handshake,
-                                  networkManagementType);
-  check(len > 0, "Error Building Packet");
-  debug("Packet: '%s (%d)'", packetBuf, len);
-
-  snprintf((char*)request.data, sizeof(request.data) - 1, "%c%c%s", len >> 8,
-           len, packetBuf);
-  request.len = len + 2;
-
-  if (networkManagementType == NETWORK_MANAGEMENT_CALL_HOME) {
-    response.len =
-        handshake->comSendReceive(&response, &request, &handshake->callHomeHost,
-                                  DEFAULT_TIMEOUT, NULL, NULL);
-  } else {
-    response.len = handshake->comSendReceive(&response, &request,
-                                             &handshake->handshakeHost,
-                                             DEFAULT_TIMEOUT, NULL, NULL);
-  }
-  check(response.len > 0, "Error sending or receiving request");
-  memcpy(responseBuf, response.data, response.len);
-  debug("Response: '%s (%ld) (%d)'", &responseBuf[2], response.len,
-        (responseBuf[0] << 8) + responseBuf[1]);
+  if (ret < 0) log_warn("Malformed DE 62, parsed up to the malformed tag");
 
-  ret = EXIT_SUCCESS;
-error:
-  return ret;
+  return ret < 0 ? -1 : 0;
 }
 
 /**
@@ -472,16 +395,29 @@ error:
  * @param handshake
  * @param isoMsg
  * @param responseBuf
+ * @param verifyMac response must carry the MAC of the session key
  * @return short
  */
 static short parseGetNetworkDataResponseHelper(Handshake_t* handshake,
                                                IsoMsg isoMsg,
-                                               unsigned char* responseBuf) {
+                                               unsigned char* responseBuf,
+                                               short verifyMac) {
   short ret = EXIT_FAILURE;
-
-  check(unpackData(isoMsg, &responseBuf[2],
-                   (responseBuf[0] << 8) + responseBuf[1]),
-        "%s", getMessage(isoMsg));
+  const int size = (responseBuf[0] << 8) + responseBuf[1];
+  MacSessionStream macState = {NULL};
+  const MacStream macStream = {macSessionStreamInit, macSessionStreamUpdate,
+                               macSessionStreamFinal, &macState};
+
+  if (verifyMac) {
+    macState.session = getMacSession(handshake);
+    check(macState.session, "Error creating MAC session");
+    check(unpackDataViewWithMacStreamVerify(isoMsg, &responseBuf[2], size,
+                                            NULL, 0, &macStream),
+          "%s", getMessage(isoMsg));
+  } else {
+    check(unpackDataView(isoMsg, &responseBuf[2], size), "%s",
+          getMessage(isoMsg));
+  }
 
   logIsoMsg(isoMsg, stderr);
 
@@ -510,18 +446,21 @@ error:
 static short parseGetKeyResponse(Handshake_t* handshake,
                                  unsigned char* responseBuf, Key* key) {
   short ret = EXIT_FAILURE;
-  IsoMsg isoMsg = createIso8583();
-  unsigned char de53Buff[97] = {'\0'};
+  unsigned char isoArena[ISO_ARENA_SIZE];
+  IsoMsg isoMsg = createIso8583InArena(isoArena, sizeof(isoArena));
+  const unsigned char* de53Buff = NULL;
+  int de53Size = 0;
   const short KEY_SIZE = 32;
   const short KCV_SIZE = 6;
 
-  check(parseGetNetworkDataResponseHelper(handshake, isoMsg, responseBuf) ==
+  check(parseGetNetworkDataResponseHelper(handshake, isoMsg, responseBuf, 0) ==
             EXIT_SUCCESS,
         "Parsing Error");
 
-  check(getDatum(isoMsg, SECURITY_RELATED_CONTROL_INFORMATION_53, de53Buff,
-                 sizeof(de53Buff)),
+  check(getDatumView(isoMsg, SECURITY_RELATED_CONTROL_INFORMATION_53,
+                     &de53Buff, &de53Size),
         "%s", getMessage(isoMsg));
+  check(de53Size >= KEY_SIZE + KCV_SIZE, "DE 53 too short (%d)", de53Size);
 
   memcpy(key->key, de53Buff, KEY_SIZE);
   memcpy(key->kcv, &de53Buff[KEY_SIZE], KCV_SIZE);
@@ -544,12 +483,13 @@ static short parseGetNetworkDataResponse(
     Handshake_t* handshake, unsigned char* responseBuf,
     NetworkManagementType networkManagementType) {
   short ret = EXIT_FAILURE;
-  IsoMsg isoMsg = createIso8583();
+  unsigned char isoArena[ISO_ARENA_SIZE];
+  IsoMsg isoMsg = createIso8583InArena(isoArena, sizeof(isoArena));
   unsigned char de62Buff[0x1000] = {'\0'};
   const char* NGN_CURRENCY_CODE = "566";
   const char* NGN_CURRENCY_SYMBOL = "NGN";
 
-  check(parseGetNetworkDataResponseHelper(handshake, isoMsg, responseBuf) ==
+  check(parseGetNetworkDataResponseHelper(handshake, isoMsg, responseBuf, 1) ==
             EXIT_SUCCESS,
         "Parsing Error");
 
@@ -612,69 +552,209 @@ static short getClearKey(Handshake_t* handshake, Key* key,
 }
 
 /**
- * @brief Get the Key object
+ * @brief Operation to Network Management Type
+ *
+ * @param operation
+ * @return NetworkManagementType
+ */
+static NetworkManagementType operationToNetworkManagementType(
+    HandshakeOperationBitmap operation) {
+  switch (operation) {
+    case HANDSHAKE_OPERATIONS_MASTER_KEY:
+      return NETWORK_MANAGEMENT_MASTER_KEY;
+    case HANDSHAKE_OPERATIONS_SESSION_KEY:
+      return NETWORK_MANAGEMENT_SESSION_KEY;
+    case HANDSHAKE_OPERATIONS_PIN_KEY:
+      return NETWORK_MANAGEMENT_PIN_KEY;
+    case HANDSHAKE_OPERATIONS_PARAMETER:
+      return NETWORK_MANAGEMENT_PARAMETER_DOWNLOAD;
+    case HANDSHAKE_OPERATIONS_CALLHOME:
+      return NETWORK_MANAGEMENT_CALL_HOME;
+    case HANDSHAKE_OPERATIONS_CAPK:
+      return NETWORK_MANAGEMENT_CAPK_DOWNLOAD;
+    case HANDSHAKE_OPERATIONS_AID:
+      return NETWORK_MANAGEMENT_AID_DOWNLOAD;
+    default:
+      return NETWORK_MANAGEMENT_UNKNOWN;
+  }
+}
+
+/**
+ * @brief Get the Key a Network Management Type downloads, NULL for network
+ * data
+ *
+ * @param handshake
+ * @param networkManagementType
+ * @return Key*
+ */
+static Key* getNetworkManagementKey(
+    Handshake_t* handshake, NetworkManagementType networkManagementType) {
+  switch (networkManagementType) {
+    case NETWORK_MANAGEMENT_MASTER_KEY:
+      return &handshake->networkManagementResponse.master;
+    case NETWORK_MANAGEMENT_SESSION_KEY:
+      return &handshake->networkManagementResponse.session;
+    case NETWORK_MANAGEMENT_PIN_KEY:
+      return &handshake->networkManagementResponse.pin;
+    default:
+      return NULL;
+  }
+}
+
+/**
+ * @brief Set the error message of a failed Network Management Type
  *
  * @param handshake
- * @param key
  * @param networkManagementType
+ */
+static void setNetworkManagementError(
+    Handshake_t* handshake, NetworkManagementType networkManagementType) {
+  const char* what = getNetworkManagementKey(handshake, networkManagementType)
+                         ? "key"
+                         : "network data";
+
+  log_err("Error getting %s (%s)", what,
+          networkManagementTypeToString(networkManagementType));
+  snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
+           "Error getting %s (%s)", what,
+           networkManagementTypeToString(networkManagementType));
+}
+
+/**
+ * @brief Build the request of a handshake operation
+ *
+ * @param handshake
+ * @param operation
+ * @param request
  * @return short
  */
-static short getKey(Handshake_t* handshake, Key* key,
-                    NetworkManagementType networkManagementType) {
-  unsigned char responseBuf[0x1000] = {'\0'};
+static short buildRequest(Handshake_t* handshake,
+                          HandshakeOperationBitmap operation,
+                          HandshakeRequest* request) {
+  unsigned char packetBuf[0x1000] = {'\0'};
+  NetworkManagementType networkManagementType =
+      operationToNetworkManagementType(operation);
+  int len = 0;
   short ret = EXIT_FAILURE;
 
-  check(getNetworkDataHelper(responseBuf, sizeof(responseBuf) - 1, handshake,
-                             networkManagementType) == EXIT_SUCCESS,
-        "Error Getting Network Data");
+  check(networkManagementType != NETWORK_MANAGEMENT_UNKNOWN,
+        "Unknown operation %d", operation);
 
-  check(parseGetKeyResponse(handshake, responseBuf, key) == EXIT_SUCCESS,
-        "Parsing Error");
+  request->buffer.len = 0;
+  request->host = &handshake->handshakeHost;
+  request->sentinel = handshake->comSentinel;
+  if (!request->sentinel) {
+    // a kept-alive connection doesn't wait for the host to close it
+    request->sentinel = comsIsFrameComplete;
+  }
+
+  if (networkManagementType == NETWORK_MANAGEMENT_CALL_HOME) {
+    // call home is not sent for now, nothing to exchange
+    request->host = &handshake->callHomeHost;
+    return EXIT_SUCCESS;
+  }
+
+  len = buildNetworkManagementIso(packetBuf, sizeof(packetBuf), handshake,
+                                  networkManagementType);
+  check(len > 0 && (size_t)len + 2 < sizeof(request->buffer.data),
+        "Error Building Packet");
+  debug("Packet: '%s (%d)'", packetBuf, len);
 
-  check(getClearKey(handshake, key, networkManagementType) == EXIT_SUCCESS,
-        "Error Getting Clear Key");
+  request->buffer.data[0] = len >> 8;
+  request->buffer.data[1] = len;
+  memcpy(&request->buffer.data[2], packetBuf, len);
+  request->buffer.len = len + 2;
 
   ret = EXIT_SUCCESS;
 error:
   if (ret != EXIT_SUCCESS) {
-    log_err("Error getting key (%s)",
-            networkManagementTypeToString(networkManagementType));
-    snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
-             "Error getting key (%s)",
-             networkManagementTypeToString(networkManagementType));
+    setNetworkManagementError(handshake, networkManagementType);
   }
   return ret;
 }
 
 /**
- * @brief Get the Network Data object
+ * @brief Parse the response of a handshake operation
  *
  * @param handshake
- * @param networkManagementType
+ * @param operation
+ * @param response
  * @return short
  */
-static short getNetworkData(Handshake_t* handshake,
-                            NetworkManagementType networkManagementType) {
-  unsigned char responseBuf[0x2000] = {'\0'};
+static short parseResponse(Handshake_t* handshake,
+                           HandshakeOperationBitmap operation,
+                           NetworkBuffer* response) {
+  NetworkManagementType networkManagementType =
+      operationToNetworkManagementType(operation);
+  Key* key = getNetworkManagementKey(handshake, networkManagementType);
   short ret = EXIT_FAILURE;
 
-  check(getNetworkDataHelper(responseBuf, sizeof(responseBuf) - 1, handshake,
-                             networkManagementType) == EXIT_SUCCESS,
-        "Error Getting Network Data");
+  check(response->len > 2, "Empty response");
+  debug("Response: '%s (%ld) (%d)'", &response->data[2], response->len,
+        (response->data[0] << 8) + response->data[1]);
 
-  check(parseGetNetworkDataResponse(handshake, responseBuf,
-                                    networkManagementType) == EXIT_SUCCESS,
-        "Parsing Error");
+  if (key) {
+    check(parseGetKeyResponse(handshake, response->data, key) == EXIT_SUCCESS,
+          "Parsing Error");
+    check(getClearKey(handshake, key, networkManagementType) == EXIT_SUCCESS,
+          "Error Getting Clear Key");
+  } else {
+    check(parseGetNetworkDataResponse(handshake, response->data,
+                                      networkManagementType) == EXIT_SUCCESS,
+          "Parsing Error");
+  }
 
   ret = EXIT_SUCCESS;
 error:
   if (ret != EXIT_SUCCESS) {
-    log_err("Error getting network data (%s)",
-            networkManagementTypeToString(networkManagementType));
-    snprintf(handshake->error.message, sizeof(handshake->error.message) - 1,
-             "Error getting network data (%s)",
-             networkManagementTypeToString(networkManagementType));
+    setNetworkManagementError(handshake, networkManagementType);
+  }
+  return ret;
+}
+
+/**
+ * @brief Perform a handshake operation on blocking comms
+ *
+ * @param handshake
+ * @param operation
+ * @return short
+ */
+static short performOperation(Handshake_t* handshake,
+                              HandshakeOperationBitmap operation) {
+  HandshakeRequest request;
+  NetworkBuffer response = {{'\0'}, 0};
+  int timeoutMs = 0;
+  short ret = EXIT_FAILURE;
+
+  memset(&request, '\0', sizeof(request));
+  check(buildRequest(handshake, operation, &request) == EXIT_SUCCESS,
+        "Error Building Request");
+  if (!request.buffer.len) return EXIT_SUCCESS;
+
+  timeoutMs = handshakeRemainingMs(handshake);
+  check(timeoutMs > 0, "Handshake deadline exceeded");
+
+  if (comsSessionIsFor(handshake->comsSession, request.host)) {
+    response.len = comsSessionSendReceive(handshake->comsSession, &response,
+                                          &request.buffer, timeoutMs,
+                                          request.sentinel, NULL);
+  } else {
+    response.len = handshake->comSendReceive(&response, &request.buffer,
+                                             request.host, timeoutMs,
+                                             request.sentinel, NULL);
   }
+  if (response.len <= 0) {
+    log_err("Error sending or receiving request");
+    setNetworkManagementError(handshake,
+                              operationToNetworkManagementType(operation));
+    goto error;
+  }
+
+  check(parseResponse(handshake, operation, &response) == EXIT_SUCCESS,
+        "Error Parsing Response");
+
+  ret = EXIT_SUCCESS;
+error:
   return ret;
 }
 
@@ -686,8 +766,7 @@ error:
  */
 static short getMasterKey(Handshake_t* handshake) {
   debug("%s", networkManagementTypeToString(NETWORK_MANAGEMENT_MASTER_KEY));
-  return getKey(handshake, &handshake->networkManagementResponse.master,
-                NETWORK_MANAGEMENT_MASTER_KEY);
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_MASTER_KEY);
 }
 
 /**
@@ -698,8 +777,7 @@ static short getMasterKey(Handshake_t* handshake) {
  */
 static short getSessionKey(Handshake_t* handshake) {
   debug("%s", networkManagementTypeToString(NETWORK_MANAGEMENT_SESSION_KEY));
-  return getKey(handshake, &handshake->networkManagementResponse.session,
-                NETWORK_MANAGEMENT_SESSION_KEY);
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_SESSION_KEY);
 }
 
 /**
@@ -710,8 +788,7 @@ static short getSessionKey(Handshake_t* handshake) {
  */
 static short getPinKey(Handshake_t* handshake) {
   debug("%s", networkManagementTypeToString(NETWORK_MANAGEMENT_PIN_KEY));
-  return getKey(handshake, &handshake->networkManagementResponse.pin,
-                NETWORK_MANAGEMENT_PIN_KEY);
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_PIN_KEY);
 }
 
 /**
@@ -723,13 +800,12 @@ static short getPinKey(Handshake_t* handshake) {
 static short getParameters(Handshake_t* handshake) {
   debug("%s",
         networkManagementTypeToString(NETWORK_MANAGEMENT_PARAMETER_DOWNLOAD));
-  return getNetworkData(handshake, NETWORK_MANAGEMENT_PARAMETER_DOWNLOAD);
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_PARAMETER);
 }
 
 static short doCallHome(Handshake_t* handshake) {
   debug("%s", networkManagementTypeToString(NETWORK_MANAGEMENT_CALL_HOME));
-  // return getNetworkData(handshake, NETWORK_MANAGEMENT_CALL_HOME);
-  return EXIT_SUCCESS;
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_CALLHOME);
 }
 
 /**
@@ -740,7 +816,7 @@ static short doCallHome(Handshake_t* handshake) {
  */
 static short getCapk(Handshake_t* handshake) {
   debug("%s", networkManagementTypeToString(NETWORK_MANAGEMENT_CAPK_DOWNLOAD));
-  return getNetworkData(handshake, NETWORK_MANAGEMENT_CAPK_DOWNLOAD);
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_CAPK);
 }
 
 /**
@@ -751,7 +827,7 @@ static short getCapk(Handshake_t* handshake) {
  */
 static short getAid(Handshake_t* handshake) {
   debug("%s", networkManagementTypeToString(NETWORK_MANAGEMENT_AID_DOWNLOAD));
-  return getNetworkData(handshake, NETWORK_MANAGEMENT_AID_DOWNLOAD);
+  return performOperation(handshake, HANDSHAKE_OPERATIONS_AID);
 }
 
 /**
@@ -767,4 +843,6 @@ void bindNibss(HandshakeOperations* handshake_internals) {
   handshake_internals->doCallHome = doCallHome;
   handshake_internals->getCapk = getCapk;
   handshake_internals->getAid = getAid;
+  handshake_internals->buildRequest = buildRequest;
+  handshake_internals->parseResponse = parseResponse;
 }
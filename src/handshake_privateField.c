@@ -0,0 +1,153 @@
+/**
+ * @file handshake_privateField.c
+ * @author Elijah Balogun (elijah.balogun@cyberpay.net.ng)
+ * @brief Implements the tag-length-value codec of NIBSS private fields
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "handshake_internals.h"
+
+/**
+ * @brief Read `width` decimal digits
+ *
+ * @param digits
+ * @param width
+ * @return int -1 if a character isn't a digit
+ */
+static int readDecimal(const char* digits, const int width) {
+  int value = 0;
+  int i = 0;
+
+  for (i = 0; i < width; i++) {
+    if (digits[i] < '0' || digits[i] > '9') return -1;
+    value = value * 10 + (digits[i] - '0');
+  }
+
+  return value;
+}
+
+/**
+ * @brief Write `value` as `width` decimal digits
+ *
+ * @param digits
+ * @param width
+ * @param value
+ */
+static void writeDecimal(char* digits, const int width, int value) {
+  int i = 0;
+
+  for (i = width - 1; i >= 0; i--) {
+    digits[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+}
+
+/**
+ * @brief Find the descriptor of `tag`
+ *
+ * @param tags
+ * @param count
+ * @param tag
+ * @return const PrivateFieldTag* NULL for tags not in the table
+ */
+static const PrivateFieldTag* findPrivateFieldTag(const PrivateFieldTag* tags,
+                                                  const size_t count,
+                                                  const int tag) {
+  size_t i = 0;
+
+  for (i = 0; i < count; i++) {
+    if (tags[i].tag == tag) return &tags[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Parse a private field into the members of `record` described by
+ * `tags`, in one pass. Values longer than their member are truncated, tags not
+ * in the table are skipped.
+ *
+ * @param record
+ * @param tags
+ * @param count
+ * @param data
+ * @param size
+ * @return int number of tags read, -1 if `data` is malformed, in which case
+ * the tags before the malformed one are still set
+ */
+int parsePrivateField(void* record, const PrivateFieldTag* tags,
+                      const size_t count, const char* data,
+                      const size_t size) {
+  size_t pos = 0;
+  int read = 0;
+
+  while (pos < size && data[pos] != '\0') {
+    const PrivateFieldTag* descriptor = NULL;
+    int tag = 0;
+    int len = 0;
+
+    if (size - pos < PRIVATE_FIELD_HEADER_WIDTH) return -1;
+
+    tag = readDecimal(&data[pos], PRIVATE_FIELD_TAG_WIDTH);
+    len = readDecimal(&data[pos + PRIVATE_FIELD_TAG_WIDTH],
+                      PRIVATE_FIELD_LEN_WIDTH);
+    pos += PRIVATE_FIELD_HEADER_WIDTH;
+    if (tag < 0 || len < 0 || (size_t)len > size - pos) return -1;
+
+    descriptor = findPrivateFieldTag(tags, count, tag);
+    if (descriptor) {
+      char* value = (char*)record + descriptor->offset;
+      size_t valueLen =
+          (size_t)len < descriptor->size ? (size_t)len : descriptor->size - 1;
+
+      memcpy(value, &data[pos], valueLen);
+      value[valueLen] = '\0';
+      read++;
+    }
+
+    pos += len;
+  }
+
+  return read;
+}
+
+/**
+ * @brief Build a private field from the members of `record` described by
+ * `tags`, in table order. Empty members are written with length 0.
+ *
+ * @param buf
+ * @param size
+ * @param record
+ * @param tags
+ * @param count
+ * @return int length written, NUL terminated, -1 if `buf` is too small
+ */
+int buildPrivateField(char* buf, const size_t size, const void* record,
+                      const PrivateFieldTag* tags, const size_t count) {
+  size_t pos = 0;
+  size_t i = 0;
+
+  for (i = 0; i < count; i++) {
+    const char* value = (const char*)record + tags[i].offset;
+    size_t len = strnlen(value, tags[i].size);
+
+    if (len > PRIVATE_FIELD_MAX_LEN ||
+        size - pos <= PRIVATE_FIELD_HEADER_WIDTH + len) {
+      buf[pos] = '\0';
+      return -1;
+    }
+
+    writeDecimal(&buf[pos], PRIVATE_FIELD_TAG_WIDTH, tags[i].tag);
+    writeDecimal(&buf[pos + PRIVATE_FIELD_TAG_WIDTH], PRIVATE_FIELD_LEN_WIDTH,
+                 (int)len);
+    pos += PRIVATE_FIELD_HEADER_WIDTH;
+    memcpy(&buf[pos], value, len);
+    pos += len;
+  }
+  buf[pos] = '\0';
+
+  return (int)pos;
+}
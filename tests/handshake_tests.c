@@ -1,10 +1,30 @@
+#include <arpa/inet.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../c8583/C8583.h"
+#include "../c8583/C8583Config.h"
+#include "../c8583/C8583Emv.h"
+#include "../c8583/FieldNames.h"
+#include "../des/des.h"
+#include "../hexcodec/hexcodec.h"
 #include "../dbg.h"
+#include "../platform/comms_internals.h"
 #include "../platform/platform.h"
+#include "../sha256/sha256.h"
 #include "../src/handshake.h"
+#include "../src/handshake_internals.h"
 #include "minunit.h"
 
 Handshake_t g_handshake = HANDSHAKE_INIT_DATA;
@@ -83,6 +103,2046 @@ const char* testHandshakeInit_mapTidTrue_dataNotSet() {
   return NULL;
 }
 
+static void countBatchCompletion(Handshake_t* handshake, size_t index,
+                                 void* userData) {
+  (void)handshake;
+  (void)index;
+  __sync_fetch_and_add((size_t*)userData, 1);
+}
+
+const char* testHandshakeBatch_invalidItems() {
+  Handshake_t handshakes[5];
+  HandshakeBatchOptions options = {2, countBatchCompletion, NULL};
+  HandshakeBatchStats stats;
+  size_t completed = 0;
+  size_t i = 0;
+
+  memset(handshakes, '\0', sizeof(handshakes));
+  options.userData = &completed;
+
+  stats = HandshakeBatch(handshakes, 5, &options);
+  mu_assert(stats.total == 5, "Batch total is %zu", stats.total);
+  mu_assert(stats.failed == 5, "Batch failed is %zu", stats.failed);
+  mu_assert(completed == 5, "Batch completed is %zu", completed);
+  for (i = 0; i < 5; i++) {
+    mu_assert(handshakes[i].error.code == ERROR_CODE_HANDSHAKE_INIT_ERROR,
+              "%s", handshakes[i].error.message);
+  }
+
+  return NULL;
+}
+
+const char* testHandshakeCtx_deviceConfigNotSupported() {
+  Handshake_t handshake = HANDSHAKE_INIT_DATA;
+  HandshakeCtx* ctx = NULL;
+
+  handshake.comSendReceive = comSendReceive;
+  handshake.platform = PLATFORM_NIBSS;
+  handshake.shouldGetDeviceConfig = TRUE;
+  strcpy(handshake.appInfo.version, "0.0.1");
+  strcpy(handshake.deviceInfo.model, "D210");
+  strcpy(handshake.deviceInfo.brand, "VERIFONE");
+  strcpy(handshake.deviceInfo.posUid, "P051200187041");
+  strcpy(handshake.deviceConfigHost.url, TMS_HOST);
+  handshake.deviceConfigHost.port = TMS_PORT;
+
+  ctx = HandshakeCtx_Start(&handshake);
+  mu_assert(ctx != NULL, "Context not created");
+  mu_assert(HandshakeCtx_IsDone(ctx), "Context not done");
+  mu_assert(HandshakeCtx_Fd(ctx) == -1, "Done context has an fd");
+  mu_assert(handshake.error.code == ERROR_CODE_HANDSHAKE_INIT_ERROR, "%s",
+            handshake.error.message);
+  HandshakeCtx_Free(ctx);
+
+  return NULL;
+}
+
+const char* testHandshakeCtx_connectionRefused() {
+  Handshake_t handshake = HANDSHAKE_INIT_DATA;
+  HandshakeCtx* ctx = NULL;
+
+  handshake.comSendReceive = comSendReceive;
+  handshake.platform = PLATFORM_NIBSS;
+  handshake.operations = HANDSHAKE_OPERATIONS_MASTER_KEY;
+  strcpy(handshake.tid, "2033GP24");
+  strcpy(handshake.handshakeHost.url, "127.0.0.1");
+  handshake.handshakeHost.port = 1;
+  handshake.handshakeHost.connectionType = CONNECTION_TYPE_PLAIN;
+
+  ctx = HandshakeCtx_Start(&handshake);
+  mu_assert(ctx != NULL, "Context not created");
+  while (!HandshakeCtx_IsDone(ctx)) {
+    struct pollfd pfd = {HandshakeCtx_Fd(ctx), 0, 0};
+    int wanted = HandshakeCtx_WantedEvents(ctx);
+
+    if (wanted & COMS_EVENT_READ) pfd.events |= POLLIN;
+    if (wanted & COMS_EVENT_WRITE) pfd.events |= POLLOUT;
+    mu_assert(poll(&pfd, 1, 5000) == 1, "Timed out waiting for connect");
+
+    if (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) {
+      HandshakeCtx_OnWritable(ctx);
+    } else {
+      HandshakeCtx_OnReadable(ctx);
+    }
+  }
+  mu_assert(handshake.error.code == ERROR_CODE_HANDSHAKE_RUN_ERROR, "%s",
+            handshake.error.message);
+  HandshakeCtx_Free(ctx);
+
+  return NULL;
+}
+
+const char* testC8583_packUnpackNetworkManagement() {
+  const char* expected =
+      "080022380000008000009A0000071522065594575422065507152058LS73";
+  const struct {
+    int field;
+    const char* datum;
+  } fields[] = {
+      {PROCESSING_CODE_3, "9A0000"},
+      {TRANSACTION_DATE_TIME_7, "0715220655"},
+      {SYSTEM_TRACE_AUDIT_NUMBER_11, "945754"},
+      {LOCAL_TRANSACTION_TIME_12, "220655"},
+      {LOCAL_TRANSACTION_DATE_13, "0715"},
+      {CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41, "2058LS73"},
+  };
+  unsigned char packet[256] = {'\0'};
+  unsigned char datum[32] = {'\0'};
+  IsoMsg isoMsg = createIso8583();
+  IsoMsg unpacked = createIso8583();
+  size_t i = 0;
+  short len = 0;
+
+  mu_assert(setDatum(isoMsg, MESSAGE_TYPE_INDICATOR_0,
+                     (const unsigned char*)"0800", 4) == 0,
+            "%s", getMessage(isoMsg));
+  for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    mu_assert(setDatum(isoMsg, fields[i].field,
+                       (const unsigned char*)fields[i].datum,
+                       strlen(fields[i].datum)) == 0,
+              "%s", getMessage(isoMsg));
+  }
+  mu_assert(setDatum(isoMsg, PROCESSING_CODE_3,
+                     (const unsigned char*)"9B0000", 6) != 0,
+            "Field set twice");
+
+  len = packData(isoMsg, packet, sizeof(packet));
+  mu_assert(len == (short)strlen(expected), "Packed %d bytes", len);
+  mu_assert(memcmp(packet, expected, len) == 0, "Packed '%s'", packet);
+
+  mu_assert(unpackData(unpacked, packet, len) == len, "%s",
+            getMessage(unpacked));
+  for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    memset(datum, '\0', sizeof(datum));
+    mu_assert(getDatum(unpacked, fields[i].field, datum, sizeof(datum)) ==
+                  (short)strlen(fields[i].datum),
+              "%s", getMessage(unpacked));
+    mu_assert(strcmp((const char*)datum, fields[i].datum) == 0,
+              "DE[%d] is '%s'", fields[i].field, datum);
+  }
+  mu_assert(getDatum(unpacked, RESPONSE_CODE_39, datum, sizeof(datum)) == 0,
+            "Unset field found");
+
+  destroyIso8583(isoMsg);
+  destroyIso8583(unpacked);
+
+  return NULL;
+}
+
+const char* testC8583_unpackDataView() {
+  const unsigned char packet[] =
+      "081022380000028000009A000007152206559457542206550715002058LS73";
+  const unsigned char* datum = NULL;
+  int datumSize = 0;
+  IsoMsg isoMsg = createIso8583();
+  short len = (short)(sizeof(packet) - 1);
+
+  mu_assert(unpackDataView(isoMsg, packet, len) == len, "%s",
+            getMessage(isoMsg));
+
+  mu_assert(getDatumView(isoMsg, MESSAGE_TYPE_INDICATOR_0, &datum,
+                         &datumSize) == 4,
+            "%s", getMessage(isoMsg));
+  mu_assert(memcmp(datum, "0810", 4) == 0, "Wrong MTI");
+
+  mu_assert(getDatumView(isoMsg, RESPONSE_CODE_39, &datum, &datumSize) == 2,
+            "%s", getMessage(isoMsg));
+  mu_assert(datum == &packet[52], "DE[39] was copied");
+  mu_assert(memcmp(datum, "00", 2) == 0, "Wrong DE[39]");
+
+  mu_assert(getDatumView(isoMsg, CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41,
+                         &datum, &datumSize) == 8,
+            "%s", getMessage(isoMsg));
+  mu_assert(memcmp(datum, "2058LS73", 8) == 0, "Wrong DE[41]");
+
+  mu_assert(getDatumView(isoMsg, PERSONAL_IDENTIFICATION_NUMBER_DATA_52,
+                         &datum, &datumSize) == 0,
+            "Unset field found");
+  mu_assert(unpackDataView(isoMsg, packet, len - 4) == 0,
+            "Truncated packet unpacked");
+
+  destroyIso8583(isoMsg);
+
+  return NULL;
+}
+
+const char* testC8583_arenaReset() {
+  const char* expected = "080020000000008000009200002058LS73";
+  unsigned char arena[0x1000];
+  unsigned char tooSmall[64];
+  unsigned char packet[64] = {'\0'};
+  unsigned char large[0x800];
+  IsoMsg isoMsg = NULL;
+  int i = 0;
+
+  mu_assert(createIso8583InArena(tooSmall, sizeof(tooSmall)) == NULL,
+            "Message created in too small a buffer");
+
+  isoMsg = createIso8583InArena(arena, sizeof(arena));
+  mu_assert(isoMsg != NULL, "Message not created in arena");
+
+  for (i = 0; i < 2; i++) {
+    memset(packet, '\0', sizeof(packet));
+    mu_assert(setDatum(isoMsg, MESSAGE_TYPE_INDICATOR_0,
+                       (const unsigned char*)"0800", 4) == 0,
+              "%s", getMessage(isoMsg));
+    mu_assert(setDatum(isoMsg, PROCESSING_CODE_3,
+                       (const unsigned char*)"920000", 6) == 0,
+              "%s", getMessage(isoMsg));
+    mu_assert(setDatum(isoMsg, CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41,
+                       (const unsigned char*)"2058LS73", 8) == 0,
+              "%s", getMessage(isoMsg));
+    mu_assert(packData(isoMsg, packet, sizeof(packet)) ==
+                  (short)strlen(expected),
+              "%s", getMessage(isoMsg));
+    mu_assert(strcmp((const char*)packet, expected) == 0, "Packed '%s'",
+              packet);
+    resetIso8583(isoMsg);
+  }
+
+  memset(large, 'A', sizeof(large));
+  mu_assert(setDatum(isoMsg, RESERVED_PRIVATE_62, large, 999) == 0, "%s",
+            getMessage(isoMsg));
+  mu_assert(setDatum(isoMsg, RESERVED_PRIVATE_63, large, 999) != 0 ||
+                setDatum(isoMsg, RESERVED_PRIVATE_61, large, 999) != 0 ||
+                setDatum(isoMsg, RESERVED_NATIONAL_60, large, 999) != 0,
+            "Field set past the end of the arena");
+  destroyIso8583(isoMsg);
+
+  return NULL;
+}
+
+const char* testC8583_packVarLen() {
+  const char* expected =
+      "02004000000000000004165399831234567890005TLV01";
+  unsigned char packet[64] = {'\0'};
+  IsoMsg isoMsg = createIso8583();
+  short len = (short)strlen(expected);
+
+  mu_assert(setDatum(isoMsg, MESSAGE_TYPE_INDICATOR_0,
+                     (const unsigned char*)"0200", 4) == 0,
+            "%s", getMessage(isoMsg));
+  mu_assert(setDatum(isoMsg, PRIMARY_ACCOUNT_NUMBER_2,
+                     (const unsigned char*)"5399831234567890", 16) == 0,
+            "%s", getMessage(isoMsg));
+  mu_assert(setDatum(isoMsg, RESERVED_PRIVATE_62,
+                     (const unsigned char*)"TLV01", 5) == 0,
+            "%s", getMessage(isoMsg));
+
+  mu_assert(packData(isoMsg, packet, len - 1) == 0, "Packed past the buffer");
+  mu_assert(packData(isoMsg, packet, sizeof(packet)) == len, "%s",
+            getMessage(isoMsg));
+  mu_assert(memcmp(packet, expected, len) == 0, "Packed '%s'", packet);
+
+  destroyIso8583(isoMsg);
+
+  return NULL;
+}
+
+const char* testHexcodec_kernelsMatchScalar() {
+  const HexcodecKernel kernels[] = {HEXCODEC_SCALAR, HEXCODEC_SSE2,
+                                    HEXCODEC_AVX2};
+  unsigned char bin[130];
+  unsigned char decoded[130];
+  char expected[261];
+  char hex[261];
+  size_t k = 0;
+  size_t len = 0;
+  size_t i = 0;
+
+  for (i = 0; i < sizeof(bin); i++) {
+    bin[i] = (unsigned char)(i * 167 + 13);
+  }
+
+  for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    HexcodecKernel kernel = hexcodecSelect(kernels[k]);
+
+    for (len = 0; len <= sizeof(bin); len++) {
+      HexCase hexCase = (len % 2) ? HEX_CASE_LOWER : HEX_CASE_UPPER;
+
+      hexcodecSelect(HEXCODEC_SCALAR);
+      hexEncode(expected, bin, len, hexCase);
+      hexcodecSelect(kernel);
+
+      hexEncode(hex, bin, len, hexCase);
+      mu_assert(memcmp(hex, expected, len * 2) == 0, "%s: encode %zu differs",
+                hexcodecKernelName(kernel), len);
+      mu_assert(hexDecode(decoded, hex, len * 2) == (long)len,
+                "%s: decode %zu failed", hexcodecKernelName(kernel), len);
+      mu_assert(memcmp(decoded, bin, len) == 0, "%s: decode %zu differs",
+                hexcodecKernelName(kernel), len);
+    }
+
+    // every position of every lane must be validated
+    for (i = 0; i < 200; i++) {
+      char saved = hex[i];
+
+      hex[i] = (i % 3) ? 'g' : ':';
+      mu_assert(hexDecode(decoded, hex, 200) == -1, "%s: '%c' at %zu accepted",
+                hexcodecKernelName(kernel), hex[i], i);
+      hex[i] = saved;
+    }
+    mu_assert(hexDecode(decoded, "ABC", 3) == -1, "Odd length accepted");
+  }
+  hexcodecSelect(HEXCODEC_AUTO);
+
+  return NULL;
+}
+
+const char* testDes3_keyedMatchesWrappers() {
+  const unsigned char key[DES3_KEY3_SIZE] = {
+      0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98,
+      0x76, 0x54, 0x32, 0x10, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF};
+  const unsigned char kcv[8] = {0x08, 0xD7, 0xB4, 0xFB,
+                                0x62, 0x9D, 0x08, 0x85};
+  unsigned char other[DES3_KEY2_SIZE];
+  unsigned char zeros[16] = {0};
+  unsigned char out[16];
+  unsigned char clear[16];
+  des3_keyed_ctx ctx;
+  int i = 0;
+
+  mu_assert(des3_keyed_init(&ctx, key, 10) == ERR_DES_INVALID_KEY_LENGTH,
+            "Invalid key length accepted");
+  mu_assert(des3_keyed_init(&ctx, key, DES3_KEY2_SIZE) == 0, "Init failed");
+
+  mu_assert(des3_keyed_ecb_encrypt(&ctx, out, zeros, 5) == 8, "Padded length");
+  mu_assert(memcmp(out, kcv, sizeof(kcv)) == 0, "Keyed KCV differs");
+  mu_assert(des3_keyed_ecb_decrypt(&ctx, clear, out, 8) == 0 &&
+                memcmp(clear, zeros, 8) == 0,
+            "Keyed decrypt differs");
+
+  // the last round pushes the key out of the cache and expands it again
+  for (i = 0; i <= DES3_SCHEDULE_CACHE_SIZE + 1; i++) {
+    memset(other, i, sizeof(other));
+    des3_ecb_encrypt(out, zeros, sizeof(zeros), other, sizeof(other));
+
+    memset(out, 0, sizeof(out));
+    mu_assert(des3_ecb_encrypt(out, zeros, sizeof(zeros), (unsigned char*)key,
+                               DES3_KEY2_SIZE) == 16,
+              "Wrapper length");
+    mu_assert(memcmp(out, kcv, 8) == 0 && memcmp(out + 8, kcv, 8) == 0,
+              "Wrapper KCV differs at %d", i);
+    mu_assert(des3_ecb_decrypt(clear, out, sizeof(out), (unsigned char*)key,
+                               DES3_KEY2_SIZE) == 0 &&
+                  memcmp(clear, zeros, sizeof(zeros)) == 0,
+              "Wrapper decrypt differs at %d", i);
+  }
+
+  // K1 K2 K1 is the 2-key schedule
+  mu_assert(des3_ecb_encrypt(out, zeros, 8, (unsigned char*)key,
+                             DES3_KEY3_SIZE) == 8 &&
+                memcmp(out, kcv, 8) == 0,
+            "3-key KCV differs");
+  mu_assert(des3_ecb_encrypt(out, zeros, 8, (unsigned char*)key, 10) == 0,
+            "Wrapper accepted invalid key length");
+
+  des3_keyed_free(&ctx);
+  des3_schedule_cache_clear();
+
+  return NULL;
+}
+
+const char* testDes3_cbcMatchesEcbChain() {
+  const unsigned char key[DES3_KEY3_SIZE] = {
+      0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98,
+      0x76, 0x54, 0x32, 0x10, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x23, 0x45, 0x67};
+  unsigned char data[7 * 8];
+  unsigned char expected[sizeof(data)];
+  unsigned char out[sizeof(data)];
+  unsigned char iv[8] = {0};
+  unsigned char chain[8] = {0};
+  des3_context ctx3;
+  size_t i = 0;
+  size_t j = 0;
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (unsigned char)(i * 29 + 7);
+  }
+
+  des3_set3key_enc(&ctx3, key);
+  for (i = 0; i < sizeof(data); i += 8) {
+    for (j = 0; j < 8; j++) chain[j] ^= data[i + j];
+    des3_crypt_ecb(&ctx3, chain, chain);
+    memcpy(expected + i, chain, 8);
+  }
+  des3_crypt_cbc(&ctx3, DES_ENCRYPT, sizeof(data), iv, data, out);
+  mu_assert(memcmp(out, expected, sizeof(out)) == 0, "3DES CBC differs");
+  mu_assert(memcmp(iv, chain, 8) == 0, "3DES CBC IV not updated");
+
+  des3_set3key_dec(&ctx3, key);
+  memset(iv, 0, sizeof(iv));
+  des3_crypt_cbc(&ctx3, DES_DECRYPT, sizeof(data), iv, expected, expected);
+  mu_assert(memcmp(expected, data, sizeof(data)) == 0,
+            "3DES CBC round trip differs");
+  mu_assert(des3_crypt_cbc(&ctx3, DES_DECRYPT, 5, iv, data, out) ==
+                ERR_DES_INVALID_INPUT_LENGTH,
+            "Partial CBC block accepted");
+
+  des3_free(&ctx3);
+
+  return NULL;
+}
+
+const char* testSha256_kernelsMatchScalar() {
+  const sha256_kernel kernels[] = {SHA256_KERNEL_SHANI, SHA256_KERNEL_AVX2};
+  const uint8 abcDigest[32] = {
+      0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40,
+      0xDE, 0x5D, 0xAE, 0x22, 0x23, 0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17,
+      0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD};
+  uint8 data[300];
+  uint8 expected[11][32];
+  uint8 digest[11][32];
+  uint8* input[11];
+  uint32 length[11];
+  sha256_context ctx[11];
+  size_t k = 0;
+  size_t i = 0;
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8)(i * 131 + 7);
+  }
+
+  // 11 messages: a full batch of lanes and a partial one, lengths across the
+  // 55/56 byte padding boundary
+  sha256_select(SHA256_KERNEL_SCALAR);
+  for (i = 0; i < 11; i++) {
+    input[i] = &data[i * 3];
+    length[i] = (uint32)(i * 26 + 3);
+    sha256_starts(&ctx[i]);
+    sha256_update(&ctx[i], data, (uint32)i);
+    sha256_update(&ctx[i], input[i], length[i]);
+    sha256_finish(&ctx[i], expected[i]);
+  }
+
+  sha256_starts(&ctx[0]);
+  sha256_update(&ctx[0], (uint8*)"abc", 3);
+  sha256_finish(&ctx[0], digest[0]);
+  mu_assert(memcmp(digest[0], abcDigest, 32) == 0, "scalar: wrong digest");
+
+  for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    sha256_kernel kernel = sha256_select(kernels[k]);
+
+    for (i = 0; i < 11; i++) {
+      sha256_starts(&ctx[i]);
+      sha256_update(&ctx[i], data, (uint32)i);
+    }
+    sha256_finish_multi(ctx, input, length, digest, 11);
+    for (i = 0; i < 11; i++) {
+      mu_assert(memcmp(digest[i], expected[i], 32) == 0,
+                "%s: message %zu differs", sha256_kernel_name(kernel), i);
+    }
+
+    sha256_starts(&ctx[0]);
+    sha256_update(&ctx[0], data, sizeof(data));
+    sha256_finish(&ctx[0], digest[0]);
+    sha256_select(SHA256_KERNEL_SCALAR);
+    sha256_starts(&ctx[1]);
+    sha256_update(&ctx[1], data, sizeof(data));
+    sha256_finish(&ctx[1], digest[1]);
+    mu_assert(memcmp(digest[0], digest[1], 32) == 0, "%s: long input differs",
+              sha256_kernel_name(kernel));
+  }
+  sha256_select(SHA256_KERNEL_AUTO);
+
+  return NULL;
+}
+
+const char* testMacSession_matchesGenerateMac() {
+  const char* key = "FD7549370776ADE3313EBA8632B5C83D";
+  const char* packet =
+      "080022380000008000059C00000426093106093106093106042620576HUK013010085C"
+      "242845";
+  unsigned char expected[65] = {'\0'};
+  unsigned char mac[65] = {'\0'};
+  MacSession* session = macSessionCreate(key);
+  MacSessionStream state = {session};
+  int i = 0;
+
+  mu_assert(session != NULL, "Error creating MAC session");
+  mu_assert(macSessionIsFor(session, key), "Session isn't for its own key");
+  mu_assert(!macSessionIsFor(session, "00000000000000000000000000000000"),
+            "Session is for another key");
+  mu_assert(macSessionCreate("FD75") == NULL, "Short key accepted");
+
+  generateMac(expected, (const unsigned char*)key, strlen(key),
+              (const unsigned char*)packet, strlen(packet));
+  // twice, to check the keyed state isn't consumed
+  for (i = 0; i < 2; i++) {
+    mu_assert(macSessionStreamInit(&state, NULL, 0) == 0,
+              "Error starting MAC");
+    macSessionStreamUpdate(&state, (const unsigned char*)packet,
+                           strlen(packet));
+    macSessionStreamFinal(&state, mac);
+  }
+  macSessionDestroy(session);
+
+  mu_assert(strcmp((char*)mac, (char*)expected) == 0, "Expected %s, got %s",
+            expected, mac);
+
+  return NULL;
+}
+
+const char* testUnpackDataWithMacVerify() {
+  const char* key = "FD7549370776ADE3313EBA8632B5C83D";
+  IsoMsg isoMsg = createIso8583();
+  MacSession* session = macSessionCreate(key);
+  MacSessionStream state = {session};
+  const MacStream macStream = {macSessionStreamInit, macSessionStreamUpdate,
+                               macSessionStreamFinal, &state};
+  unsigned char packet[512] = {'\0'};
+  unsigned char datum[65] = {'\0'};
+  int len = 0;
+
+  mu_assert(session != NULL, "Error creating MAC session");
+  setDatum(isoMsg, MESSAGE_TYPE_INDICATOR_0, (unsigned char*)"0810", 4);
+  setDatum(isoMsg, PROCESSING_CODE_3, (unsigned char*)"9C0000", 6);
+  setDatum(isoMsg, RESPONSE_CODE_39, (unsigned char*)"00", 2);
+  setDatum(isoMsg, CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41,
+           (unsigned char*)"2057HUK0", 8);
+  len = packDataWithMacStream(isoMsg, packet, sizeof(packet), NULL, 0,
+                              &macStream);
+  mu_assert(len > 64, "%s", getMessage(isoMsg));
+
+  resetIso8583(isoMsg);
+  mu_assert(unpackDataViewWithMacStreamVerify(isoMsg, packet, len, NULL, 0,
+                                              &macStream),
+            "%s", getMessage(isoMsg));
+  mu_assert(getDatum(isoMsg, MESSAGE_AUTHENTICATION_CODE_64, datum,
+                     sizeof(datum)) &&
+                memcmp(datum, &packet[len - 64], 64) == 0,
+            "MAC not unpacked");
+
+  packet[len - 20] ^= 0x01;
+  resetIso8583(isoMsg);
+  mu_assert(!unpackDataWithMacStreamVerify(isoMsg, packet, len, NULL, 0,
+                                           &macStream),
+            "Tampered MAC accepted");
+  mu_assert(strcmp(getMessage(isoMsg), "MAC mismatch") == 0, "%s",
+            getMessage(isoMsg));
+
+  packet[len - 20] ^= 0x01;
+  packet[30] ^= 0x01;
+  resetIso8583(isoMsg);
+  mu_assert(!unpackDataWithMacStreamVerify(isoMsg, packet, len, NULL, 0,
+                                           &macStream),
+            "Tampered packet accepted");
+
+  // a MacFunc given the key gives the same MAC
+  resetIso8583(isoMsg);
+  mu_assert(unpackDataWithMacVerify(isoMsg, packet, len,
+                                    (const unsigned char*)key, strlen(key),
+                                    generateMac) == 0,
+            "Tampered packet accepted by MacFunc");
+  packet[30] ^= 0x01;
+  resetIso8583(isoMsg);
+  mu_assert(unpackDataWithMacVerify(isoMsg, packet, len,
+                                    (const unsigned char*)key, strlen(key),
+                                    generateMac),
+            "%s", getMessage(isoMsg));
+
+  macSessionDestroy(session);
+  destroyIso8583(isoMsg);
+
+  return NULL;
+}
+
+static short setMacTestFields(IsoMsg isoMsg) {
+  const unsigned char pinBlock[16] = {0x3A, 0x00, 0x91, 0x7F, 0x00, 0x00,
+                                      0xC4, 0x12, 0x00, 0x55, 0xE0, 0x01,
+                                      0x02, 0x00, 0x8B, 0x6D};
+
+  setDatum(isoMsg, MESSAGE_TYPE_INDICATOR_0, (unsigned char*)"0200", 4);
+  setDatum(isoMsg, PROCESSING_CODE_3, (unsigned char*)"000000", 6);
+  setDatum(isoMsg, CARD_ACCEPTOR_TERMINAL_IDENTIFICATION_41,
+           (unsigned char*)"2057HUK0", 8);
+  return setDatum(isoMsg, PERSONAL_IDENTIFICATION_NUMBER_DATA_52, pinBlock,
+                  sizeof(pinBlock));
+}
+
+const char* testPackDataWithMacStream() {
+  const char* key = "FD7549370776ADE3313EBA8632B5C83D";
+  IsoMsg streamedMsg = createIso8583();
+  IsoMsg packedMsg = createIso8583();
+  MacSession* session = macSessionCreate(key);
+  MacSessionStream state = {session};
+  const MacStream macStream = {macSessionStreamInit, macSessionStreamUpdate,
+                               macSessionStreamFinal, &state};
+  unsigned char streamed[512] = {'\0'};
+  unsigned char packed[512] = {'\0'};
+  char expected[65] = {'\0'};
+  int streamedLen = 0;
+  int packedLen = 0;
+
+  mu_assert(session != NULL, "Error creating MAC session");
+  mu_assert(setMacTestFields(streamedMsg) == 0, "%s",
+            getMessage(streamedMsg));
+  setMacTestFields(packedMsg);
+
+  streamedLen = packDataWithMacStream(streamedMsg, streamed, sizeof(streamed),
+                                      NULL, 0, &macStream);
+  mu_assert(streamedLen > 64, "%s", getMessage(streamedMsg));
+  packedLen = packDataWithMac(packedMsg, packed, sizeof(packed),
+                              (const unsigned char*)key, strlen(key),
+                              generateMac);
+  mu_assert(packedLen == streamedLen, "%s", getMessage(packedMsg));
+  mu_assert(memcmp(packed, streamed, streamedLen) == 0,
+            "Streamed and packed MACs differ");
+
+  // the MAC covers the NULs of DE 52, not only the packet up to the first
+  macSessionDigest(session, expected, sizeof(expected), streamed,
+                   streamedLen - 64, HEX_CASE_UPPER);
+  mu_assert(memcmp(&streamed[streamedLen - 64], expected, 64) == 0,
+            "Expected MAC %s", expected);
+
+  macSessionDestroy(session);
+  destroyIso8583(streamedMsg);
+  destroyIso8583(packedMsg);
+
+  return NULL;
+}
+
+const char* testPrivateField_parseAndBuild() {
+  const PrivateFieldTag tags[] = {
+      PRIVATE_FIELD_TAG(3, Parameters, cardAcceptorID),
+      PRIVATE_FIELD_TAG(5, Parameters, currencyCode),
+      PRIVATE_FIELD_TAG(52, Parameters, merchantNameAndLocation),
+  };
+  const size_t count = sizeof(tags) / sizeof(tags[0]);
+  const char* de62 =
+      "0201420231017120000"  // not in the table
+      "03015" "2033LAGOS000001"
+      "05012" "566566566566"  // longer than currencyCode
+      "52040" "ITEX TEST MERCHANT      LA          LANG";
+  Parameters parameters;
+  Parameters rebuilt;
+  char buf[256] = {'\0'};
+  int len = 0;
+
+  memset(&parameters, 0x00, sizeof(parameters));
+  mu_assert(parsePrivateField(&parameters, tags, count, de62, strlen(de62)) ==
+                3,
+            "Expected 3 tags");
+  mu_assert(strcmp(parameters.cardAcceptorID, "2033LAGOS000001") == 0, "%s",
+            parameters.cardAcceptorID);
+  mu_assert(strcmp(parameters.currencyCode, "5665665") == 0, "%s",
+            parameters.currencyCode);
+  mu_assert(strcmp(parameters.merchantNameAndLocation,
+                   "ITEX TEST MERCHANT      LA          LANG") == 0,
+            "%s", parameters.merchantNameAndLocation);
+
+  len = buildPrivateField(buf, sizeof(buf), &parameters, tags, count);
+  mu_assert(len == (int)strlen(buf) && len == 5 * 3 + 15 + 7 + 40, "%s", buf);
+  memset(&rebuilt, 0x00, sizeof(rebuilt));
+  mu_assert(parsePrivateField(&rebuilt, tags, count, buf, len) == 3, "%s",
+            buf);
+  mu_assert(memcmp(&rebuilt, &parameters, sizeof(rebuilt)) == 0,
+            "Round trip differs");
+
+  mu_assert(buildPrivateField(buf, 20, &parameters, tags, count) < 0,
+            "Buffer too small accepted");
+  mu_assert(parsePrivateField(&rebuilt, tags, count, "03015SHORT", 10) < 0,
+            "Truncated value accepted");
+  mu_assert(parsePrivateField(&rebuilt, tags, count, "0A003abc", 8) < 0,
+            "Non-digit tag accepted");
+
+  return NULL;
+}
+
+const char* testEmvTlv_indexAndBuild() {
+  // DE 55 of the 0200 in doc/ISO.MD, 9F03 is repeated
+  const char* iccData =
+      "820258008407A0000003710001950542801418009F26087323FB67B1A9496C9F270180"
+      "9F10200FA501A23132140000000000000000000F010000000000000000000000000000"
+      "9F37043AC4F7D99F3602004F9A032303179C01009F02060000000001009F0306000000"
+      "0000005F2A0205669F1A0205669F03060000000000009F3303E0E9C89F34034203009F"
+      "3501229F090201009F410400000619";
+  const unsigned int tags[] = {0x9F26, 0x9F27, 0x9F10, 0x95};
+  EmvTlvIndex index;
+  EmvTlvIndex rebuiltIndex;
+  EmvTlvView views[4];
+  unsigned char rebuilt[256] = {'\0'};
+  unsigned char binary[256];
+  const unsigned char* value = NULL;
+  int length = 0;
+  int len = 0;
+  size_t i = 0;
+
+  mu_assert(emvTlvIndex(&index, (const unsigned char*)iccData,
+                        strlen(iccData), EMV_TLV_HEX) == 20,
+            "Expected 20 data objects");
+  mu_assert(emvTlvFind(&index, 0x9F26, &value, &length) && length == 16 &&
+                memcmp(value, "7323FB67B1A9496C", 16) == 0,
+            "Wrong 9F26");
+  mu_assert(emvTlvFind(&index, 0x9F10, &value, &length) && length == 64,
+            "Wrong 9F10");
+  mu_assert(emvTlvFind(&index, 0x95, &value, &length) && length == 10 &&
+                memcmp(value, "4280141800", 10) == 0,
+            "Wrong 95");
+  mu_assert(!emvTlvFind(&index, 0x9F27 << 8, &value, &length),
+            "Found a missing tag");
+
+  for (i = 0; i < 4; i++) {
+    views[i].tag = tags[i];
+    emvTlvFind(&index, tags[i], &views[i].value, &views[i].length);
+  }
+  len = emvTlvBuild(rebuilt, sizeof(rebuilt), views, 4, EMV_TLV_HEX);
+  mu_assert(len == (int)strlen((char*)rebuilt), "%s", rebuilt);
+  mu_assert(strcmp((char*)rebuilt,
+                   "9F26087323FB67B1A9496C9F2701809F10200FA501A231321400000000"
+                   "00000000000F0100000000000000000000000000009505428014180"
+                   "0") == 0,
+            "%s", rebuilt);
+  mu_assert(emvTlvBuild(rebuilt, 20, views, 4, EMV_TLV_HEX) < 0,
+            "Buffer too small accepted");
+
+  len = (int)hexDecode(binary, iccData, strlen(iccData));
+  mu_assert(emvTlvIndex(&rebuiltIndex, binary, len, EMV_TLV_BINARY) == 20,
+            "Binary: expected 20 data objects");
+  mu_assert(emvTlvFind(&rebuiltIndex, 0x9F27, &value, &length) &&
+                length == 1 && value[0] == 0x80,
+            "Binary: wrong 9F27");
+
+  mu_assert(!emvTlvIndex(&index, (const unsigned char*)"9F2608AABB", 10,
+                         EMV_TLV_HEX),
+            "Truncated value accepted");
+
+  return NULL;
+}
+
+const char* testBitmap_iterateSetFields() {
+  const int fields[] = {2, 3, 39, 64, 65, 100, 128};
+  const size_t count = sizeof(fields) / sizeof(fields[0]);
+  const char* mac =
+      "0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF";
+  C8583Bitmap bitmap;
+  unsigned char bytes[BITMAP_SIZE];
+  IsoMsg isoMsg = createIso8583();
+  IsoMsg unpacked = createIso8583();
+  unsigned char packet[256] = {'\0'};
+  unsigned char datum[65] = {'\0'};
+  int field = 0;
+  int len = 0;
+  size_t i = 0;
+
+  memset(&bitmap, 0x00, sizeof(bitmap));
+  for (i = 0; i < count; i++) {
+    setFieldBit(&bitmap, fields[i]);
+  }
+  mu_assert(isSecondaryBitmap(&bitmap), "Secondary bitmap not indicated");
+  mu_assert(countFieldBits(&bitmap) == (int)count, "Expected %zu fields",
+            count);
+
+  for (i = 0, field = nextFieldBit(&bitmap, 1); field;
+       i++, field = nextFieldBit(&bitmap, field)) {
+    mu_assert(i < count && field == fields[i], "Unexpected field %d", field);
+  }
+  mu_assert(i == count, "Expected %zu fields, iterated %zu", count, i);
+
+  bitmapToBytes(bytes, &bitmap);
+  mu_assert(bytes[0] == 0xE0 && bytes[7] == 0x01 && bytes[8] == 0x80 &&
+                bytes[15] == 0x01,
+            "Wrong bytes");
+
+  // field 128 used to be skipped when unpacking
+  setDatum(isoMsg, MESSAGE_TYPE_INDICATOR_0, (unsigned char*)"0800", 4);
+  setDatum(isoMsg, PROCESSING_CODE_3, (unsigned char*)"9A0000", 6);
+  mu_assert(setDatum(isoMsg, MESSAGE_AUTHENTICATION_CODE_128,
+                     (unsigned char*)mac, 64) == 0,
+            "%s", getMessage(isoMsg));
+  len = packData(isoMsg, packet, sizeof(packet));
+  mu_assert(len > 0, "%s", getMessage(isoMsg));
+  mu_assert(unpackData(unpacked, packet, len) == len, "%s",
+            getMessage(unpacked));
+  mu_assert(getDatum(unpacked, MESSAGE_AUTHENTICATION_CODE_128, datum,
+                     sizeof(datum)) &&
+                memcmp(datum, mac, 64) == 0,
+            "Field 128 not unpacked");
+
+  destroyIso8583(isoMsg);
+  destroyIso8583(unpacked);
+
+  return NULL;
+}
+
+const char* testFieldCodecs_matchConfig() {
+  const struct C8583Config bcdConfig = {
+      RESERVED_PRIVATE_62, LLL_VAR, NUMERIC, ASCII_ENCODING, BCD_ENCODING,
+      999};
+  struct C8583Config config;
+  struct IsoDataView view, expectedView;
+  unsigned char datum[99];
+  unsigned char packet[128], expected[128];
+  char message[128] = {'\0'};
+  unsigned int datumSize = 0;
+  int len = 0;
+  short field = 0;
+  short decoded = 0;
+
+  for (len = 0; len < (int)sizeof(datum); len++) {
+    datum[len] = '0' + len % 10;
+  }
+
+  for (field = PRIMARY_ACCOUNT_NUMBER_2; field < FIELD_END; field++) {
+    getC8583Config(&config, field);
+    datumSize = config.length < sizeof(datum) ? config.length : sizeof(datum);
+
+    len = encodeField(field, packet, sizeof(packet), datum, datumSize,
+                      message);
+    mu_assert(len == encodeDatum(expected, sizeof(expected), datum, datumSize,
+                                 &config, message) &&
+                  memcmp(packet, expected, len) == 0,
+              "F[%d] encoded differently: %s", field, message);
+    if (!len) continue;  // e.g. binary in, ASCII out has no encoder
+
+    decoded = decodeFieldView(&view, field, packet, len, message);
+    mu_assert(decoded == decodeDatumView(&expectedView, packet, len, &config,
+                                         message) &&
+                  (!decoded || memcmp(&view, &expectedView, sizeof(view)) == 0),
+              "F[%d] decoded differently: %s", field, message);
+    // variable length binary fields are packed with ASCII lengths, read as BCD
+    mu_assert(decoded ? view.jumper == (unsigned int)len &&
+                            view.size == datumSize
+                      : config.attribute == BINARY,
+              "F[%d] not round tripped: %s", field, message);
+  }
+
+  // length prefixes are written and read without going through strings
+  len = encodeDatum(packet, sizeof(packet), datum, 24, &bcdConfig, message);
+  mu_assert(len == 14 && packet[0] == 0x00 && packet[1] == 0x24 &&
+                packet[2] == 0x01,
+            "Wrong BCD length prefix");
+  mu_assert(decodeDatumView(&view, packet, len, &bcdConfig, message) &&
+                view.offset == 2 && view.size == 12,
+            "%s", message);
+
+  mu_assert(!decodeFieldView(&view, PRIMARY_ACCOUNT_NUMBER_2,
+                             (const unsigned char*)"1A1234567890", 12,
+                             message),
+            "Non-digit length accepted");
+
+  return NULL;
+}
+
+/**
+ * Listens on an ephemeral loopback port and points host at it
+ */
+static int listenOnLoopback(Host* host) {
+  struct sockaddr_in addr;
+  socklen_t addrLen = sizeof(addr);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&addr, '\0', sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(listener, 1) != 0 ||
+      getsockname(listener, (struct sockaddr*)&addr, &addrLen) != 0) {
+    if (listener >= 0) close(listener);
+    return -1;
+  }
+  host->port = ntohs(addr.sin_port);
+
+  return listener;
+}
+
+/**
+ * Replies to one request with a response split across three writes, then
+ * closes the connection or, if keepOpen, holds it open as a kept-alive host
+ * would
+ */
+static void serveInPieces(int listener, const char* response, size_t size,
+                          short keepOpen) {
+  unsigned char request[64];
+  int fd = accept(listener, NULL, NULL);
+
+  if (fd < 0) _exit(1);
+  if (read(fd, request, sizeof(request)) <= 0) _exit(1);
+  write(fd, response, 1);
+  usleep(50000);
+  write(fd, &response[1], size / 2);
+  usleep(50000);
+  write(fd, &response[1 + size / 2], size - 1 - size / 2);
+  if (keepOpen) sleep(3);
+  close(fd);
+  _exit(0);
+}
+
+const char* testComSendReceive_plainFramed() {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+  Host host = {"127.0.0.1", 0, CONNECTION_TYPE_PLAIN};
+  struct timespec start, end;
+  long elapsedMs = 0;
+  int listener = listenOnLoopback(&host);
+  int len = 0;
+  pid_t pid;
+
+  mu_assert(listener >= 0, "Unable to listen");
+
+  pid = fork();
+  if (pid == 0) serveInPieces(listener, "\x00\x0A" "0810223800", 12, 1);
+  close(listener);
+  mu_assert(pid > 0, "Unable to fork");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  len = comSendReceive(&response, &request, &host, 2000, comsIsFrameComplete,
+                       NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsedMs = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+
+  mu_assert(len == 12 && memcmp(&response.data[2], "0810223800", 10) == 0,
+            "Frame not reassembled, got %d bytes", len);
+  mu_assert(elapsedMs < 1000, "Waited %ldms for a complete frame", elapsedMs);
+
+  return NULL;
+}
+
+const char* testComSendReceive_noSentinelReadsToClose() {
+  const char* reply =
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n"
+      "{\"status\":\"ok\"}";
+  NetworkBuffer request = {"GET / HTTP/1.1\r\n\r\n", 18};
+  NetworkBuffer response = {{'\0'}, 0};
+  Host host = {"127.0.0.1", 0, CONNECTION_TYPE_PLAIN};
+  int listener = listenOnLoopback(&host);
+  int len = 0;
+  pid_t pid;
+
+  mu_assert(listener >= 0, "Unable to listen");
+
+  pid = fork();
+  if (pid == 0) serveInPieces(listener, reply, strlen(reply), 0);
+  close(listener);
+  mu_assert(pid > 0, "Unable to fork");
+
+  len = comSendReceive(&response, &request, &host, 2000, NULL, NULL);
+  waitpid(pid, NULL, 0);
+
+  mu_assert(len == (int)strlen(reply) &&
+                memcmp(response.data, reply, len) == 0,
+            "Response cut short, got %d of %zu bytes", len, strlen(reply));
+
+  return NULL;
+}
+
+const char* testComSendReceive_deadline() {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+  Host host = {"127.0.0.1", 0, CONNECTION_TYPE_SSL};
+  struct timespec start, end;
+  long elapsedMs = 0;
+  int listener = listenOnLoopback(&host);
+  int len = 0;
+
+  mu_assert(listener >= 0, "Unable to listen");
+
+  // the kernel completes the connect, nobody ever answers the TLS handshake
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  len = comSendReceive(&response, &request, &host, 300, comsIsFrameComplete,
+                       NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  close(listener);
+  elapsedMs = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+
+  mu_assert(len <= 0, "Got a response from a silent host");
+  mu_assert(elapsedMs >= 250 && elapsedMs < 1000,
+            "Gave up after %ldms instead of 300ms", elapsedMs);
+
+  return NULL;
+}
+
+const char* testHandshake_deadlineExceeded() {
+  Handshake_t handshake = HANDSHAKE_INIT_DATA;
+  struct timespec start, end;
+  long elapsedMs = 0;
+  int listener = listenOnLoopback(&handshake.handshakeHost);
+
+  mu_assert(listener >= 0, "Unable to listen");
+  handshake.comSendReceive = comSendReceive;
+  handshake.platform = PLATFORM_NIBSS;
+  handshake.operations =
+      HANDSHAKE_OPERATIONS_MASTER_KEY | HANDSHAKE_OPERATIONS_SESSION_KEY;
+  handshake.deadlineMs = 300;
+  strcpy(handshake.tid, "20390000");
+  strcpy(handshake.handshakeHost.url, "127.0.0.1");
+  handshake.handshakeHost.connectionType = CONNECTION_TYPE_PLAIN;
+
+  // the host accepts the connection and never replies
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  Handshake(&handshake);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  close(listener);
+  elapsedMs = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+
+  mu_assert(handshake.error.code == ERROR_CODE_HANDSHAKE_DEADLINE_EXCEEDED,
+            "%s", handshake.error.message);
+  mu_assert(elapsedMs < 1000, "Handshake ran %ldms on a 300ms budget",
+            elapsedMs);
+
+  return NULL;
+}
+
+const char* testHandshakeCtx_timeoutWithoutDeadline() {
+  Handshake_t handshake = HANDSHAKE_INIT_DATA;
+  HandshakeCtx* ctx = NULL;
+  int listener = listenOnLoopback(&handshake.handshakeHost);
+  int timeoutMs = 0;
+
+  mu_assert(listener >= 0, "Unable to listen");
+  handshake.comSendReceive = comSendReceive;
+  handshake.platform = PLATFORM_NIBSS;
+  handshake.operations = HANDSHAKE_OPERATIONS_MASTER_KEY;
+  strcpy(handshake.tid, "20390000");
+  strcpy(handshake.handshakeHost.url, "127.0.0.1");
+  handshake.handshakeHost.connectionType = CONNECTION_TYPE_PLAIN;
+
+  // the host accepts the connection and never replies
+  ctx = HandshakeCtx_Start(&handshake);
+  mu_assert(ctx != NULL && !HandshakeCtx_IsDone(ctx), "%s",
+            handshake.error.message);
+  timeoutMs = HandshakeCtx_TimeoutMs(ctx);
+  HandshakeCtx_Free(ctx);
+  close(listener);
+
+  mu_assert(timeoutMs > 0 && timeoutMs <= DEFAULT_TIMEOUT,
+            "Waiting %dms for an exchange with no deadline", timeoutMs);
+
+  return NULL;
+}
+
+const char* testOperationSteps_dependenciesComeFirst() {
+  HandshakeOperationBitmap before = HANDSHAKE_OPERATIONS_NONE;
+  size_t i = 0;
+
+  // HandshakeCtx runs the steps in table order
+  for (i = 0; i < HANDSHAKE_OPERATION_STEPS_COUNT; i++) {
+    const HandshakeOperationStep* step = &handshakeOperationSteps[i];
+
+    mu_assert((step->dependsOn & ~before) == 0,
+              "%s runs before its dependencies", step->errorMessage);
+    before |= step->operation;
+  }
+
+  return NULL;
+}
+
+#define LOOPBACK_MAX_CONNECTIONS 64
+
+/**
+ * Writes the reply to a framed request, header included, to response and
+ * returns its size, -1 to close the connection without replying
+ */
+typedef int (*LoopbackReply)(const unsigned char* request, int size,
+                             unsigned char* response, int capacity,
+                             void* userData);
+
+struct LoopbackHost;
+
+struct LoopbackConnection {
+  struct LoopbackHost* host;
+  int fd;
+  SSL* ssl;
+  pthread_t thread;
+};
+
+/**
+ * In-process host on an ephemeral loopback port, answering the 2-byte framed
+ * requests of each connection on a thread of its own
+ * @host: where to reach it
+ * @tls: context of TLS connections, NULL for plain ones
+ * @reply: builds the responses
+ * @userData: passed to reply
+ * @closeAfter: exchanges after which a connection is closed, 0 to keep it
+ * @accepted: connections accepted so far
+ * @exchanges: requests answered so far
+ * @serving: entries of connections in use
+ */
+typedef struct LoopbackHost {
+  Host host;
+  SSL_CTX* tls;
+  LoopbackReply reply;
+  void* userData;
+  int closeAfter;
+  int accepted;
+  int exchanges;
+  int listener;
+  int serving;
+  short stopping;
+  pthread_t acceptor;
+  struct LoopbackConnection connections[LOOPBACK_MAX_CONNECTIONS];
+} LoopbackHost;
+
+static int loopbackCount(int* counter) {
+  return __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Reads exactly size bytes, -1 if the peer closes first or the host stops
+ */
+static int loopbackRead(struct LoopbackConnection* connection,
+                        unsigned char* buf, int size) {
+  int got = 0;
+
+  while (got < size) {
+    struct pollfd pfd = {connection->fd, POLLIN, 0};
+    int n = 0;
+
+    if (__atomic_load_n(&connection->host->stopping, __ATOMIC_SEQ_CST)) {
+      return -1;
+    }
+    if ((connection->ssl == NULL || SSL_pending(connection->ssl) == 0) &&
+        poll(&pfd, 1, 20) <= 0) {
+      continue;
+    }
+
+    if (connection->ssl) {
+      n = SSL_read(connection->ssl, &buf[got], size - got);
+    } else {
+      n = recv(connection->fd, &buf[got], size - got, 0);
+    }
+    if (n <= 0) return -1;
+    got += n;
+  }
+
+  return got;
+}
+
+static int loopbackWrite(struct LoopbackConnection* connection,
+                         const unsigned char* buf, int size) {
+  if (connection->ssl) return SSL_write(connection->ssl, buf, size);
+  return send(connection->fd, buf, size, MSG_NOSIGNAL);
+}
+
+static void* serveLoopbackConnection(void* arg) {
+  struct LoopbackConnection* connection = (struct LoopbackConnection*)arg;
+  LoopbackHost* lh = connection->host;
+  unsigned char request[0x1000];
+  unsigned char response[0x1000];
+  int served = 0;
+
+  if (lh->tls) {
+    // a client that stalls mid handshake can't hold the host up for long
+    struct timeval timeout = {2, 0};
+
+    setsockopt(connection->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+               sizeof(timeout));
+    connection->ssl = SSL_new(lh->tls);
+    if (connection->ssl == NULL) goto done;
+    SSL_set_fd(connection->ssl, connection->fd);
+    if (SSL_accept(connection->ssl) != 1) goto done;
+  }
+
+  while (loopbackRead(connection, request, 2) == 2) {
+    int size = (request[0] << 8) + request[1];
+    int len = 0;
+
+    if (size > (int)sizeof(request) - 2 ||
+        loopbackRead(connection, &request[2], size) != size) {
+      break;
+    }
+    len = lh->reply(request, size + 2, response, sizeof(response),
+                    lh->userData);
+    if (len < 0 || loopbackWrite(connection, response, len) != len) break;
+    __sync_fetch_and_add(&lh->exchanges, 1);
+    if (lh->closeAfter && ++served == lh->closeAfter) break;
+  }
+
+done:
+  if (connection->ssl) SSL_shutdown(connection->ssl);
+  // the fd is closed once the host stops, so it can't be reused meanwhile
+  shutdown(connection->fd, SHUT_RDWR);
+
+  return NULL;
+}
+
+static void* acceptLoopbackConnections(void* arg) {
+  LoopbackHost* lh = (LoopbackHost*)arg;
+
+  while (!__atomic_load_n(&lh->stopping, __ATOMIC_SEQ_CST)) {
+    struct pollfd pfd = {lh->listener, POLLIN, 0};
+    struct LoopbackConnection* connection = NULL;
+    int fd = -1;
+
+    if (poll(&pfd, 1, 20) <= 0) continue;
+    fd = accept(lh->listener, NULL, NULL);
+    if (fd < 0) continue;
+    __sync_fetch_and_add(&lh->accepted, 1);
+    if (lh->serving == LOOPBACK_MAX_CONNECTIONS) {
+      close(fd);
+      continue;
+    }
+
+    connection = &lh->connections[lh->serving];
+    connection->host = lh;
+    connection->fd = fd;
+    connection->ssl = NULL;
+    if (pthread_create(&connection->thread, NULL, serveLoopbackConnection,
+                       connection) != 0) {
+      close(fd);
+      continue;
+    }
+    lh->serving++;
+  }
+
+  return NULL;
+}
+
+/**
+ * Starts a host serving TLS with tls, or plain connections if it is NULL
+ */
+static int startLoopbackTlsHost(LoopbackHost* lh, SSL_CTX* tls,
+                                LoopbackReply reply, void* userData,
+                                int closeAfter) {
+  memset(lh, '\0', sizeof(LoopbackHost));
+  strcpy(lh->host.url, "127.0.0.1");
+  lh->host.connectionType =
+      tls ? CONNECTION_TYPE_SSL : CONNECTION_TYPE_PLAIN;
+  lh->tls = tls;
+  lh->reply = reply;
+  lh->userData = userData;
+  lh->closeAfter = closeAfter;
+
+  lh->listener = listenOnLoopback(&lh->host);
+  if (lh->listener < 0) return -1;
+  if (pthread_create(&lh->acceptor, NULL, acceptLoopbackConnections, lh) !=
+      0) {
+    close(lh->listener);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int startLoopbackHost(LoopbackHost* lh, LoopbackReply reply,
+                             void* userData, int closeAfter) {
+  return startLoopbackTlsHost(lh, NULL, reply, userData, closeAfter);
+}
+
+static void stopLoopbackHost(LoopbackHost* lh) {
+  int i = 0;
+
+  __atomic_store_n(&lh->stopping, 1, __ATOMIC_SEQ_CST);
+  pthread_join(lh->acceptor, NULL);
+  for (i = 0; i < lh->serving; i++) {
+    pthread_join(lh->connections[i].thread, NULL);
+    SSL_free(lh->connections[i].ssl);
+    close(lh->connections[i].fd);
+  }
+  close(lh->listener);
+}
+
+/**
+ * Server context with a throwaway self-signed certificate
+ */
+static SSL_CTX* newLoopbackTlsContext(void) {
+  SSL_CTX* tls = SSL_CTX_new(TLS_server_method());
+  EVP_PKEY_CTX* keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+  EVP_PKEY* key = NULL;
+  X509* cert = X509_new();
+  X509_NAME* name = NULL;
+  short ok = 0;
+
+  if (tls == NULL || keyContext == NULL || cert == NULL ||
+      EVP_PKEY_keygen_init(keyContext) != 1 ||
+      EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext,
+                                             NID_X9_62_prime256v1) != 1 ||
+      EVP_PKEY_keygen(keyContext, &key) != 1) {
+    goto done;
+  }
+
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             (const unsigned char*)"localhost", -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  ok = X509_sign(cert, key, EVP_sha256()) > 0 &&
+       SSL_CTX_use_certificate(tls, cert) == 1 &&
+       SSL_CTX_use_PrivateKey(tls, key) == 1;
+
+done:
+  EVP_PKEY_CTX_free(keyContext);
+  EVP_PKEY_free(key);
+  X509_free(cert);
+  if (!ok) {
+    SSL_CTX_free(tls);
+    return NULL;
+  }
+
+  return tls;
+}
+
+/**
+ * Replies to every request with the same 10-byte frame
+ */
+static int replyFrame(const unsigned char* request, int size,
+                      unsigned char* response, int capacity, void* userData) {
+  (void)request;
+  (void)size;
+  (void)capacity;
+  (void)userData;
+
+  memcpy(response, "\x00\x0A" "0810223800", 12);
+  return 12;
+}
+
+#define MOCK_COMPONENT_KEY "0123456789ABCDEFFEDCBA9876543210"
+#define MOCK_MASTER_KEY "11223344556677889900AABBCCDDEEFF"
+#define MOCK_SESSION_KEY "A1B2C3D4E5F60718293A4B5C6D7E8F90"
+#define MOCK_PIN_KEY "0F1E2D3C4B5A69788796A5B4C3D2E1F0"
+#define MOCK_DE62                                                      \
+  "02014" "20231017120000" "03015" "2033LAGOS000001" "04002" "60"      \
+  "05003566" "06003566" "07001" "1" "08004" "5999"                     \
+  "52040" "ITEX TEST MERCHANT      LA          LANG"
+
+/**
+ * DE 53 of a key download: clear encrypted under key, then the check value
+ * of clear, zero padded
+ */
+static void mockKeyField(char* de53, const char* clear, const char* under) {
+  unsigned char clearBin[16], underBin[16], encrypted[16];
+  unsigned char zeros[8] = {0};
+  unsigned char kcv[8];
+
+  hexDecode(clearBin, clear, 32);
+  hexDecode(underBin, under, 32);
+  des3_ecb_encrypt(encrypted, clearBin, 16, underBin, 16);
+  des3_ecb_encrypt(kcv, zeros, 8, clearBin, 16);
+
+  memset(de53, '0', 96);
+  hexEncode(de53, encrypted, 16, HEX_CASE_UPPER);
+  hexEncode(&de53[32], kcv, 3, HEX_CASE_UPPER);
+  de53[96] = '\0';
+}
+
+/**
+ * Replies to NIBSS network management requests as the NIBSS test host does,
+ * with the MOCK_ keys
+ */
+static int replyLikeNibss(const unsigned char* request, int size,
+                          unsigned char* response, int capacity,
+                          void* userData) {
+  const int fields[] = {3, 7, 11, 12, 13, 39, 41};
+  char body[0x400];
+  char proc[3] = {'\0'};
+  char tid[9] = {'\0'};
+  char de53[97] = {'\0'};
+  unsigned long long bitmap = 0;
+  short macced = 1;
+  size_t i = 0;
+  int len = 0;
+
+  (void)userData;
+  // MTI, bitmap and the fixed size DE 3, 7, 11, 12 and 13 come before DE 41
+  if (size < 2 + 60) return -1;
+  memcpy(proc, &request[2 + 20], 2);
+  memcpy(tid, &request[2 + 52], 8);
+
+  for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    bitmap |= 1ULL << (64 - fields[i]);
+  }
+  if (strcmp(proc, "9A") == 0) {
+    mockKeyField(de53, MOCK_MASTER_KEY, MOCK_COMPONENT_KEY);
+  } else if (strcmp(proc, "9B") == 0) {
+    mockKeyField(de53, MOCK_SESSION_KEY, MOCK_MASTER_KEY);
+  } else if (strcmp(proc, "9G") == 0) {
+    mockKeyField(de53, MOCK_PIN_KEY, MOCK_MASTER_KEY);
+  }
+  if (de53[0]) {
+    bitmap |= 1ULL << (64 - 53);
+    macced = 0;
+  }
+  if (strcmp(proc, "9C") == 0) bitmap |= 1ULL << (64 - 62);
+  if (strcmp(proc, "9E") == 0 || strcmp(proc, "9F") == 0) {
+    bitmap |= 1ULL << (64 - 63);
+  }
+  if (macced) bitmap |= 1ULL << (64 - 64);
+
+  len = snprintf(body, sizeof(body),
+                 "0810%016llX%s0000" "1017120000" "120000" "120000" "1017"
+                 "00" "%s%s",
+                 bitmap, proc, tid, de53);
+  if (strcmp(proc, "9C") == 0) {
+    len += snprintf(&body[len], sizeof(body) - len, "%03d%s",
+                    (int)strlen(MOCK_DE62), MOCK_DE62);
+  } else if (bitmap & (1ULL << (64 - 63))) {
+    len += snprintf(&body[len], sizeof(body) - len, "0004TEST");
+  }
+  if (macced) {
+    len += generateMac((unsigned char*)&body[len],
+                       (const unsigned char*)MOCK_SESSION_KEY, 32,
+                       (const unsigned char*)body, len);
+  }
+  if (len + 2 > capacity) return -1;
+
+  response[0] = len >> 8;
+  response[1] = len & 0xFF;
+  memcpy(&response[2], body, len);
+
+  return len + 2;
+}
+
+static int mockCallHomeData(char* data, const size_t len) {
+  snprintf(data, len, "{\"x\":1}");
+  return 1;
+}
+
+/**
+ * Points a handshake at a replyLikeNibss host
+ */
+static void setUpMockHandshake(Handshake_t* handshake, const Host* host,
+                               HandshakeOperationBitmap operations) {
+  memset(handshake, '\0', sizeof(Handshake_t));
+  handshake->comSendReceive = comSendReceive;
+  handshake->getCallHomeData = mockCallHomeData;
+  handshake->platform = PLATFORM_NIBSS;
+  handshake->operations = operations;
+  strcpy(handshake->tid, "20390000");
+  strcpy(handshake->deviceInfo.posUid, "P051200187041");
+  strcpy(handshake->tmsResponse.componentKey, MOCK_COMPONENT_KEY);
+  memcpy(&handshake->handshakeHost, host, sizeof(Host));
+  memcpy(&handshake->callHomeHost, host, sizeof(Host));
+}
+
+typedef struct PoolWaiter {
+  ComsPool* pool;
+  const Host* host;
+  ComsSession* session;
+} PoolWaiter;
+
+static void* acquireFromPool(void* arg) {
+  PoolWaiter* waiter = (PoolWaiter*)arg;
+
+  __atomic_store_n(&waiter->session,
+                   comsPoolAcquire(waiter->pool, waiter->host, 2000),
+                   __ATOMIC_SEQ_CST);
+  return NULL;
+}
+
+const char* testComsPool_maxPerHostWaits() {
+  ComsPoolOptions options = {4, 1, 0};
+  ComsPool* pool = comsPoolCreate(&options);
+  Host host = {"127.0.0.1", 1, CONNECTION_TYPE_PLAIN};
+  Host other = {"127.0.0.1", 2, CONNECTION_TYPE_PLAIN};
+  PoolWaiter waiter = {pool, &host, NULL};
+  ComsSession* lent = comsPoolAcquire(pool, &host, 100);
+  ComsSession* overLimit = NULL;
+  ComsSession* elsewhere = NULL;
+  pthread_t thread;
+
+  mu_assert(lent != NULL, "First session not lent");
+  overLimit = comsPoolAcquire(pool, &host, 100);
+  mu_assert(overLimit == NULL, "Lent past maxPerHost");
+  elsewhere = comsPoolAcquire(pool, &other, 100);
+  mu_assert(elsewhere != NULL, "Other host held back by maxPerHost");
+
+  mu_assert(pthread_create(&thread, NULL, acquireFromPool, &waiter) == 0,
+            "Unable to start waiter");
+  usleep(100000);
+  mu_assert(__atomic_load_n(&waiter.session, __ATOMIC_SEQ_CST) == NULL,
+            "Waiter didn't wait for a release");
+  comsPoolRelease(pool, lent);
+  pthread_join(thread, NULL);
+  mu_assert(waiter.session != NULL, "Waiter not woken by the release");
+
+  comsPoolRelease(pool, waiter.session);
+  comsPoolRelease(pool, elsewhere);
+  comsPoolDestroy(pool);
+
+  return NULL;
+}
+
+static int exchangeOver(ComsSession* session) {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+
+  return comsSessionSendReceive(session, &response, &request, 2000,
+                                comsIsFrameComplete, NULL);
+}
+
+static int exchangeThrough(ComsPool* pool, Host* host) {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+
+  return comsPoolSendReceive(pool, &response, &request, host, 2000,
+                             comsIsFrameComplete, NULL);
+}
+
+const char* testComsPool_maxIdle() {
+  ComsPoolOptions options = {1, 0, 0};
+  ComsPool* pool = comsPoolCreate(&options);
+  LoopbackHost lh;
+  ComsSession* first = NULL;
+  ComsSession* second = NULL;
+  int round = 0;
+
+  mu_assert(startLoopbackHost(&lh, replyFrame, NULL, 0) == 0,
+            "Unable to start host");
+
+  for (round = 0; round < 2; round++) {
+    first = comsPoolAcquire(pool, &lh.host, 100);
+    second = comsPoolAcquire(pool, &lh.host, 100);
+    mu_assert(exchangeOver(first) == 12 && exchangeOver(second) == 12,
+              "Exchange failed in round %d", round);
+    comsPoolRelease(pool, first);
+    comsPoolRelease(pool, second);
+  }
+  comsPoolDestroy(pool);
+  stopLoopbackHost(&lh);
+
+  // the 2nd round reuses the one connection kept idle and opens another
+  mu_assert(loopbackCount(&lh.accepted) == 3,
+            "%d connections for maxIdle 1, expected 3",
+            loopbackCount(&lh.accepted));
+
+  return NULL;
+}
+
+const char* testComsPool_idleTimeout() {
+  ComsPoolOptions options = {4, 0, 50};
+  ComsPool* pool = comsPoolCreate(&options);
+  LoopbackHost lh;
+  int warm = 0;
+
+  mu_assert(startLoopbackHost(&lh, replyFrame, NULL, 0) == 0,
+            "Unable to start host");
+
+  mu_assert(exchangeThrough(pool, &lh.host) == 12 &&
+                exchangeThrough(pool, &lh.host) == 12,
+            "Exchange failed");
+  warm = loopbackCount(&lh.accepted);
+  usleep(120000);
+  mu_assert(exchangeThrough(pool, &lh.host) == 12, "Exchange failed");
+  comsPoolDestroy(pool);
+  stopLoopbackHost(&lh);
+
+  mu_assert(warm == 1, "Idle connection not reused, %d opened", warm);
+  mu_assert(loopbackCount(&lh.accepted) == 2,
+            "Connection idle past the timeout reused");
+
+  return NULL;
+}
+
+/**
+ * Swaps the default pool on the first request, then replies with reply
+ */
+typedef struct PoolSwap {
+  LoopbackReply reply;
+  ComsPool* swapTo;
+} PoolSwap;
+
+static int replySwappingPool(const unsigned char* request, int size,
+                             unsigned char* response, int capacity,
+                             void* userData) {
+  PoolSwap* swap = (PoolSwap*)userData;
+
+  comsSetDefaultPool(swap->swapTo);
+  return swap->reply(request, size, response, capacity, NULL);
+}
+
+const char* testComsPool_defaultSwappedMidRun() {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+  ComsPoolOptions options = {0, 1, 0};
+  ComsPool* pool = comsPoolCreate(&options);
+  ComsPool* swapped = comsPoolCreate(&options);
+  PoolSwap swap = {replyFrame, swapped};
+  Handshake_t handshake;
+  ComsSession* session = NULL;
+  LoopbackHost lh;
+  int len = 0;
+
+  mu_assert(startLoopbackHost(&lh, replySwappingPool, &swap, 0) == 0,
+            "Unable to start host");
+
+  comsSetDefaultPool(pool);
+  len = comSendReceive(&response, &request, &lh.host, 2000,
+                       comsIsFrameComplete, NULL);
+  mu_assert(len == 12, "Exchange failed");
+  // maxPerHost 1: only lent again if the session went back to pool
+  session = comsPoolAcquire(pool, &lh.host, 100);
+  mu_assert(session != NULL, "Exchange released to the swapped in pool");
+  comsPoolRelease(pool, session);
+
+  swap.reply = replyLikeNibss;
+  comsSetDefaultPool(pool);
+  setUpMockHandshake(&handshake, &lh.host,
+                     HANDSHAKE_OPERATIONS_MASTER_KEY |
+                         HANDSHAKE_OPERATIONS_SESSION_KEY);
+  handshake.reuseConnection = 1;
+  Handshake(&handshake);
+  mu_assert(handshake.error.code == ERROR_CODE_NO_ERROR, "Handshake failed: %s",
+            handshake.error.message);
+  session = comsPoolAcquire(pool, &lh.host, 100);
+  mu_assert(session != NULL, "Handshake released to the swapped in pool");
+  comsPoolRelease(pool, session);
+
+  comsSetDefaultPool(NULL);
+  stopLoopbackHost(&lh);
+  comsPoolDestroy(swapped);
+  comsPoolDestroy(pool);
+
+  return NULL;
+}
+
+const char* testComs_noSentinelOnKeptAlive() {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+  ComsPoolOptions options = {4, 0, 0};
+  ComsPool* pool = comsPoolCreate(&options);
+  ComsSession* session = NULL;
+  LoopbackHost keepAlive, closing;
+  struct timespec start, end;
+  long elapsedMs = 0;
+  int len = 0;
+
+  mu_assert(startLoopbackHost(&keepAlive, replyFrame, NULL, 0) == 0 &&
+                startLoopbackHost(&closing, replyFrame, NULL, 1) == 0,
+            "Unable to start hosts");
+
+  // refused up front rather than read until the deadline
+  session = comsSessionCreate(&keepAlive.host);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  len = comsSessionSendReceive(session, &response, &request, 2000, NULL,
+                               NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  comsSessionDestroy(session);
+  elapsedMs = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+  mu_assert(len <= 0 && elapsedMs < 100,
+            "Sentinel-less exchange on a session took %ldms, got %d bytes",
+            elapsedMs, len);
+
+  // a host that never closes leaves a sentinel-less response unfinished
+  comsSetDefaultPool(pool);
+  len = comSendReceive(&response, &request, &keepAlive.host, 300, NULL, NULL);
+  mu_assert(len <= 0, "Response cut short by the deadline taken as whole");
+
+  len = comSendReceive(&response, &request, &closing.host, 2000, NULL, NULL);
+  mu_assert(len == 12 && memcmp(&response.data[2], "0810223800", 10) == 0,
+            "Response read to close not whole, got %d bytes", len);
+  len = comSendReceive(&response, &request, &closing.host, 2000, NULL, NULL);
+  comsSetDefaultPool(NULL);
+  comsPoolDestroy(pool);
+  stopLoopbackHost(&keepAlive);
+  stopLoopbackHost(&closing);
+
+  mu_assert(len == 12 && loopbackCount(&closing.accepted) == 2,
+            "Sentinel-less exchanges pooled");
+
+  return NULL;
+}
+
+/**
+ * Drives ctx to the end like an event loop would, -1 if it stalls
+ */
+static int runHandshakeCtx(HandshakeCtx* ctx) {
+  while (!HandshakeCtx_IsDone(ctx)) {
+    struct pollfd pfd = {HandshakeCtx_Fd(ctx), 0, 0};
+    int wanted = HandshakeCtx_WantedEvents(ctx);
+    int timeoutMs = HandshakeCtx_TimeoutMs(ctx);
+
+    if (wanted & COMS_EVENT_READ) pfd.events |= POLLIN;
+    if (wanted & COMS_EVENT_WRITE) pfd.events |= POLLOUT;
+    if (poll(&pfd, 1, timeoutMs < 0 ? 5000 : timeoutMs) < 0) return -1;
+
+    if (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) {
+      HandshakeCtx_OnWritable(ctx);
+    } else {
+      HandshakeCtx_OnReadable(ctx);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Replies as NIBSS, with a header promising 10 more bytes than follow
+ */
+static int replyTruncatedFrame(const unsigned char* request, int size,
+                               unsigned char* response, int capacity,
+                               void* userData) {
+  int len = replyLikeNibss(request, size, response, capacity, userData);
+  int promised = len - 2 + 10;
+
+  response[0] = promised >> 8;
+  response[1] = promised & 0xFF;
+  return len;
+}
+
+const char* testHandshakeCtx_framedExchange() {
+  Handshake_t handshake;
+  const Key* master = &handshake.networkManagementResponse.master;
+  const Key* session = &handshake.networkManagementResponse.session;
+  HandshakeCtx* ctx = NULL;
+  LoopbackHost lh;
+
+  mu_assert(startLoopbackHost(&lh, replyLikeNibss, NULL, 0) == 0,
+            "Unable to start host");
+  setUpMockHandshake(&handshake, &lh.host,
+                     HANDSHAKE_OPERATIONS_MASTER_KEY |
+                         HANDSHAKE_OPERATIONS_SESSION_KEY);
+
+  ctx = HandshakeCtx_Start(&handshake);
+  mu_assert(ctx != NULL, "Context not created");
+  mu_assert(runHandshakeCtx(ctx) == 0, "Handshake stalled");
+  HandshakeCtx_Free(ctx);
+  stopLoopbackHost(&lh);
+
+  mu_assert(handshake.error.code == ERROR_CODE_NO_ERROR, "%s",
+            handshake.error.message);
+  mu_assert(strcmp((const char*)master->key, MOCK_MASTER_KEY) == 0 &&
+                strcmp((const char*)session->key, MOCK_SESSION_KEY) == 0,
+            "Keys not decrypted from the responses");
+
+  return NULL;
+}
+
+const char* testHandshakeCtx_truncatedFrame() {
+  Handshake_t handshake;
+  HandshakeCtx* ctx = NULL;
+  LoopbackHost lh;
+
+  // the host closes the connection 10 bytes short of a valid response
+  mu_assert(startLoopbackHost(&lh, replyTruncatedFrame, NULL, 1) == 0,
+            "Unable to start host");
+  setUpMockHandshake(&handshake, &lh.host, HANDSHAKE_OPERATIONS_MASTER_KEY);
+
+  ctx = HandshakeCtx_Start(&handshake);
+  mu_assert(ctx != NULL, "Context not created");
+  mu_assert(runHandshakeCtx(ctx) == 0, "Handshake stalled");
+  HandshakeCtx_Free(ctx);
+  stopLoopbackHost(&lh);
+
+  mu_assert(handshake.error.code != ERROR_CODE_NO_ERROR,
+            "Truncated frame taken as a response");
+
+  return NULL;
+}
+
+static int gTransportCalls = 0;
+
+static int countingSendReceive(NetworkBuffer* response, NetworkBuffer* request,
+                               Host* host, int receiveTimeoutms,
+                               const ComSentinel recevSentinel,
+                               const char* endTag) {
+  __sync_fetch_and_add(&gTransportCalls, 1);
+  return comSendReceive(response, request, host, receiveTimeoutms,
+                        recevSentinel, endTag);
+}
+
+/**
+ * Runs master, session and PIN key with reuseConnection against a
+ * replyLikeNibss host closing connections after closeAfter exchanges
+ */
+static const char* runReusingHandshake(LoopbackHost* lh, int closeAfter,
+                                       ComSendReceive transport) {
+  Handshake_t handshake;
+
+  mu_assert(startLoopbackHost(lh, replyLikeNibss, NULL, closeAfter) == 0,
+            "Unable to start host");
+  setUpMockHandshake(&handshake, &lh->host,
+                     HANDSHAKE_OPERATIONS_MASTER_KEY |
+                         HANDSHAKE_OPERATIONS_SESSION_KEY |
+                         HANDSHAKE_OPERATIONS_PIN_KEY);
+  handshake.comSendReceive = transport;
+  handshake.reuseConnection = 1;
+  Handshake(&handshake);
+  stopLoopbackHost(lh);
+
+  mu_assert(handshake.error.code == ERROR_CODE_NO_ERROR, "%s",
+            handshake.error.message);
+  mu_assert(loopbackCount(&lh->exchanges) == 3, "%d exchanges, expected 3",
+            loopbackCount(&lh->exchanges));
+
+  return NULL;
+}
+
+const char* testHandshake_reuseConnection() {
+  LoopbackHost lh;
+  const char* message = NULL;
+
+  message = runReusingHandshake(&lh, 0, comSendReceive);
+  if (message) return message;
+  mu_assert(loopbackCount(&lh.accepted) == 1,
+            "%d connections for one run, expected 1",
+            loopbackCount(&lh.accepted));
+
+  // the host closes after every exchange, each operation reconnects
+  message = runReusingHandshake(&lh, 1, comSendReceive);
+  if (message) return message;
+  mu_assert(loopbackCount(&lh.accepted) == 3,
+            "%d connections to a closing host, expected 3",
+            loopbackCount(&lh.accepted));
+
+  gTransportCalls = 0;
+  message = runReusingHandshake(&lh, 0, countingSendReceive);
+  if (message) return message;
+  mu_assert(gTransportCalls == 3, "Custom comSendReceive called %d times",
+            gTransportCalls);
+
+  return NULL;
+}
+
+/**
+ * Replies as NIBSS except to parameters downloads, which get no reply
+ */
+static int replyFailingParameters(const unsigned char* request, int size,
+                                  unsigned char* response, int capacity,
+                                  void* userData) {
+  if (size > 2 + 22 && memcmp(&request[2 + 20], "9C", 2) == 0) return -1;
+  return replyLikeNibss(request, size, response, capacity, userData);
+}
+
+/**
+ * Runs every operation with reuseConnection, the wave after the session key
+ * concurrently if concurrent
+ */
+static void runAllOperations(Handshake_t* handshake, LoopbackReply reply,
+                             short concurrent) {
+  LoopbackHost lh;
+
+  if (startLoopbackHost(&lh, reply, NULL, 0) != 0) {
+    handshake->error.code = ERROR_CODE_HANDSHAKE_RUN_ERROR;
+    return;
+  }
+  setUpMockHandshake(handshake, &lh.host, 0x7F);
+  handshake->reuseConnection = 1;
+  handshake->concurrentOperations = concurrent;
+  Handshake(handshake);
+  stopLoopbackHost(&lh);
+}
+
+const char* testHandshake_concurrentMatchesSequential() {
+  // fewer connections per host than the wave has operations
+  ComsPoolOptions options = {4, 2, 0};
+  ComsPool* pool = comsPoolCreate(&options);
+  Handshake_t sequential, concurrent;
+  const NetworkManagementResponse* merged =
+      &concurrent.networkManagementResponse;
+
+  comsSetDefaultPool(pool);
+  runAllOperations(&sequential, replyLikeNibss, 0);
+  runAllOperations(&concurrent, replyLikeNibss, 1);
+
+  mu_assert(sequential.error.code == ERROR_CODE_NO_ERROR &&
+                concurrent.error.code == ERROR_CODE_NO_ERROR,
+            "Handshake failed: '%s' '%s'", sequential.error.message,
+            concurrent.error.message);
+  mu_assert(strcmp((const char*)merged->pin.key, MOCK_PIN_KEY) == 0 &&
+                strcmp(merged->parameters.merchantCategoryCode, "5999") == 0,
+            "PIN key or parameters not copied back");
+  mu_assert(memcmp(&sequential.networkManagementResponse, merged,
+                   sizeof(NetworkManagementResponse)) == 0,
+            "Concurrent response differs from the sequential one");
+
+  // the parameters error is reported either way, the PIN key still kept
+  runAllOperations(&sequential, replyFailingParameters, 0);
+  runAllOperations(&concurrent, replyFailingParameters, 1);
+  comsSetDefaultPool(NULL);
+  comsPoolDestroy(pool);
+
+  mu_assert(sequential.error.code != ERROR_CODE_NO_ERROR &&
+                concurrent.error.code == sequential.error.code &&
+                strcmp(concurrent.error.message, sequential.error.message) ==
+                    0,
+            "Concurrent error '%s' isn't the sequential '%s'",
+            concurrent.error.message, sequential.error.message);
+  mu_assert(strcmp((const char*)merged->pin.key, MOCK_PIN_KEY) == 0,
+            "PIN key lost to the parameters error");
+
+  return NULL;
+}
+
+/**
+ * One exchange on a connection of its own, read past the response so TLS
+ * 1.3 tickets are taken in
+ */
+static int exchangeOnce(Host* host) {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+
+  return comSendReceive(&response, &request, host, 2000, comsIsFrameComplete,
+                        NULL);
+}
+
+const char* testComsTls_sessionCache() {
+  const int others = COMS_TLS_SESSION_CACHE_SIZE;
+  SSL_CTX* tls = newLoopbackTlsContext();
+  LoopbackHost* hosts = NULL;
+  LoopbackHost* lh = NULL;
+  Host byName;
+  ComsTlsStats stats;
+  int i = 0;
+
+  mu_assert(tls != NULL, "Unable to create a TLS context");
+  hosts = (LoopbackHost*)calloc(others + 1, sizeof(LoopbackHost));
+  mu_assert(hosts != NULL, "Out of memory");
+  for (i = 0; i <= others; i++) {
+    mu_assert(startLoopbackTlsHost(&hosts[i], tls, replyFrame, NULL, 0) == 0,
+              "Unable to start host %d", i);
+  }
+  lh = &hosts[others];
+  memcpy(&byName, &lh->host, sizeof(Host));
+  strcpy(byName.url, "localhost");
+
+  comsSetTlsSessionTickets(1);
+  comsClearTlsSessions();
+  comsResetTlsStats();
+
+  // the 2nd connect resumes, the same host by another name doesn't
+  mu_assert(exchangeOnce(&lh->host) == 12 && exchangeOnce(&lh->host) == 12,
+            "Exchange failed");
+  comsGetTlsStats(&stats);
+  mu_assert(stats.fullHandshakes == 1 && stats.resumedHandshakes == 1,
+            "%lu full, %lu resumed handshakes to one host",
+            stats.fullHandshakes, stats.resumedHandshakes);
+  mu_assert(exchangeOnce(&byName) == 12 && exchangeOnce(&byName) == 12,
+            "Exchange failed");
+  comsGetTlsStats(&stats);
+  mu_assert(stats.fullHandshakes == 2 && stats.resumedHandshakes == 2,
+            "Session shared between localhost and 127.0.0.1");
+
+  // without tickets there's nothing to resume a TLS 1.3 session with
+  comsSetTlsSessionTickets(0);
+  comsClearTlsSessions();
+  comsResetTlsStats();
+  mu_assert(exchangeOnce(&lh->host) == 12 && exchangeOnce(&lh->host) == 12,
+            "Exchange failed");
+  comsGetTlsStats(&stats);
+  mu_assert(stats.fullHandshakes == 2 && stats.resumedHandshakes == 0,
+            "Resumed %lu handshakes with tickets off",
+            stats.resumedHandshakes);
+  comsSetTlsSessionTickets(1);
+
+  // a full cache drops the host used least recently
+  comsClearTlsSessions();
+  comsResetTlsStats();
+  mu_assert(exchangeOnce(&lh->host) == 12, "Exchange failed");
+  for (i = 0; i < others; i++) {
+    mu_assert(exchangeOnce(&hosts[i].host) == 12, "Exchange %d failed", i);
+  }
+  mu_assert(exchangeOnce(&hosts[others - 1].host) == 12 &&
+                exchangeOnce(&lh->host) == 12,
+            "Exchange failed");
+  comsGetTlsStats(&stats);
+  mu_assert(stats.fullHandshakes == (unsigned long)others + 2 &&
+                stats.resumedHandshakes == 1,
+            "%lu full, %lu resumed handshakes, evicted session reused",
+            stats.fullHandshakes, stats.resumedHandshakes);
+
+  comsClearTlsSessions();
+  for (i = 0; i <= others; i++) stopLoopbackHost(&hosts[i]);
+  free(hosts);
+  SSL_CTX_free(tls);
+
+  return NULL;
+}
+
+const char* testComsDns_cacheTtl() {
+  Host host = {"localhost", 1, CONNECTION_TYPE_PLAIN};
+  ComsDnsStats stats;
+
+  comsClearDnsCache();
+  comsResetDnsStats();
+  mu_assert(comsResolveHost(&host) == 0 && comsResolveHost(&host) == 0,
+            "Unable to resolve localhost");
+  comsGetDnsStats(&stats);
+  mu_assert(stats.lookups == 1 && stats.hits == 1,
+            "%lu lookups, %lu hits resolving twice within the TTL",
+            stats.lookups, stats.hits);
+
+  comsSetDnsCacheTtl(50);
+  comsClearDnsCache();
+  comsResetDnsStats();
+  mu_assert(comsResolveHost(&host) == 0, "Unable to resolve localhost");
+  usleep(100000);
+  mu_assert(comsResolveHost(&host) == 0, "Unable to resolve localhost");
+  comsSetDnsCacheTtl(COMS_DNS_CACHE_TTL_MS);
+  comsGetDnsStats(&stats);
+  mu_assert(stats.lookups == 2 && stats.hits == 0,
+            "Expired entry not looked up again");
+
+  return NULL;
+}
+
+static void addLoopbackAddress(ResolvedHost* resolved, const char* ip) {
+  struct sockaddr_in* addr =
+      (struct sockaddr_in*)&resolved->addrs[resolved->count];
+
+  memset(addr, '\0', sizeof(struct sockaddr_in));
+  addr->sin_family = AF_INET;
+  inet_pton(AF_INET, ip, &addr->sin_addr);
+  resolved->addrLens[resolved->count] = sizeof(struct sockaddr_in);
+  resolved->count++;
+}
+
+const char* testComs_raceConnectPastRefused() {
+  NetworkBuffer request = {{0x00, 0x04, '0', '8', '0', '0'}, 6};
+  NetworkBuffer response = {{'\0'}, 0};
+  ResolvedHost resolved;
+  LoopbackHost lh;
+  Host host;
+  struct timespec start, end;
+  long elapsedMs = 0;
+  int len = 0;
+
+  mu_assert(startLoopbackHost(&lh, replyFrame, NULL, 0) == 0,
+            "Unable to start host");
+
+  // nothing listens on 127.0.0.2, the host only on 127.0.0.1
+  memset(&resolved, '\0', sizeof(resolved));
+  addLoopbackAddress(&resolved, "127.0.0.2");
+  addLoopbackAddress(&resolved, "127.0.0.1");
+  comsPutDnsEntry("refused-first.test", &resolved);
+  memcpy(&host, &lh.host, sizeof(Host));
+  strcpy(host.url, "refused-first.test");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  len = comSendReceive(&response, &request, &host, 2000, comsIsFrameComplete,
+                       NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsedMs = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+  comsClearDnsCache();
+  stopLoopbackHost(&lh);
+
+  mu_assert(len == 12, "No exchange past the refused address");
+  mu_assert(elapsedMs < COMS_CONNECT_STAGGER_MS,
+            "Waited %ldms after the refusal", elapsedMs);
+
+  return NULL;
+}
+
 // NIBSS TESTS
 // -------------------------------------------------------------
 const char* test_HandshakeNibssAllMapDeviceTrue() {
@@ -541,6 +2601,42 @@ const char* allTests() {
   mu_run_test(testHandshakeInit_comSendReceiveNotSet);
   mu_run_test(testHandshakeInit_hostNotSet);
   mu_run_test(testHandshakeInit_mapTidTrue_dataNotSet);
+  mu_run_test(testHandshakeBatch_invalidItems);
+  mu_run_test(testHandshakeCtx_deviceConfigNotSupported);
+  mu_run_test(testC8583_packUnpackNetworkManagement);
+  mu_run_test(testHandshakeCtx_connectionRefused);
+  mu_run_test(testC8583_unpackDataView);
+  mu_run_test(testC8583_arenaReset);
+  mu_run_test(testC8583_packVarLen);
+  mu_run_test(testHexcodec_kernelsMatchScalar);
+  mu_run_test(testDes3_keyedMatchesWrappers);
+  mu_run_test(testDes3_cbcMatchesEcbChain);
+  mu_run_test(testSha256_kernelsMatchScalar);
+  mu_run_test(testMacSession_matchesGenerateMac);
+  mu_run_test(testUnpackDataWithMacVerify);
+  mu_run_test(testPackDataWithMacStream);
+  mu_run_test(testPrivateField_parseAndBuild);
+  mu_run_test(testEmvTlv_indexAndBuild);
+  mu_run_test(testBitmap_iterateSetFields);
+  mu_run_test(testFieldCodecs_matchConfig);
+  mu_run_test(testComSendReceive_plainFramed);
+  mu_run_test(testComSendReceive_noSentinelReadsToClose);
+  mu_run_test(testComSendReceive_deadline);
+  mu_run_test(testHandshake_deadlineExceeded);
+  mu_run_test(testHandshakeCtx_timeoutWithoutDeadline);
+  mu_run_test(testOperationSteps_dependenciesComeFirst);
+  mu_run_test(testComsPool_maxPerHostWaits);
+  mu_run_test(testComsPool_maxIdle);
+  mu_run_test(testComsPool_idleTimeout);
+  mu_run_test(testComsPool_defaultSwappedMidRun);
+  mu_run_test(testComs_noSentinelOnKeptAlive);
+  mu_run_test(testHandshakeCtx_framedExchange);
+  mu_run_test(testHandshakeCtx_truncatedFrame);
+  mu_run_test(testHandshake_reuseConnection);
+  mu_run_test(testHandshake_concurrentMatchesSequential);
+  mu_run_test(testComsTls_sessionCache);
+  mu_run_test(testComsDns_cacheTtl);
+  mu_run_test(testComs_raceConnectPastRefused);
 
   // NIBSS TESTS
   mu_run_test(test_HandshakeNibssAllMapDeviceTrue);
@@ -1,7 +1,7 @@
 #!/usr/bin/env bash
 
 # Already built so we can comment out this line, uncomment if you haven't
-cc unpack.c c8583/*.c -o parseIso
+cc unpack.c c8583/*.c hexcodec/*.c -o parseIso
 
 ./parseIso "0200F23C46D129E09200000000000000002119506117032151823334200100000000000010003172105183777852105180317250754110510020004D0000000006636092365061170321518233342D25076010241782001921683777856012101H4062101LA200002513STAR VALUES NIGERIA LIMLA           LANG5662EBEECC65EDBA831310820258008407A0000003710001950542801418009F26087323FB67B1A9496C9F2701809F10200FA501A23132140000000000000000000F0100000000000000000000000000009F37043AC4F7D99F3602004F9A032303179C01009F02060000000001009F03060000000000005F2A0205669F1A0205669F03060000000000009F3303E0E9C89F34034203009F3501229F090201009F4104000006190155101015113441013D0206B801AC22FC63CC3152C62E8B9A1229140173891C3D50CC59104F71CED2" &>logs/request.log
 ./parseIso "0210F23C46D12BE09200000000000000002119506117032151823334200100000000000010003172105183777852105180317250754110510020004D0000000006200007365061170321518233342D2507601024178200192168377785916012101H4062101LA200002513STAR VALUES NIGERIA LIMLA           LANG5662EBEECC65EDBA8312829F26087323FB67B1A9496C9F2701809F10200FA501A23132140000000000000000000F0100000000000000000000000000009F37043AC4F7D99F3602004F950542801418009A032303179C01009F02060000000001005F2A020566820258009F1A0205669F3303E0E9C89F03060000000000009F3501229F34034203009F4104000006198407A000000371000101551010151134410117414b34fa1fa1b81f9aac46e5054591990fbc7130799ce4749bd2504d838908" &>logs/response.log